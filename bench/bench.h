@@ -0,0 +1,71 @@
+#ifndef YHB_BENCH_H
+#define YHB_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace bench {
+
+/**
+ * @brief Measure the average time of a function call.
+ *
+ * @param f         The function to measure, invoked repeatedly for about 'min_ms' milliseconds.
+ * @param min_ms    Minimum duration of the measurement.
+ * @return Nanoseconds per call.
+ */
+template <typename F>
+double measure_ns(F f, unsigned min_ms = 200) {
+    typedef std::chrono::steady_clock clock;
+    f();    // Warm up
+    uint64_t calls = 0;
+    auto const start = clock::now();
+    auto now = start;
+    do {
+        for (int i = 0; i < 16; ++i) {
+            f();
+        }
+        calls += 16;
+        now = clock::now();
+    } while (now - start < std::chrono::milliseconds(min_ms));
+    return std::chrono::duration<double, std::nano>(now - start).count() / calls;
+}
+
+/**
+ * @brief Print a result line.
+ *
+ * @param name          What was measured.
+ * @param ns_per_call   Nanoseconds per call.
+ * @param items         Items processed by each call, such as bytes, packets or lookups.
+ * @param unit          Name of the items.
+ */
+inline void report(const char * name, double ns_per_call, double items, const char * unit) {
+    printf("%-48s %12.1f ns/call %12.2f M%s/s\n", name, ns_per_call, items * 1000.0 / ns_per_call, unit);
+}
+
+/**
+ * @brief Keep the compiler from optimizing away a result.
+ *
+ * The value is an input of an empty asm statement, or read back from a volatile copy where there is no GNU asm.
+ */
+template <typename T>
+inline void keep(const T & value) {
+#if defined(__GNUC__)
+    __asm__ __volatile__("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+    T const read_back = sink;
+    (void)read_back;
+#endif
+}
+
+} // End of namespace 'bench'
+
+void bench_checksum();
+void bench_route_table();
+void bench_route_table6();
+void bench_packet_classifier();
+
+#endif
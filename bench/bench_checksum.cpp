@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "checksum.h"
+#include <vector>
+
+using Checksum = yhb::Checksum;
+
+static const char * kernel_name(Checksum::Kernel k) {
+    switch (k) {
+    case Checksum::Kernel::SCALAR: return "scalar";
+    case Checksum::Kernel::SSE2: return "sse2";
+    case Checksum::Kernel::AVX2: return "avx2";
+    case Checksum::Kernel::AVX512: return "avx512";
+    default: return "auto";
+    }
+}
+
+static void bench_kernels() {
+    std::vector<uint8_t> data(9000 + 1);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    Checksum::Kernel const kernels[] = {
+        Checksum::Kernel::SCALAR, Checksum::Kernel::SSE2, Checksum::Kernel::AVX2, Checksum::Kernel::AVX512,
+    };
+    for (size_t len : { 64, 1500, 9000 }) {
+        for (auto k : kernels) {
+            if (!Checksum::SetKernel(k)) {
+                continue;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "Calculate %zu bytes, %s", len, kernel_name(k));
+            bench::report(name, bench::measure_ns([&] {
+                bench::keep(Checksum::Calculate(&data[0], len));
+            }), static_cast<double>(len), "B");
+        }
+    }
+    Checksum::SetKernel(Checksum::Kernel::AUTO);
+}
+
+static void bench_batch() {
+    size_t const packets = 256;
+    std::vector<std::vector<uint8_t>> storage(packets);
+    std::vector<const void *> ptrs(packets);
+    std::vector<uint16_t> results(packets);
+    for (size_t len : { 64, 128, 512 }) {
+        std::vector<size_t> lens(packets, len);
+        for (size_t i = 0; i < packets; ++i) {
+            storage[i].assign(len, static_cast<uint8_t>(i));
+            ptrs[i] = storage[i].data();
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "Calculate x%zu, %zu bytes each", packets, len);
+        bench::report(name, bench::measure_ns([&] {
+            for (size_t i = 0; i < packets; ++i) {
+                results[i] = Checksum::Calculate(ptrs[i], lens[i]);
+            }
+            bench::keep(results[0]);
+        }), static_cast<double>(packets), "pkt");
+
+        snprintf(name, sizeof(name), "CalculateBatch x%zu, %zu bytes each", packets, len);
+        bench::report(name, bench::measure_ns([&] {
+            Checksum::CalculateBatch(ptrs.data(), lens.data(), nullptr, results.data(), packets);
+            bench::keep(results[0]);
+        }), static_cast<double>(packets), "pkt");
+    }
+}
+
+static void bench_parallel() {
+    std::vector<uint8_t> data(64 * 1024 * 1024, 0x5a);
+    bench::report("Calculate 64 MiB", bench::measure_ns([&] {
+        bench::keep(Checksum::Calculate(data.data(), data.size()));
+    }), static_cast<double>(data.size()), "B");
+    for (unsigned threads : { 2u, 4u, 8u }) {
+        char name[64];
+        snprintf(name, sizeof(name), "CalculateParallel 64 MiB, %u threads", threads);
+        bench::report(name, bench::measure_ns([&] {
+            bench::keep(Checksum::CalculateParallel(data.data(), data.size(), 0, threads));
+        }), static_cast<double>(data.size()), "B");
+    }
+}
+
+void bench_checksum() {
+    bench_kernels();
+    bench_batch();
+    bench_parallel();
+}
@@ -0,0 +1,31 @@
+#include "bench.h"
+#include <cstring>
+
+struct BenchEntry {
+    const char * name;
+    void (*run)();
+};
+
+static const BenchEntry ALL_BENCHES[] = {
+    { "checksum", bench_checksum },
+    { "route_table", bench_route_table },
+    { "route_table6", bench_route_table6 },
+    { "packet_classifier", bench_packet_classifier },
+};
+
+// Usage: bench [name...], runs all the benchmarks if no name is given.
+int main(int argc, char * argv[]) {
+    for (const BenchEntry & e : ALL_BENCHES) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], e.name) == 0) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            printf("== %s\n", e.name);
+            e.run();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "packet_classifier.h"
+#include <random>
+#include <vector>
+
+using PacketClassifier = yhb::PacketClassifier;
+using Rule = PacketClassifier::Rule;
+using Packet = PacketClassifier::Packet;
+
+static size_t const RULE_COUNT = 10000;
+
+static uint32_t prefix_last(uint32_t first, unsigned bits) {
+    return bits == 0 ? 0xffffffff : first | (0xffffffff >> bits);
+}
+
+// A synthetic firewall ACL, ClassBench-like: the prefixes are drawn from some hundreds of networks, most of the
+// source ports are wildcards, most of the destination ports are well-known ones, the priorities are the order.
+static void make_acl(PacketClassifier & acl, std::vector<Rule> & rules) {
+    static uint16_t const WELL_KNOWN_PORTS[] = { 22, 25, 53, 80, 110, 123, 143, 443, 993, 3306, 5432, 8080 };
+    std::mt19937 rng(1);
+    std::vector<uint32_t> networks(500);
+    for (uint32_t & net : networks) {
+        net = static_cast<uint32_t>(rng()) & 0xffff0000;
+    }
+    auto prefix = [&](unsigned min_bits) {
+        unsigned const bits = min_bits + rng() % (33 - min_bits);
+        uint32_t const ip = networks[rng() % networks.size()] | (static_cast<uint32_t>(rng()) & 0xffff);
+        uint32_t const first = bits == 0 ? 0 : ip & (0xffffffff << (32 - bits));
+        return yhb::RouteTable::IpRange{ first, prefix_last(first, bits) };
+    };
+    for (size_t i = 0; i < RULE_COUNT; ++i) {
+        Rule r;
+        r.src = rng() % 100 < 30 ? yhb::RouteTable::IpRange{ 0, 0xffffffff } : prefix(8);
+        r.dst = rng() % 100 < 10 ? yhb::RouteTable::IpRange{ 0, 0xffffffff } : prefix(16);
+        r.src_port = rng() % 100 < 80 ? PacketClassifier::PortRange{ 0, 0xffff }
+            : PacketClassifier::PortRange{ 1024, 0xffff };
+        unsigned const dice = rng() % 100;
+        if (dice < 45) {
+            uint16_t const port = WELL_KNOWN_PORTS[rng() % (sizeof(WELL_KNOWN_PORTS) / sizeof(WELL_KNOWN_PORTS[0]))];
+            r.dst_port = PacketClassifier::PortRange{ port, port };
+        } else if (dice < 65) {
+            uint16_t const first = static_cast<uint16_t>(rng() % 60000);
+            r.dst_port = PacketClassifier::PortRange{ first, static_cast<uint16_t>(first + rng() % 5000) };
+        } else {
+            r.dst_port = PacketClassifier::PortRange{ 0, 0xffff };
+        }
+        unsigned const proto = rng() % 100;
+        r.protocol = proto < 45 ? PacketClassifier::ProtocolRange{ 6, 6 }
+            : proto < 75 ? PacketClassifier::ProtocolRange{ 17, 17 } : PacketClassifier::ProtocolRange{ 0, 0xff };
+        r.priority = static_cast<uint32_t>(i);
+        r.id = static_cast<uint32_t>(i);
+        acl.AddRule(r);
+        rules.push_back(r);
+    }
+}
+
+// Three quarters of the packets are in the ranges of a rule, the others are random.
+static std::vector<Packet> make_packets(const std::vector<Rule> & rules, size_t n) {
+    std::mt19937 rng(2);
+    auto in = [&rng](uint32_t first, uint32_t last) {
+        return first + static_cast<uint32_t>(rng() % (uint64_t(last) - first + 1));
+    };
+    std::vector<Packet> packets(n);
+    for (size_t i = 0; i < n; ++i) {
+        Packet & p = packets[i];
+        if (i % 4 != 0) {
+            const Rule & r = rules[rng() % rules.size()];
+            p.src = in(r.src.first, r.src.last);
+            p.dst = in(r.dst.first, r.dst.last);
+            p.src_port = static_cast<uint16_t>(in(r.src_port.first, r.src_port.last));
+            p.dst_port = static_cast<uint16_t>(in(r.dst_port.first, r.dst_port.last));
+            p.protocol = static_cast<uint8_t>(in(r.protocol.first, r.protocol.last));
+        } else {
+            p.src = rng();
+            p.dst = rng();
+            p.src_port = static_cast<uint16_t>(rng());
+            p.dst_port = static_cast<uint16_t>(rng());
+            p.protocol = rng() % 2 ? 6 : 17;
+        }
+    }
+    return packets;
+}
+
+static void bench_classify(const char * name, const PacketClassifier & acl, const std::vector<Packet> & packets) {
+    bench::report(name, bench::measure_ns([&] {
+        uint32_t sum = 0;
+        for (const Packet & p : packets) {
+            sum += acl.Classify(p);
+        }
+        bench::keep(sum);
+    }), static_cast<double>(packets.size()), "packet");
+}
+
+void bench_packet_classifier() {
+    PacketClassifier acl;
+    std::vector<Rule> rules;
+    make_acl(acl, rules);
+    std::vector<Packet> const packets = make_packets(rules, 1 << 16);
+    printf("%zu rules\n", acl.GetRuleCount());
+
+    std::vector<Packet> const few(packets.begin(), packets.begin() + 1024);
+    bench_classify("Classify, linear scan", acl, few);
+
+    PacketClassifier::CompileStats const stats = acl.Compile();
+    printf("Compile: %.1f ms, %.1f MiB, %zu vectors\n", stats.build_time_ns / 1e6,
+        stats.memory_bytes / (1024.0 * 1024.0), stats.vector_count);
+    bench_classify("Classify, bit vectors", acl, packets);
+
+    std::vector<uint32_t> ids(packets.size());
+    bench::report("ClassifyBatch, bit vectors", bench::measure_ns([&] {
+        acl.ClassifyBatch(packets.data(), packets.size(), ids.data());
+        bench::keep(ids[0]);
+    }), static_cast<double>(packets.size()), "packet");
+}
@@ -0,0 +1,393 @@
+#include "bench.h"
+#include "route_table.h"
+#include "frozen_route_table.h"
+#include "mapped_route_table.h"
+#include "shared_route_table.h"
+#include "route_map.h"
+#include "rcu_holder.h"
+#include "expiring_route_table.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using RouteTable = yhb::RouteTable;
+using FrozenRouteTable = yhb::FrozenRouteTable;
+using MappedRouteTable = yhb::MappedRouteTable;
+
+// A blocklist-like table, mostly single addresses and small prefixes.
+static void make_table(RouteTable & tab, size_t count) {
+    std::mt19937 rng(1);
+    std::vector<RouteTable::CIDR> cidrs(count);
+    for (auto & c : cidrs) {
+        c.network_bits = 20 + rng() % 13;
+        c.prefix = static_cast<uint32_t>(rng());
+    }
+    tab.BulkInsert(cidrs.data(), cidrs.size());
+}
+
+static std::vector<uint32_t> make_ips(size_t count) {
+    std::mt19937 rng(2);
+    std::vector<uint32_t> ips(count);
+    for (uint32_t & ip : ips) {
+        ip = rng();
+    }
+    return ips;
+}
+
+static void bench_find(const char * name, const RouteTable & tab, const std::vector<uint32_t> & ips) {
+    bench::report(name, bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += tab.Find(ip, true);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+static void bench_find_batch(const char * name, const RouteTable & tab, const std::vector<uint32_t> & ips,
+    bool host_order)
+{
+    std::vector<uint8_t> out(ips.size());
+    bench::report(name, bench::measure_ns([&] {
+        tab.FindBatch(ips.data(), ips.size(), host_order, out.data());
+        bench::keep(out[0]);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+static void bench_find_net_order(const char * name, const RouteTable & tab, const std::vector<uint32_t> & ips) {
+    bench::report(name, bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += tab.Find(ip, false);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+static void bench_compile() {
+    RouteTable tab;
+    make_table(tab, 900000);
+    std::vector<uint32_t> const ips = make_ips(1 << 16);
+    printf("%zu ranges\n", tab.GetCount());
+
+    bench_find("Find, binary search", tab, ips);
+    bench_find_batch("FindBatch, binary search", tab, ips, true);
+    bench_find_net_order("Find, binary search, net order", tab, ips);
+    bench_find_batch("FindBatch, binary search, net order", tab, ips, false);
+
+    FrozenRouteTable const frozen(tab);
+    printf("Frozen: %.2f bytes per range\n", static_cast<double>(frozen.GetMemoryUsage()) / frozen.GetCount());
+    for (auto k : { FrozenRouteTable::Kernel::SCALAR, FrozenRouteTable::Kernel::AVX2 }) {
+        if (!FrozenRouteTable::SetKernel(k)) {
+            continue;
+        }
+        bench::report(k == FrozenRouteTable::Kernel::SCALAR ? "Find, frozen, scalar" : "Find, frozen, avx2",
+            bench::measure_ns([&] {
+                size_t hits = 0;
+                for (uint32_t ip : ips) {
+                    hits += frozen.Find(ip, true);
+                }
+                bench::keep(hits);
+            }), static_cast<double>(ips.size()), "lookup");
+    }
+    FrozenRouteTable::SetKernel(FrozenRouteTable::Kernel::AUTO);
+
+    RouteTable::CompileStats const stats = tab.Compile();
+    printf("Compile: %.1f ms, %.1f MiB, %zu groups\n", stats.build_time_ns / 1e6,
+        stats.memory_bytes / 1048576.0, stats.group_count);
+    bench_find("Find, DIR-24-8", tab, ips);
+    bench_find_batch("FindBatch, DIR-24-8", tab, ips, true);
+    bench_find_net_order("Find, DIR-24-8, net order", tab, ips);
+    bench_find_batch("FindBatch, DIR-24-8, net order", tab, ips, false);
+}
+
+static void bench_bulk_insert() {
+    std::mt19937 rng(3);
+    std::vector<RouteTable::CIDR> cidrs(200000);
+    for (auto & c : cidrs) {
+        c.prefix = static_cast<uint32_t>(rng());
+        c.network_bits = 20 + rng() % 13;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "Insert x%zu", cidrs.size());
+    bench::report(name, bench::measure_ns([&] {
+        RouteTable tab;
+        for (auto const & c : cidrs) {
+            tab.Insert(c.prefix, c.network_bits);
+        }
+        bench::keep(tab.GetCount());
+    }, 1), static_cast<double>(cidrs.size()), "rule");
+    snprintf(name, sizeof(name), "BulkInsert x%zu", cidrs.size());
+    bench::report(name, bench::measure_ns([&] {
+        RouteTable tab;
+        tab.BulkInsert(cidrs.data(), cidrs.size());
+        bench::keep(tab.GetCount());
+    }), static_cast<double>(cidrs.size()), "rule");
+}
+
+static void bench_load() {
+    std::mt19937 rng(4);
+    std::string text;
+    char line[64];
+    size_t const lines = 1000000;
+    for (size_t i = 0; i < lines; ++i) {
+        uint32_t const ip = static_cast<uint32_t>(rng());
+        snprintf(line, sizeof(line), "%u.%u.%u.%u/%u\n", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+            static_cast<unsigned>(20 + rng() % 13));
+        text += line;
+    }
+    bench::report("LoadFromBuffer 1M lines", bench::measure_ns([&] {
+        RouteTable tab;
+        bench::keep(tab.LoadFromBuffer(text.data(), text.size()));
+    }, 1000), static_cast<double>(lines), "line");
+}
+
+static void bench_snapshot() {
+    char const path[] = "bench_route_table.snapshot";
+    RouteTable tab;
+    make_table(tab, 900000);
+    for (bool with_index : { false, true }) {
+        if (with_index) {
+            tab.Compile();
+        }
+        if (!tab.SaveSnapshot(path)) {
+            printf("SaveSnapshot failed\n");
+            return;
+        }
+        std::string const name = with_index ? "MappedRouteTable::Open, indexed" : "MappedRouteTable::Open";
+        bench::report(name.c_str(), bench::measure_ns([&] {
+            MappedRouteTable mapped;
+            bench::keep(mapped.Open(path, false));
+        }), 1, "open");
+        bench::report((name + ", verified").c_str(), bench::measure_ns([&] {
+            MappedRouteTable mapped;
+            bench::keep(mapped.Open(path, true));
+        }), 1, "open");
+    }
+    remove(path);
+}
+
+static void bench_set_algebra() {
+    RouteTable allow;
+    make_table(allow, 900000);
+    RouteTable block;
+    std::mt19937 rng(6);
+    std::vector<RouteTable::CIDR> cidrs(20000);
+    for (auto & c : cidrs) {
+        c.network_bits = 16 + rng() % 17;
+        c.prefix = static_cast<uint32_t>(rng());
+    }
+    block.BulkInsert(cidrs.data(), cidrs.size());
+    double const items = static_cast<double>(allow.GetCount() + block.GetCount());
+
+    bench::report("Union, by Insert", bench::measure_ns([&] {
+        RouteTable result = allow;
+        for (auto const & r : block) {
+            result.Insert(r);
+        }
+        bench::keep(result.GetCount());
+    }, 1), items, "range");
+    bench::report("Union", bench::measure_ns([&] {
+        bench::keep(RouteTable::Union(allow, block).GetCount());
+    }), items, "range");
+    bench::report("Difference", bench::measure_ns([&] {
+        bench::keep(RouteTable::Difference(allow, block).GetCount());
+    }), items, "range");
+    RouteTable result;
+    bench::report("Subtract, in place", bench::measure_ns([&] {
+        result = allow;
+        result.Subtract(block);
+        bench::keep(result.GetCount());
+    }), items, "range");
+}
+
+// A compiled table published to the shared memory, then picked up by a reader.
+static void bench_shared() {
+    char const name[] = "/yhb_bench_route_table";
+    RouteTable tab;
+    make_table(tab, 900000);
+    tab.Compile();
+    yhb::SharedRouteTable::Unlink(name);
+    bench::report("SharedRouteTable::Publish", bench::measure_ns([&] {
+        bench::keep(yhb::SharedRouteTable::Publish(name, tab));
+    }), 1, "generation");
+    yhb::SharedRouteTable reader;
+    if (!reader.Open(name, false)) {
+        printf("SharedRouteTable::Open failed\n");
+        return;
+    }
+    bench::report("SharedRouteTable::Refresh, unchanged", bench::measure_ns([&] {
+        bench::keep(reader.Refresh());
+    }), 1, "call");
+    bench::report("SharedRouteTable, Publish and Refresh", bench::measure_ns([&] {
+        yhb::SharedRouteTable::Publish(name, tab);
+        bench::keep(reader.Refresh());
+    }), 1, "generation");
+    std::vector<uint32_t> const ips = make_ips(1 << 16);
+    bench::report("SharedRouteTable::Find", bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += reader.Find(ip, true);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+    reader.Close();
+    yhb::SharedRouteTable::Unlink(name);
+}
+
+// A small update of a large compiled table, patched in place or rebuilt and compiled again.
+static void bench_apply_delta() {
+    RouteTable tab;
+    make_table(tab, 900000);
+    std::mt19937 rng(7);
+    std::vector<RouteTable::IpRange> adds(300);
+    std::vector<RouteTable::IpRange> removes(300);
+    for (auto * delta : { &adds, &removes }) {
+        for (auto & r : *delta) {
+            r.first = static_cast<uint32_t>(rng());
+            r.last = r.first + (rng() & 0xfff);
+            if (r.last < r.first) {
+                r.last = 0xffffffff;
+            }
+        }
+    }
+    RouteTable::IpRange const * a = adds.data();
+    RouteTable::IpRange const * b = removes.data();
+    double const items = static_cast<double>(adds.size() + removes.size());
+
+    tab.Compile();
+    bench::report("ApplyDelta, compiled", bench::measure_ns([&] {
+        tab.ApplyDelta(a, adds.size(), b, removes.size());
+        std::swap(a, b);
+        bench::keep(tab.GetCount());
+    }), items, "change");
+    bench::report("Erase and Insert, then Compile", bench::measure_ns([&] {
+        for (size_t i = 0; i < removes.size(); ++i) {
+            tab.Erase(b[i]);
+        }
+        for (size_t i = 0; i < adds.size(); ++i) {
+            tab.Insert(a[i]);
+        }
+        std::swap(a, b);
+        bench::keep(tab.Compile().group_count);
+    }, 1), items, "change");
+}
+
+// Bans of /24 to /32 for up to 10 minutes, 2000 per second, the clock in milliseconds advanced every 10 ms.
+// Then the lookups of the table in the steady state, against a compiled static table of the same addresses.
+static void bench_expiring() {
+    std::mt19937 rng(8);
+    yhb::ExpiringRouteTable tab;
+    size_t const seconds = 900;
+    size_t const bans_per_tick = 20;
+    size_t expired = 0;
+    // Run once, the table changes.
+    auto const start = std::chrono::steady_clock::now();
+    for (uint64_t now = 10; now <= seconds * 1000; now += 10) {
+        for (size_t i = 0; i < bans_per_tick; ++i) {
+            tab.Insert(static_cast<uint32_t>(rng()), 24 + rng() % 9, now + 1000 + rng() % 599000);
+        }
+        expired += tab.Advance(now);
+    }
+    double const ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu segments, %zu expired\n", tab.GetSegmentCount(), expired);
+    bench::report("ExpiringRouteTable, ban and expire", ns, static_cast<double>(seconds * 100 * bans_per_tick), "ban");
+
+    std::vector<uint32_t> const ips = make_ips(1 << 16);
+    RouteTable copy = tab.ToRouteTable();
+    copy.Compile();
+    bench::report("ExpiringRouteTable::Find", bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += tab.Find(ip, true);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+    bench::report("RouteTable::Find of the same, compiled", bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += copy.Find(ip, true);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+// The CIDRs of a large table, for a router configuration for example.
+static void bench_export() {
+    RouteTable tab;
+    make_table(tab, 900000);
+    std::vector<RouteTable::CIDR> cidrs(tab.CountCIDRs());
+    printf("%zu CIDRs\n", cidrs.size());
+    double const items = static_cast<double>(cidrs.size());
+    bench::report("IpRange::ToCIDR, std::function", bench::measure_ns([&] {
+        std::vector<RouteTable::CIDR> result;
+        for (auto const & r : tab) {
+            r.ToCIDR([&result](RouteTable::CIDR cidr) {
+                result.push_back(cidr);
+            });
+        }
+        bench::keep(result.size());
+    }), items, "CIDR");
+    bench::report("ExportCIDRs", bench::measure_ns([&] {
+        bench::keep(tab.ExportCIDRs(cidrs.data()) - cidrs.data());
+    }), items, "CIDR");
+}
+
+// A guard per lookup, the worst case of the readers of a RouteTableHolder.
+static void bench_holder() {
+    std::unique_ptr<RouteTable> tab(new RouteTable());
+    make_table(*tab, 900000);
+    tab->Compile();
+    yhb::RouteTableHolder holder(std::unique_ptr<const RouteTable>(tab.release()));
+    std::vector<uint32_t> const ips = make_ips(1 << 16);
+    bench::report("RouteTableHolder, Read and Find", bench::measure_ns([&] {
+        size_t hits = 0;
+        for (uint32_t ip : ips) {
+            hits += holder.Read()->Find(ip, true);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+// A forwarding table, prefixes from /8 to /32 with next hop IDs, the more specific ones nested in the others.
+static void bench_route_map() {
+    std::mt19937 rng(5);
+    yhb::RouteMap<uint32_t> map;
+    for (uint32_t i = 0; i < 900000; ++i) {
+        unsigned const bits = 8 + rng() % 25;
+        map.Insert(static_cast<uint32_t>(rng()), bits, i % 64);
+    }
+    std::vector<uint32_t> const ips = make_ips(1 << 16);
+    printf("%zu prefixes\n", map.GetCount());
+    auto const find_all = [&] {
+        uint32_t sum = 0;
+        for (uint32_t ip : ips) {
+            const uint32_t * const hop = map.Find(ip, true);
+            sum += hop != nullptr ? *hop : 0;
+        }
+        bench::keep(sum);
+    };
+    bench::report("RouteMap::Find, hash per length", bench::measure_ns(find_all), static_cast<double>(ips.size()),
+        "lookup");
+    RouteTable::CompileStats const stats = map.Compile();
+    printf("RouteMap::Compile: %.1f ms, %.1f MiB, %zu groups\n", stats.build_time_ns / 1e6,
+        stats.memory_bytes / 1048576.0, stats.group_count);
+    bench::report("RouteMap::Find, DIR-24-8", bench::measure_ns(find_all), static_cast<double>(ips.size()),
+        "lookup");
+}
+
+void bench_route_table() {
+    bench_compile();
+    bench_bulk_insert();
+    bench_load();
+    bench_snapshot();
+    bench_shared();
+    bench_set_algebra();
+    bench_apply_delta();
+    bench_expiring();
+    bench_export();
+    bench_holder();
+    bench_route_map();
+}
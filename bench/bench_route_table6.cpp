@@ -0,0 +1,85 @@
+#include "bench.h"
+#include "route_table.h"
+#include "route_table6.h"
+#include <random>
+#include <vector>
+
+using RouteTable = yhb::RouteTable;
+using RouteTable6 = yhb::RouteTable6;
+using Address = RouteTable6::Address;
+
+static size_t const TABLE_SIZE = 200000;
+
+// A BGP-like table, prefixes from /32 to /64 in 2000::/3, and some single addresses.
+static void make_table6(RouteTable6 & tab, std::vector<Address> & ips) {
+    std::mt19937_64 rng(1);
+    for (size_t i = 0; i < TABLE_SIZE; ++i) {
+        Address const a = { 0x2000000000000000ull | (rng() >> 3), rng() };
+        uint8_t bytes[16];
+        a.ToBytes(bytes);
+        tab.Insert(bytes, i % 10 == 0 ? 128 : static_cast<unsigned>(32 + rng() % 33));
+    }
+    // Half of the lookups hit near the prefixes, the others are random in 2000::/3.
+    ips.resize(1 << 16);
+    for (size_t i = 0; i < ips.size(); ++i) {
+        if (i % 2 == 0) {
+            const RouteTable6::IpRange & r = *(tab.begin() + rng() % tab.GetCount());
+            ips[i] = Address{ r.first.hi + (rng() & 0xff), rng() };
+        } else {
+            ips[i] = Address{ 0x2000000000000000ull | (rng() >> 3), rng() };
+        }
+    }
+}
+
+static void make_table4(RouteTable & tab, std::vector<uint32_t> & ips) {
+    std::mt19937 rng(1);
+    std::vector<RouteTable::CIDR> cidrs(TABLE_SIZE);
+    for (auto & c : cidrs) {
+        c.network_bits = 20 + rng() % 13;
+        c.prefix = static_cast<uint32_t>(rng());
+    }
+    tab.BulkInsert(cidrs.data(), cidrs.size());
+    ips.resize(1 << 16);
+    for (uint32_t & ip : ips) {
+        ip = rng();
+    }
+}
+
+template <typename Table, typename Ip>
+static void bench_find(const char * name, const Table & tab, const std::vector<Ip> & ips) {
+    bench::report(name, bench::measure_ns([&] {
+        size_t hits = 0;
+        for (const Ip & ip : ips) {
+            hits += tab.Find(ip);
+        }
+        bench::keep(hits);
+    }), static_cast<double>(ips.size()), "lookup");
+}
+
+// Adapt RouteTable::Find() to the single argument of bench_find().
+struct HostOrderTable {
+    const RouteTable & tab;
+    bool Find(uint32_t ip) const {
+        return tab.Find(ip, true);
+    }
+};
+
+void bench_route_table6() {
+    RouteTable6 tab6;
+    std::vector<Address> ips6;
+    make_table6(tab6, ips6);
+    RouteTable tab4;
+    std::vector<uint32_t> ips4;
+    make_table4(tab4, ips4);
+    printf("%zu IPv6 ranges, %zu IPv4 ranges\n", tab6.GetCount(), tab4.GetCount());
+
+    bench_find("IPv4 Find, binary search", HostOrderTable{ tab4 }, ips4);
+    bench_find("IPv6 Find, binary search", tab6, ips6);
+
+    tab4.Compile();
+    RouteTable6::CompileStats const stats = tab6.Compile();
+    printf("Compile IPv6: %.1f ms, %.1f MiB, %zu nodes\n", stats.build_time_ns / 1e6,
+        stats.memory_bytes / 1048576.0, stats.node_count);
+    bench_find("IPv4 Find, DIR-24-8", HostOrderTable{ tab4 }, ips4);
+    bench_find("IPv6 Find, trie", tab6, ips6);
+}
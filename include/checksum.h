@@ -28,6 +28,10 @@ SOFTWARE.
 #include <cstdint>
 #include <cstddef>
 
+#ifndef _WIN32
+struct iovec;
+#endif
+
 namespace yhb {
 
 struct Checksum {
@@ -43,6 +47,192 @@ struct Checksum {
      * it needs to be using the bitwise NOT operator '~'.
      */
     static uint16_t Calculate(const void * dataptr, size_t len, uint16_t additional = 0);
+
+#ifndef _WIN32
+    /**
+     * @brief Calculate the checksum of data scattered in several memory blocks.
+     *
+     * The byte parity is carried across the blocks, so they can have any length, odd or even.
+     *
+     * @param iov           The memory blocks, in order.
+     * @param count         Number of the memory blocks.
+     * @param additional    Additional value to be accumulated in the result.
+     * @return uint16_t     The same as Calculate() on all the blocks concatenated at an even address.
+     */
+    static uint16_t Calculate(const struct iovec * iov, size_t count, uint16_t additional = 0);
+#endif
+
+    /**
+     * @brief Copy a memory block and calculate its checksum in a single pass.
+     *
+     * @param dst           Destination of the copy, must not overlap the source.
+     * @param src           Source memory block.
+     * @param len           Length of the memory block.
+     * @param additional    Additional value to be accumulated in the result.
+     * @return uint16_t     The same as memcpy(dst, src, len) followed by Calculate(dst, len, additional).
+     */
+    static uint16_t CopyAndCalculate(void * dst, const void * src, size_t len, uint16_t additional = 0);
+
+    /**
+     * @brief Calculate the checksums of many memory blocks at once.
+     *
+     * It's faster than calling Calculate() one by one for bursts of small packets, the blocks are summed
+     * interleaved so that their loads and additions overlap.
+     *
+     * @param dataptrs      Pointers to the beginning of the memory blocks.
+     * @param lens          Lengths of the memory blocks.
+     * @param additionals   Additional value of each memory block, nullptr for all zeros.
+     * @param results       Receives the results, results[i] is the same as Calculate(dataptrs[i], lens[i], additionals[i]).
+     * @param count         Number of the memory blocks.
+     */
+    static void CalculateBatch(const void * const * dataptrs, const size_t * lens, const uint16_t * additionals,
+                               uint16_t * results, size_t count);
+
+    /**
+     * @brief Calculate the checksum of a large memory block with several threads.
+     *
+     * The block is split into chunks summed on a shared thread pool, the result is the same as Calculate().
+     * Blocks too short to benefit from it are calculated by the calling thread alone.
+     *
+     * @param dataptr       Pointer to the beginning of the memory block.
+     * @param len           Length of the memory block.
+     * @param additional    Additional value to be accumulated in the result.
+     * @param max_threads   Number of chunks to split into at most, the calling thread and the workers of the pool
+     *                      take them. Zero for the count of the hardware threads.
+     * @return uint16_t     The result, @see Calculate().
+     */
+    static uint16_t CalculateParallel(const void * dataptr, size_t len, uint16_t additional = 0, unsigned max_threads = 0);
+
+    /**
+     * @brief Update a checksum field after a 16-bit word of the covered data changed (RFC 1624, eqn. 3).
+     *
+     * @param checksum      The checksum field, as stored in the header (the bitwise NOT of the sum).
+     * @param old_value     The replaced 16-bit word.
+     * @param new_value     The new 16-bit word.
+     * @return uint16_t     The new checksum field.
+     * @note All the values are in the same byte order, usually as they are in the packet.
+     */
+    static uint16_t Update16(uint16_t checksum, uint16_t old_value, uint16_t new_value);
+
+    /**
+     * @brief Update a checksum field after a 32-bit word of the covered data changed, such as an IPv4 address.
+     *
+     * The 32-bit word must start at an even offset of the covered data.
+     * @see Update16()
+     */
+    static uint16_t Update32(uint16_t checksum, uint32_t old_value, uint32_t new_value);
+
+    /**
+     * @brief Implementations of the bulk summing loop.
+     *
+     * The fastest one supported by the CPU is picked at startup. All of them give identical results.
+     */
+    enum class Kernel {
+        AUTO,           // The fastest one supported by the running CPU.
+        SCALAR,         // Portable, 64 bits per addition.
+        SSE2,
+        AVX2,
+        AVX512,
+    };
+
+    /**
+     * @brief Select the kernel used by all the calculations, mainly for testing and benchmarking.
+     *
+     * @param kernel    The kernel to use, Kernel::AUTO restores the startup choice.
+     * @return Returning false if the running CPU does not support the kernel, the current one remains.
+     * @note It is not thread-safe, do not call it while other threads are calculating.
+     */
+    static bool SetKernel(Kernel kernel);
+
+    /**
+     * @brief Get the kernel currently in use, never Kernel::AUTO.
+     */
+    static Kernel GetKernel();
+};
+
+/**
+ * @brief Checksums of the transport layer (TCP, UDP, ICMP and ICMPv6), taken straight from the IP packet.
+ *
+ * The IPv4 or IPv6 pseudo header is summed from the IP header fields, no temporary header is built.
+ * IPv6 Hop-by-Hop, Routing, Destination Options and Authentication extension headers are skipped,
+ * fragments are not supported.
+ *
+ * For all the functions:
+ * @param ip_header Pointer to the IPv4 or IPv6 header (by the version field), no alignment required.
+ * @param len       Length of the available data, starting from the IP header. The packet lengths in
+ *                  the IP header should not exceed it.
+ */
+struct L4Checksum {
+
+    /**
+     * @brief Calculate the value of the checksum field of a TCP, UDP, ICMP or ICMPv6 packet.
+     *
+     * @param checksum[out] Receives the checksum, to be stored in the header as it is.
+     *                      The value of the checksum field itself is taken as zero.
+     * @return Returning false if the packet is malformed, truncated or of other protocols.
+     */
+    static bool Calculate(const void * ip_header, size_t len, uint16_t * checksum);
+
+    /**
+     * @brief Calculate the checksum of a TCP, UDP, ICMP or ICMPv6 packet and store it in the header.
+     *
+     * @return Returning false if the packet is malformed, truncated or of other protocols.
+     */
+    static bool Update(void * ip_header, size_t len);
+
+    /**
+     * @brief Verify the checksum of a TCP, UDP, ICMP or ICMPv6 packet.
+     *
+     * An IPv4 UDP packet without checksum (zero) is taken as valid.
+     * @return Returning false if the checksum is wrong, or the packet is malformed, truncated or of other protocols.
+     */
+    static bool Verify(const void * ip_header, size_t len);
+
+    /**
+     * @brief Verify the checksums of the IPv4 header (if IPv4) and the TCP, UDP, ICMP or ICMPv6 packet
+     * in a single pass, for the receive path.
+     *
+     * @return Returning false if any of the checksums is wrong, or the packet is malformed, truncated
+     *          or of other protocols.
+     */
+    static bool VerifyPacket(const void * ip_header, size_t len);
+};
+
+/**
+ * @brief Rewrite the fields of an IPv4 packet, and patch the IP and the TCP/UDP checksums in place,
+ * in constant time.
+ *
+ * The TCP/UDP checksum is only patched when the packet carries the L4 header, that is, it's not
+ * a non-first fragment. A zero UDP checksum means no checksum and is kept as it is.
+ *
+ * For all the functions:
+ * @param ip_header Pointer to the IPv4 header, no alignment required.
+ * @param len       Length of the available data, starting from the IPv4 header.
+ * @return Returning false if the packet is malformed or too short, the packet remains unchanged.
+ */
+struct IPv4Rewriter {
+
+    static bool SetSourceAddress(void * ip_header, size_t len, uint32_t addr_net_order);
+
+    static bool SetDestinationAddress(void * ip_header, size_t len, uint32_t addr_net_order);
+
+    /**
+     * @brief Set the TCP or UDP source port.
+     * @return Also returning false if it's neither TCP nor UDP, or a non-first fragment.
+     */
+    static bool SetSourcePort(void * ip_header, size_t len, uint16_t port_net_order);
+
+    /**
+     * @brief Set the TCP or UDP destination port.
+     * @return Also returning false if it's neither TCP nor UDP, or a non-first fragment.
+     */
+    static bool SetDestinationPort(void * ip_header, size_t len, uint16_t port_net_order);
+
+    /**
+     * @brief Decrease the TTL by one.
+     * @return Also returning false if the TTL is zero already.
+     */
+    static bool DecreaseTTL(void * ip_header, size_t len);
 };
 
 } // End of namespace
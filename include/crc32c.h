@@ -0,0 +1,86 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_CRC32C_H
+#define YHB_CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace yhb {
+
+/**
+ * @brief CRC-32C (Castagnoli), as used by SCTP, iSCSI, ext4 and so on.
+ */
+struct CRC32C {
+
+    /**
+     * @brief Calculate the CRC-32C of the given memory block.
+     *
+     * @param dataptr   Pointer to the beginning of the memory block.
+     * @param len       Length of the memory block.
+     * @param crc       CRC of the preceding data, for calculating piece by piece. Zero for the first piece.
+     * @return uint32_t The CRC of the preceding data followed by this memory block.
+     */
+    static uint32_t Calculate(const void * dataptr, size_t len, uint32_t crc = 0);
+
+    /**
+     * @brief Combine the CRCs of two consecutive memory blocks, A followed by B.
+     *
+     * @param crc1  CRC of the block A.
+     * @param crc2  CRC of the block B.
+     * @param len2  Length of the block B.
+     * @return uint32_t The CRC of A followed by B, as if calculated in one go.
+     */
+    static uint32_t Combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+    /**
+     * @brief Implementations of the calculation.
+     *
+     * The fastest one supported by the CPU is picked at startup. All of them give identical results.
+     */
+    enum class Kernel {
+        AUTO,           // The fastest one supported by the running CPU.
+        SOFTWARE,       // Portable, slice-by-8.
+        SSE42,          // The 'crc32' instruction, three streams interleaved for long blocks. x86-64 only.
+    };
+
+    /**
+     * @brief Select the kernel used by all the calculations, mainly for testing and benchmarking.
+     *
+     * @param kernel    The kernel to use, Kernel::AUTO restores the startup choice.
+     * @return Returning false if the running CPU does not support the kernel, the current one remains.
+     * @note It is not thread-safe, do not call it while other threads are calculating.
+     */
+    static bool SetKernel(Kernel kernel);
+
+    /**
+     * @brief Get the kernel currently in use, never Kernel::AUTO.
+     */
+    static Kernel GetKernel();
+};
+
+} // End of namespace
+
+#endif
@@ -0,0 +1,156 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef YHB_EXPIRING_ROUTE_TABLE_H
+#define YHB_EXPIRING_ROUTE_TABLE_H
+
+#include "route_table.h"
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+
+namespace yhb {
+
+template <typename T> class TimingWheel;
+namespace dir24_8 { struct Index; }
+
+/**
+ * @brief A route table of which the rules expire, for the dynamic block lists such as the short-lived bans.
+ *
+ * The time is counted in ticks of a clock given by the caller, milliseconds or seconds for example. Each rule has
+ * a deadline, an address matches while any rule of it has not expired, so a rule overlapping a later one only
+ * expires for the addresses not covered by the later one.
+ *
+ * The addresses are kept as disjoint segments, each with the latest deadline of the rules covering it, and the
+ * segments are retired by a hierarchical timing wheel as the clock is advanced, O(1) per tick amortized.
+ * The addresses matching are kept in a DIR-24-8 index, the same as RouteTable::Compile() builds, so Find() is
+ * as cheap as that of a compiled static table. The index is patched for the /24 blocks of each rule added or
+ * segment expired, never rebuilt, it takes 64 MiB plus 32 bytes for each /24 block partially matched.
+ */
+class ExpiringRouteTable {
+public:
+    /**
+     * @brief Create an empty table.
+     *
+     * @param now The current time, in ticks.
+     */
+    explicit ExpiringRouteTable(uint64_t now = 0);
+
+    ~ExpiringRouteTable();
+
+    ExpiringRouteTable(const ExpiringRouteTable &) = delete;
+    ExpiringRouteTable & operator = (const ExpiringRouteTable &) = delete;
+
+    /**
+     * @brief Add a rule by IP range, matching until the given time.
+     *
+     * @param range The addresses.
+     * @param expire_at The time the rule expires at, in ticks. A rule already expired is not added.
+     * @return Returning false if range parameter is not valid.
+     */
+    bool Insert(RouteTable::IpRange range, uint64_t expire_at);
+
+    /**
+     * @brief Add a rule by address prefix and length, @see RouteTable::Insert(uint32_t, unsigned).
+     */
+    bool Insert(uint32_t prefix_net_order, unsigned network_bits, uint64_t expire_at);
+
+    /**
+     * @brief Add a rule by CIDR string, @see RouteTable::Insert(const char *).
+     */
+    bool Insert(const char * cidr_str, uint64_t expire_at);
+
+    /**
+     * @brief Move the clock forward and remove the addresses of which all the rules have expired.
+     *
+     * @param now The current time, in ticks, a time before the current one is ignored.
+     * @return Returning the number of the segments expired.
+     */
+    size_t Advance(uint64_t now);
+
+    /**
+     * @brief The current time, in ticks.
+     */
+    uint64_t GetTime() const;
+
+    /**
+     * @brief Check if the given IP address matches a rule not expired as of the last Advance().
+     *
+     * @param ip The IP.
+     * @param host_order Is the IP address host or net bits order.
+     */
+    bool Find(uint32_t ip, bool host_order) const;
+
+    /**
+     * @brief The time the given IP address stops matching at.
+     *
+     * @param ip The IP, by host bits order.
+     * @param expire_at Receives the latest deadline of the rules of the address.
+     * @return Returning false if the address does not match.
+     */
+    bool GetExpiry(uint32_t ip, uint64_t & expire_at) const;
+
+    /**
+     * @brief Number of the segments of the addresses with different deadlines.
+     */
+    size_t GetSegmentCount() const {
+        return segments.size();
+    }
+
+    bool IsEmpty() const {
+        return segments.empty();
+    }
+
+    /**
+     * @brief A static table of the addresses matching, to be saved or combined for example.
+     */
+    RouteTable ToRouteTable() const;
+
+    /**
+     * @brief Remove all the rules.
+     */
+    void Clear();
+
+private:
+    struct Segment {
+        uint32_t last;
+        uint64_t expire_at;
+    };
+
+    // A timer of a segment, stale if the segment has been split, merged or extended since.
+    struct SegmentTimer {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    std::map<uint32_t, Segment> segments;           // By the first addresses, disjoint.
+    std::unique_ptr<TimingWheel<SegmentTimer>> wheel;
+    std::unique_ptr<dir24_8::Index> index;
+};
+
+} // End of namespace 'yhb'
+
+#endif
@@ -0,0 +1,115 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_FROZEN_ROUTE_TABLE_H
+#define YHB_FROZEN_ROUTE_TABLE_H
+
+#include "route_table.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace yhb {
+
+/**
+ * @brief A read-only snapshot of a RouteTable, for the tables too large for RouteTable::Compile().
+ *
+ * The starting addresses of the ranges are laid out as a static B+ tree of 16 keys per node, one cache line
+ * each (an S+ tree), the nodes are searched by SIMD compares. It takes about 8.3 bytes per range, close to
+ * the 8 bytes of an IpRange, and a lookup touches one cache line per level instead of one per step of a
+ * binary search.
+ */
+class FrozenRouteTable {
+public:
+    /**
+     * @brief Create an empty table.
+     */
+    FrozenRouteTable();
+
+    /**
+     * @brief Take a snapshot of the given table.
+     */
+    explicit FrozenRouteTable(const RouteTable & tab);
+
+    /**
+     * @brief Check if the given IP address matches in the table.
+     *
+     * @param ip The IP.
+     * @param host_order Is the IP address host or net bits order.
+     *
+     * @return Returning true when match, the same as RouteTable::Find() of the original table.
+     */
+    bool Find(uint32_t ip, bool host_order) const;
+
+    /**
+     * @brief Number of the ranges.
+     */
+    size_t GetCount() const {
+        return lasts.size();
+    }
+
+    /**
+     * @brief Memory used by the snapshot, in bytes.
+     */
+    size_t GetMemoryUsage() const {
+        return (storage.size() + lasts.size()) * sizeof(uint32_t);
+    }
+
+    /**
+     * @brief Implementations of the node search.
+     *
+     * The fastest one supported by the CPU is picked at startup. All of them give identical results.
+     */
+    enum class Kernel {
+        AUTO,           // The fastest one supported by the running CPU.
+        SCALAR,         // Portable.
+        AVX2,           // Two 8-lane compares per node. x86 only.
+    };
+
+    /**
+     * @brief Select the kernel used by all the lookups, mainly for testing and benchmarking.
+     *
+     * @param kernel    The kernel to use, Kernel::AUTO restores the startup choice.
+     * @return Returning false if the running CPU does not support the kernel, the current one remains.
+     * @note It is not thread-safe, do not call it while other threads are looking up.
+     */
+    static bool SetKernel(Kernel kernel);
+
+    /**
+     * @brief Get the kernel currently in use, never Kernel::AUTO.
+     */
+    static Kernel GetKernel();
+
+private:
+    // Layer 0 is the leaves, the sorted starting addresses, padded to whole nodes.
+    // The keys are stored with the sign bit flipped, so that signed SIMD compares order them as unsigned.
+    std::vector<uint32_t> storage;
+    size_t tree_offset;                 // Offset of the top layer in 'storage', aligned to a cache line.
+    std::vector<size_t> layer_offsets;  // Offsets of the layers from the top layer, the leaves first.
+    std::vector<uint32_t> lasts;        // The ending addresses of the ranges.
+};
+
+} // End of namespace
+
+#endif
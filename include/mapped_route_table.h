@@ -0,0 +1,125 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_MAPPED_ROUTE_TABLE_H
+#define YHB_MAPPED_ROUTE_TABLE_H
+
+#include "route_table.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace yhb {
+
+/**
+ * @brief A read-only RouteTable mapped from a snapshot file saved by RouteTable::SaveSnapshot().
+ *
+ * The file is queried in place, nothing is deserialized, so opening even a large table takes milliseconds.
+ * The pages are mapped shared, the processes mapping the same file share the physical memory.
+ * The compiled index is used if the snapshot has one, otherwise the ranges are binary searched.
+ */
+class MappedRouteTable {
+public:
+    MappedRouteTable();
+    ~MappedRouteTable();
+
+    /**
+     * @brief Map a snapshot file, the one opened before is closed.
+     *
+     * @param path Path of the file.
+     * @param verify Check the CRC of the whole file, which reads all the pages. Otherwise only the header is
+     *               checked, and a corrupted file may give wrong results, but Find() never reads out of
+     *               the mapping.
+     * @return Returning false if the file can not be mapped, or it's not a valid snapshot.
+     */
+    bool Open(const char * path, bool verify = true);
+
+    /**
+     * @brief Map a snapshot in a POSIX shared memory object, @see Open().
+     *
+     * @param name Name of the object, such as "/routes", as given to shm_open().
+     * @param verify @see Open().
+     * @return Returning false if the object can not be mapped, or it's not a valid snapshot. Always false
+     *         on Windows.
+     */
+    bool OpenSharedMemory(const char * name, bool verify = true);
+
+    /**
+     * @brief Unmap the file.
+     */
+    void Close();
+
+    bool IsOpen() const {
+        return base != nullptr;
+    }
+
+    /**
+     * @brief Exchange the mapped snapshots of the two tables.
+     */
+    void Swap(MappedRouteTable & other);
+
+    /**
+     * @brief Does the snapshot have the compiled index, @see RouteTable::Compile().
+     */
+    bool HasIndex() const {
+        return tbl24 != nullptr;
+    }
+
+    /**
+     * @brief Check if the given IP address matches in the table, @see RouteTable::Find().
+     */
+    bool Find(uint32_t ip, bool host_order) const;
+
+    size_t GetCount() const {
+        return count;
+    }
+
+    const RouteTable::IpRange * begin() const {
+        return ranges;
+    }
+
+    const RouteTable::IpRange * end() const {
+        return ranges + count;
+    }
+
+private:
+    MappedRouteTable(const MappedRouteTable &) = delete;
+    MappedRouteTable & operator = (const MappedRouteTable &) = delete;
+
+    /**
+     * @brief Take a mapped snapshot after validating it, otherwise it's unmapped.
+     */
+    bool Attach(void * view, size_t file_size, bool verify);
+
+    void * base;
+    size_t size;
+    const RouteTable::IpRange * ranges;
+    size_t count;
+    const uint32_t * tbl24;
+    const void * groups;
+    size_t group_count;
+};
+
+} // End of namespace
+
+#endif
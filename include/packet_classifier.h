@@ -0,0 +1,169 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#ifndef YHB_PACKET_CLASSIFIER_H
+#define YHB_PACKET_CLASSIFIER_H
+
+#include "route_table.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace yhb {
+
+/**
+ * @brief A multi-field packet classifier, the access control lists matching the source and destination
+ * addresses, the ports and the protocol of the packets, 5-tuples.
+ *
+ * Each field of a rule is a range, the addresses are RouteTable::IpRange, so a rule of prefixes or of any
+ * range of addresses is the same. A packet matches a rule if each of its fields is in the range of the field,
+ * the rule of the highest priority is returned among the rules matched.
+ *
+ * Compile() builds bit vectors of the rules, RFC-style: the values of each field are cut into the intervals
+ * by the bounds of the rules, each interval has a bit vector of the rules covering it, one bit per rule by
+ * priority. Classify() finds the interval of each field, by a binary search for the addresses, a table for the
+ * ports and the protocol, and the first bit set in all the five vectors is the rule. The vectors are
+ * aggregated, a bit of the summary for each 64 rules, so the words of no rule matched are skipped, and the
+ * identical vectors are stored once. Before Compile() the rules are scanned one by one.
+ */
+class PacketClassifier {
+public:
+    /**
+     * @brief The ID returned if no rule matches.
+     */
+    static uint32_t const NO_MATCH = 0xffffffff;
+
+    struct PortRange {
+        uint16_t first;     // Inclusive.
+        uint16_t last;      // Inclusive, should be large or equal than the 'first'.
+    };
+
+    struct ProtocolRange {
+        uint8_t first;      // Inclusive, IPPROTO_TCP for example.
+        uint8_t last;       // Inclusive, should be large or equal than the 'first'.
+    };
+
+    struct Rule {
+        RouteTable::IpRange src;
+        RouteTable::IpRange dst;
+        PortRange src_port;
+        PortRange dst_port;
+        ProtocolRange protocol;
+        uint32_t priority;  // The lower the value, the higher the priority, the rules added earlier win the ties.
+        uint32_t id;        // Returned if the rule matches, should not be NO_MATCH.
+    };
+
+    /**
+     * @brief The fields of a packet, by host bits order.
+     */
+    struct Packet {
+        uint32_t src;
+        uint32_t dst;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint8_t protocol;
+    };
+
+    PacketClassifier() = default;
+
+    /**
+     * @brief Add a rule, drops the compiled vectors.
+     *
+     * @return Returning false if a range of the rule is not valid, or the ID is NO_MATCH.
+     */
+    bool AddRule(const Rule & rule);
+
+    /**
+     * @brief Add a rule of the address prefixes by CIDR strings, @see RouteTable::Insert(const char *).
+     */
+    bool AddRule(const char * src_cidr, const char * dst_cidr, PortRange src_port, PortRange dst_port,
+        ProtocolRange protocol, uint32_t priority, uint32_t id);
+
+    size_t GetRuleCount() const {
+        return rules.size();
+    }
+
+    /**
+     * @brief Remove all the rules.
+     */
+    void Clear();
+
+    /**
+     * @brief Statistics of PacketClassifier::Compile().
+     */
+    struct CompileStats {
+        size_t memory_bytes;        // Memory used by the compiled vectors.
+        size_t vector_count;        // Number of the distinct bit vectors of all the fields.
+        uint64_t build_time_ns;     // Time spent building the vectors.
+    };
+
+    /**
+     * @brief Build the bit vectors of the rules, then Classify() takes a lookup of each field and the AND of the
+     * vectors, instead of a scan of all the rules.
+     *
+     * The vectors take up to 2 * N * N / 8 bytes for each address field of N rules, less for the rules of the
+     * same bounds. The rules are still the source of truth, AddRule() drops the vectors, call Compile() again
+     * after the changes.
+     */
+    CompileStats Compile();
+
+    /**
+     * @brief Does Classify() use the compiled vectors.
+     */
+    bool IsCompiled() const {
+        return compiled != nullptr;
+    }
+
+    /**
+     * @brief Find the rule of the highest priority matching the packet.
+     *
+     * @return Returning the ID of the rule, or NO_MATCH.
+     */
+    uint32_t Classify(const Packet & packet) const;
+
+    /**
+     * @brief Classify() a batch of packets, the lookups of the packets are interleaved so that the memory
+     * accesses of them overlap.
+     *
+     * @param packets The packets.
+     * @param n Number of the packets.
+     * @param ids Receives the ID of the rule of each packet, or NO_MATCH.
+     */
+    void ClassifyBatch(const Packet * packets, size_t n, uint32_t * ids) const;
+
+private:
+    struct Compiled;
+
+    uint32_t Scan(const Packet & packet) const;
+
+    std::vector<Rule> rules;
+    std::shared_ptr<const Compiled> compiled;   // Shared by the copies, it's immutable.
+};
+
+} // End of namespace 'yhb'
+
+#endif
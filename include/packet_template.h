@@ -0,0 +1,292 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_PACKET_TEMPLATE_H
+#define YHB_PACKET_TEMPLATE_H
+
+#include "checksum.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace yhb {
+
+/**
+ * @brief Headers of IPv4 TCP or UDP packets which are mostly constant.
+ *
+ * The partial sums of the constant bytes are cached when the template is created, each packet built from
+ * it only sums the fields changed by Builder::Set16() / Builder::Set32(), the lengths and the payload.
+ * The IPv4 header must have no options, so all the field offsets are compile-time constants.
+ *
+ * Usage:
+ *      UDPv4PacketTemplate tpl(header, sizeof(header));
+ *      tpl.Build(buf)
+ *          .Set16<UDPv4PacketTemplate::IP_ID>(htons(id))
+ *          .Set16<UDPv4PacketTemplate::SRC_PORT>(htons(port))
+ *          .Finish(payload, payload_len);
+ *
+ * @tparam Protocol     TCP (6) or UDP (17).
+ */
+template <uint8_t Protocol>
+class IPv4PacketTemplate {
+    static_assert(Protocol == 6 || Protocol == 17, "Only TCP and UDP are supported");
+
+public:
+    enum : size_t {
+        IP_HEADER_LEN = 20,
+        MAX_HEADER_LEN = IP_HEADER_LEN + 60,
+
+        // Offsets of the fields from the beginning of the IPv4 header, by network bits order.
+        IP_ID = 4,
+        IP_FRAGMENT = 6,            // Flags and fragment offset.
+        IP_TTL_PROTOCOL = 8,        // The protocol must not be changed.
+        SRC_ADDR = 12,
+        DST_ADDR = 16,
+        SRC_PORT = 20,
+        DST_PORT = 22,
+        TCP_SEQ = 24,
+        TCP_ACK = 28,
+        TCP_FLAGS = 32,             // Data offset and flags, the data offset must not be changed.
+        TCP_WINDOW = 34,
+        TCP_URGENT = 38,
+
+        // Calculated by Builder::Finish(), can not be set.
+        IP_TOTAL_LENGTH = 2,
+        IP_CHECKSUM = 10,
+        UDP_LENGTH = 24,
+        L4_CHECKSUM = IP_HEADER_LEN + (Protocol == 17 ? 6 : 16),
+    };
+
+    /**
+     * @brief Create a template from the headers of a sample packet.
+     *
+     * @param header    The IPv4 header without options, followed by the UDP header or the TCP header
+     *                  (options included). The lengths and the checksums in it are ignored.
+     * @param len       Length of the available data, at least the length of the headers.
+     */
+    IPv4PacketTemplate(const void * header, size_t len);
+
+    /**
+     * @brief Was the template created from a valid header.
+     */
+    bool IsValid() const {
+        return header_len != 0;
+    }
+
+    /**
+     * @brief Length of the headers, the payload of each packet follows them.
+     */
+    size_t GetHeaderLength() const {
+        return header_len;
+    }
+
+    /**
+     * @brief Fills the headers of a packet, created by IPv4PacketTemplate::Build().
+     */
+    class Builder {
+    public:
+        /**
+         * @brief Set a 16-bit field of the packet, a field may be set more than once.
+         *
+         * @tparam Offset   Offset of the field, from the beginning of the IPv4 header, must be even.
+         * @param value     The value, by network bits order. Ignored if the field is beyond the headers
+         *                  of the template, @see GetHeaderLength().
+         */
+        template <size_t Offset>
+        Builder & Set16(uint16_t value) {
+            static_assert(Offset % 2 == 0 && Offset + 2 <= MAX_HEADER_LEN, "Invalid field offset");
+            static_assert(Offset != IP_TOTAL_LENGTH && Offset != IP_CHECKSUM && Offset != L4_CHECKSUM
+                && !(Protocol == 17 && Offset == UDP_LENGTH), "The field is calculated by Finish()");
+            if (Offset + 2 > tpl.header_len) {
+                return *this;
+            }
+            // The sums are of the packet as built so far, so the change is from the value in it.
+            uint16_t old_value;
+            memcpy(&old_value, out + Offset, sizeof(old_value));
+            memcpy(out + Offset, &value, sizeof(value));
+            Add<Offset>((uint16_t)~old_value + (uint32_t)value);
+            return *this;
+        }
+
+        /**
+         * @brief Set a 32-bit field of the packet, such as an address or the TCP sequence number.
+         *
+         * @tparam Offset   Offset of the field, from the beginning of the IPv4 header, must be even.
+         * @param value     The value, by network bits order. Ignored if the field is beyond the headers.
+         */
+        template <size_t Offset>
+        Builder & Set32(uint32_t value) {
+            static_assert(Offset % 2 == 0 && Offset + 4 <= MAX_HEADER_LEN, "Invalid field offset");
+            if (Offset + 4 > tpl.header_len) {
+                return *this;
+            }
+            uint16_t parts[2];
+            memcpy(parts, &value, sizeof(parts));
+            Set16<Offset>(parts[0]);
+            return Set16<Offset + 2>(parts[1]);
+        }
+
+        /**
+         * @brief Finish the packet whose payload is already in place, or elsewhere (zero-copy).
+         *
+         * Fill the lengths and the checksums.
+         * @param payload_len   Length of the payload.
+         * @param payload_sum   The checksum of the payload, by Checksum::Calculate(payload, payload_len).
+         */
+        void Finish(size_t payload_len, uint16_t payload_sum) {
+            size_t const l4_len = tpl.header_len - IP_HEADER_LEN + payload_len;
+            ip_sum += WriteLength(IP_TOTAL_LENGTH, tpl.header_len + payload_len);
+            uint8_t const len_bytes[2] = { (uint8_t)(l4_len >> 8), (uint8_t)l4_len };
+            uint16_t len_word;
+            memcpy(&len_word, len_bytes, sizeof(len_word));
+            if (Protocol == 17) {
+                memcpy(out + UDP_LENGTH, &len_word, sizeof(len_word));
+                l4_sum += len_word;         // The UDP length field
+            }
+            l4_sum += len_word;             // The length in the pseudo header
+            l4_sum += payload_sum;
+
+            uint16_t const ip_checksum = (uint16_t)~Fold(ip_sum);
+            memcpy(out + IP_CHECKSUM, &ip_checksum, sizeof(ip_checksum));
+            uint16_t l4_checksum = (uint16_t)~Fold(l4_sum);
+            if (Protocol == 17 && l4_checksum == 0) {
+                l4_checksum = 0xffff;       // Zero is reserved for "no checksum" in UDP
+            }
+            memcpy(out + L4_CHECKSUM, &l4_checksum, sizeof(l4_checksum));
+        }
+
+        /**
+         * @brief Copy the payload right after the headers and finish the packet.
+         */
+        void Finish(const void * payload, size_t payload_len) {
+            Finish(payload_len, Checksum::CopyAndCalculate(out + tpl.header_len, payload, payload_len));
+        }
+
+    private:
+        friend class IPv4PacketTemplate;
+
+        Builder(const IPv4PacketTemplate & tpl, uint8_t * out)
+            : tpl(tpl)
+            , out(out)
+            , ip_sum(tpl.ip_sum)
+            , l4_sum(tpl.l4_sum) {}
+
+        // Add the change of a field to the sums covering it, resolved at compile time.
+        template <size_t Offset>
+        void Add(uint32_t delta) {
+            if (Offset < IP_HEADER_LEN) {
+                ip_sum += delta;
+            }
+            if (Offset >= SRC_ADDR) {   // The addresses are in the pseudo header too.
+                l4_sum += delta;
+            }
+        }
+
+        uint16_t WriteLength(size_t offset, size_t len) {
+            uint8_t const bytes[2] = { (uint8_t)(len >> 8), (uint8_t)len };
+            memcpy(out + offset, bytes, sizeof(bytes));
+            uint16_t word;
+            memcpy(&word, bytes, sizeof(word));
+            return word;
+        }
+
+        static uint16_t Fold(uint32_t sum) {
+            sum = (sum >> 16) + (sum & 0xffff);
+            sum = (sum >> 16) + (sum & 0xffff);
+            return (uint16_t)sum;
+        }
+
+        const IPv4PacketTemplate & tpl;
+        uint8_t * const out;
+        uint32_t ip_sum;
+        uint32_t l4_sum;
+    };
+
+    /**
+     * @brief Start a packet, copy the headers of the template to the given buffer.
+     *
+     * @param out   Buffer of the packet, large enough for the headers and the payload.
+     */
+    Builder Build(void * out) const {
+        memcpy(out, header, header_len);
+        return Builder(*this, (uint8_t *)out);
+    }
+
+private:
+    uint8_t header[MAX_HEADER_LEN];     // The first member, so at an even address for Checksum::Calculate().
+    size_t header_len;      // Zero if the template is not valid.
+    uint32_t ip_sum;        // Sum of the IPv4 header, the length and the checksum excluded.
+    uint32_t l4_sum;        // Sum of the pseudo header and the TCP/UDP header, the lengths and the checksum excluded.
+};
+
+template <uint8_t Protocol>
+IPv4PacketTemplate<Protocol>::IPv4PacketTemplate(const void * data, size_t len)
+    : header_len(0)
+    , ip_sum(0)
+    , l4_sum(0)
+{
+    const uint8_t * const p = (const uint8_t *)data;
+    if (len < IP_HEADER_LEN || p[0] != 0x45) {
+        return;
+    }
+    size_t l4_header_len = 8;
+    if (Protocol == 6) {
+        if (len < IP_HEADER_LEN + 20) {
+            return;
+        }
+        l4_header_len = (p[IP_HEADER_LEN + 12] >> 4) * 4;
+        if (l4_header_len < 20) {
+            return;
+        }
+    }
+    if (len < IP_HEADER_LEN + l4_header_len) {
+        return;
+    }
+
+    header_len = IP_HEADER_LEN + l4_header_len;
+    memcpy(header, p, header_len);
+    header[9] = Protocol;
+    memset(header + IP_TOTAL_LENGTH, 0, 2);
+    memset(header + IP_CHECKSUM, 0, 2);
+    memset(header + L4_CHECKSUM, 0, 2);
+    if (Protocol == 17) {
+        memset(header + UDP_LENGTH, 0, 2);
+    }
+
+    ip_sum = Checksum::Calculate(header, IP_HEADER_LEN);
+    // The protocol is added as a word, not summed from a buffer, as Calculate() swaps the bytes of the sum
+    // given to it if the buffer is at an odd address.
+    uint8_t const protocol_bytes[2] = { 0, Protocol };
+    uint16_t protocol_word;
+    memcpy(&protocol_word, protocol_bytes, sizeof(protocol_word));
+    uint16_t const pseudo = Checksum::Calculate(header + SRC_ADDR, 8);
+    l4_sum = Checksum::Calculate(header + IP_HEADER_LEN, l4_header_len, pseudo) + (uint32_t)protocol_word;
+}
+
+typedef IPv4PacketTemplate<6> TCPv4PacketTemplate;
+typedef IPv4PacketTemplate<17> UDPv4PacketTemplate;
+
+} // End of namespace
+
+#endif
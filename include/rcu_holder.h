@@ -0,0 +1,203 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_RCU_HOLDER_H
+#define YHB_RCU_HOLDER_H
+
+#include "route_table.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace yhb {
+
+/**
+ * @brief Tracks the readers of an RcuHolder, so that the writer can wait for the readers of the old object.
+ *
+ * Each reader thread counts itself in a slot of its own cache line, there are two counters per slot, one for
+ * each phase. The writer flips the phase and waits for the counters of the old phase to drain, twice, as a
+ * reader may have read the phase just before a flip (the same as the sleepable RCU of Linux).
+ * A reader never blocks, it takes an atomic increment and decrement on a cache line no other thread writes,
+ * unless there are more reader threads than the slots.
+ */
+class RcuReaders {
+public:
+    RcuReaders();
+
+    /**
+     * @brief Count the calling thread as a reader.
+     *
+     * @return Returning the counter to pass to Exit().
+     */
+    std::atomic<uint32_t> * Enter();
+
+    /**
+     * @brief Stop counting the calling thread as a reader.
+     */
+    static void Exit(std::atomic<uint32_t> * counter) {
+        counter->fetch_sub(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Wait for all the readers entered before the call to exit.
+     */
+    void Synchronize();
+
+private:
+    RcuReaders(const RcuReaders &) = delete;
+    RcuReaders & operator = (const RcuReaders &) = delete;
+
+    enum : size_t {
+        SLOT_COUNT = 64,
+        CACHE_LINE_SIZE = 64,
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> counters[2];      // By the phase.
+        char padding[CACHE_LINE_SIZE - 2 * sizeof(std::atomic<uint32_t>)];
+    };
+
+    std::atomic<uint32_t> phase;                // The lowest bit is the current phase.
+    std::unique_ptr<char[]> storage;            // Of the slots, aligned to a cache line.
+    Slot * slots;
+};
+
+/**
+ * @brief Holds an immutable object, such as a RouteTable, read by many threads while it's replaced from time to
+ * time, with no lock taken by the readers (read-copy-update).
+ *
+ * The readers get the current object by Read(), it's kept alive until the ReadGuard is destroyed. The writer
+ * builds a new object aside, then Publish() swaps it in by an atomic pointer, and frees the old one after
+ * all its readers are done.
+ *
+ * @tparam T Type of the object.
+ */
+template <typename T>
+class RcuHolder {
+public:
+    /**
+     * @brief Access to the object current when it was created, it must be destroyed by the same thread.
+     */
+    class ReadGuard {
+    public:
+        ReadGuard(ReadGuard && other) : object(other.object), counter(other.counter) {
+            other.counter = nullptr;
+        }
+
+        ~ReadGuard() {
+            if (counter != nullptr) {
+                RcuReaders::Exit(counter);
+            }
+        }
+
+        const T * get() const {
+            return object;
+        }
+
+        const T * operator -> () const {
+            return object;
+        }
+
+        const T & operator * () const {
+            return *object;
+        }
+
+    private:
+        friend class RcuHolder;
+
+        ReadGuard(const T * object, std::atomic<uint32_t> * counter) : object(object), counter(counter) {}
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard & operator = (const ReadGuard &) = delete;
+
+        const T * object;
+        std::atomic<uint32_t> * counter;
+    };
+
+    /**
+     * @brief Create a holder of the given object, not null.
+     */
+    explicit RcuHolder(std::unique_ptr<const T> initial) : current(initial.release()) {}
+
+    /**
+     * @brief Create a holder of a default constructed object.
+     */
+    RcuHolder() : current(new T()) {}
+
+    /**
+     * @brief There must be no reader left.
+     */
+    ~RcuHolder() {
+        delete current.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the current object, never blocks.
+     *
+     * The guard should be short-lived, Publish() waits for it. Don't call Publish() while holding a guard in
+     * the same thread, it would wait forever.
+     */
+    ReadGuard Read() const {
+        std::atomic<uint32_t> * const counter = readers.Enter();
+        return ReadGuard(current.load(std::memory_order_seq_cst), counter);
+    }
+
+    /**
+     * @brief Replace the object, then wait for the readers of the old one to finish and free it.
+     *
+     * May be called from several threads, they are serialized.
+     * @param next The new object, not null.
+     */
+    void Publish(std::unique_ptr<const T> next) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        const T * const old = current.exchange(next.release(), std::memory_order_seq_cst);
+        readers.Synchronize();
+        delete old;
+    }
+
+    /**
+     * @brief Replace the object by a copy of the given one, @see Publish(std::unique_ptr<const T>).
+     */
+    void Publish(const T & next) {
+        Publish(std::unique_ptr<const T>(new T(next)));
+    }
+
+private:
+    RcuHolder(const RcuHolder &) = delete;
+    RcuHolder & operator = (const RcuHolder &) = delete;
+
+    std::atomic<const T *> current;
+    mutable RcuReaders readers;
+    std::mutex writer_mutex;
+};
+
+/**
+ * @brief A RouteTable shared by the worker threads and refreshed by a loader thread.
+ */
+typedef RcuHolder<RouteTable> RouteTableHolder;
+
+} // End of namespace 'yhb'
+
+#endif
@@ -0,0 +1,266 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_ROUTE_MAP_H
+#define YHB_ROUTE_MAP_H
+
+#include "route_table.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace yhb {
+
+/**
+ * @brief A longest prefix match table, each prefix has a value, such as a next hop or a policy ID.
+ *
+ * Unlike RouteTable, the prefixes are not merged, a lookup gets the value of the longest prefix matching
+ * the address, the more specific prefixes override the less specific ones.
+ *
+ * @tparam T Type of the values, copyable.
+ */
+template <typename T>
+class RouteMap {
+public:
+    typedef RouteTable::CIDR CIDR;
+    typedef RouteTable::IpRange IpRange;
+    typedef RouteTable::CompileStats CompileStats;
+
+    RouteMap() : count(0), lengths(0) {}
+
+    /**
+     * @brief Set the value of a prefix by CIDR string, @see RouteTable::Insert(const char *).
+     *
+     * @return Returning false if the CIDR string is not valid.
+     */
+    bool Insert(const char * cidr_str, const T & value) {
+        CIDR cidr;
+        if (!RouteTable::ParseCIDR(cidr_str, cidr)) {
+            return false;
+        }
+        return Insert(cidr.prefix, cidr.network_bits, value);
+    }
+
+    /**
+     * @brief Set the value of a prefix, the value of the same prefix is replaced.
+     *
+     * @param prefix_net_order IPv4 address prefix, by net bits order, the host bits are ignored.
+     * @param network_bits Length of the prefix. In [0,32].
+     * @param value The value.
+     * @return Returning false if network_bits large than 32.
+     */
+    bool Insert(uint32_t prefix_net_order, unsigned network_bits, const T & value) {
+        if (network_bits > 32) {
+            return false;
+        }
+        compiled.reset();
+        auto const r = prefixes[network_bits].emplace(to_host(prefix_net_order) & mask_of(network_bits), value);
+        if (r.second) {
+            ++count;
+            lengths |= uint64_t(1) << network_bits;
+        } else {
+            r.first->second = value;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Remove a prefix.
+     *
+     * @return Returning false if the prefix is not in the table.
+     */
+    bool Erase(uint32_t prefix_net_order, unsigned network_bits) {
+        if (network_bits > 32
+            || prefixes[network_bits].erase(to_host(prefix_net_order) & mask_of(network_bits)) == 0)
+        {
+            return false;
+        }
+        compiled.reset();
+        --count;
+        if (prefixes[network_bits].empty()) {
+            lengths &= ~(uint64_t(1) << network_bits);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Get the value of the longest prefix matching the given IP address.
+     *
+     * @param ip The IP.
+     * @param host_order Is the IP address host or net bits order.
+     * @return Returning the value, or null if no prefix matches. It's valid until the table is changed.
+     */
+    const T * Find(uint32_t ip, bool host_order) const {
+        uint32_t const key = host_order ? ip : to_host(ip);
+        if (compiled) {
+            return compiled->Find(key);
+        }
+        // From the longest prefix length in use.
+        for (int bits = 32; bits >= 0; --bits) {
+            if (!((lengths >> bits) & 1)) {
+                continue;
+            }
+            auto const it = prefixes[bits].find(key & mask_of(static_cast<unsigned>(bits)));
+            if (it != prefixes[bits].end()) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Build a DIR-24-8 index of the values, then Find() takes at most three memory accesses, the
+     * /24 table, the group of 256 addresses if any prefix is longer than /24 in the block, and the value.
+     *
+     * The index takes 64 MiB for the /24 blocks, plus 1 KiB for each /24 block with longer prefixes, plus a
+     * copy of the values. Any change of the table drops the index, call Compile() again after the changes.
+     */
+    CompileStats Compile() {
+        auto const start = std::chrono::steady_clock::now();
+        std::shared_ptr<Compiled> index = std::make_shared<Compiled>();
+        index->Build(prefixes);
+        compiled = index;
+
+        CompileStats stats;
+        stats.memory_bytes = (index->tbl24.size() + index->tbl8.size()) * sizeof(uint32_t)
+            + index->values.size() * sizeof(T);
+        stats.group_count = index->tbl8.size() / 256;
+        stats.build_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        return stats;
+    }
+
+    /**
+     * @brief Does Find() use the compiled index.
+     */
+    bool IsCompiled() const {
+        return compiled != nullptr;
+    }
+
+    /**
+     * @brief Call f(const CIDR &, const T &) for each prefix, by no particular order.
+     */
+    template <typename F>
+    void ForEach(F f) const {
+        for (unsigned bits = 0; bits <= 32; ++bits) {
+            for (auto const & e : prefixes[bits]) {
+                CIDR const cidr = { to_host(e.first), bits };   // Swapping is symmetric.
+                f(cidr, e.second);
+            }
+        }
+    }
+
+    void Clear() {
+        for (auto & m : prefixes) {
+            m.clear();
+        }
+        count = 0;
+        lengths = 0;
+        compiled.reset();
+    }
+
+    bool IsEmpty() const {
+        return count == 0;
+    }
+
+    size_t GetCount() const {
+        return count;
+    }
+
+private:
+    typedef std::unordered_map<uint32_t, T> PrefixMap;  // By the prefix, host bits order.
+
+    /**
+     * @brief The DIR-24-8 index, @see RouteTable::Compile().
+     *
+     * An entry of 'tbl24' is the index of the value plus one, zero for no match, or GROUP_FLAG plus
+     * the index of a group of 256 entries in 'tbl8', one for each address of the /24 block.
+     */
+    struct Compiled {
+        enum : uint32_t {
+            GROUP_FLAG = 0x80000000,
+        };
+
+        std::vector<uint32_t> tbl24;
+        std::vector<uint32_t> tbl8;
+        std::vector<T> values;
+
+        const T * Find(uint32_t ip) const {
+            uint32_t entry = tbl24[ip >> 8];
+            if (UNLIKELY(entry & GROUP_FLAG)) {
+                entry = tbl8[((entry & ~GROUP_FLAG) << 8) | (ip & 0xff)];
+            }
+            return entry == 0 ? nullptr : &values[entry - 1];
+        }
+
+        // By the prefix length ascending, so the longer prefixes overwrite the shorter ones.
+        void Build(const PrefixMap (&prefixes)[33]) {
+            tbl24.assign(size_t(1) << 24, 0);
+            for (unsigned bits = 0; bits <= 32; ++bits) {
+                for (auto const & e : prefixes[bits]) {
+                    values.push_back(e.second);
+                    uint32_t const entry = static_cast<uint32_t>(values.size());
+                    if (bits <= 24) {
+                        // No group exists yet.
+                        std::fill_n(tbl24.begin() + (e.first >> 8), size_t(1) << (24 - bits), entry);
+                        continue;
+                    }
+                    uint32_t & slot = tbl24[e.first >> 8];
+                    if (!(slot & GROUP_FLAG)) {
+                        uint32_t const group = static_cast<uint32_t>(tbl8.size() >> 8);
+                        tbl8.resize(tbl8.size() + 256, slot);
+                        slot = GROUP_FLAG | group;
+                    }
+                    size_t const first = ((slot & ~GROUP_FLAG) << 8) | (e.first & 0xff);
+                    std::fill_n(tbl8.begin() + first, size_t(1) << (32 - bits), entry);
+                }
+            }
+            tbl8.shrink_to_fit();
+        }
+    };
+
+    static uint32_t mask_of(unsigned network_bits) {
+        return network_bits == 0 ? 0 : uint32_t(-1) << (32 - network_bits);
+    }
+
+    static uint32_t to_host(uint32_t net_order) {
+        uint8_t bytes[4];
+        memcpy(bytes, &net_order, sizeof(bytes));
+        return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+    }
+
+    PrefixMap prefixes[33];     // By the prefix length.
+    size_t count;
+    uint64_t lengths;           // Bit n is set if any prefix of length n.
+    std::shared_ptr<const Compiled> compiled;   // Shared by the copies, it's immutable.
+};
+
+} // End of namespace 'yhb'
+
+#endif
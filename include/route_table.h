@@ -4,8 +4,16 @@
 #include "yhb_common.h"
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+#include <cstdio>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <string>
+
+#if defined(_MSC_VER) && !defined(__GNUC__)
+#include <intrin.h>
+#endif
 
 namespace yhb {
 
@@ -18,7 +26,8 @@ public:
      *
      * @param cidr_str CIDR string, "a.b.c.d/n" (such as "61.4.55.0/24").
      *                 If "/n" not present, it's a single IP address (equivalent to "/32"）.
-     *                 "a.b.c.d" should be a valid IPv4 address, and n must between in range [0,32].
+     *                 "a.b.c.d" should be a valid IPv4 address, as strict as inet_pton(), and n must between
+     *                 in range [0,32]. n is parsed by strtol(), so "/024", "/+24" and "/ 24" are the same as "/24".
      *                 添加失败，函数返回 false。
      * @return Returning true when succeeded. Returning false indicates failure,
      *          such as when the input parameters are invalid.
@@ -67,8 +76,45 @@ public:
          *      For each CIDR entry will invoke this callback.
          */
         void ToCIDR(std::function<void (CIDR)> each_cidr_callback) const;
+
+        /**
+         * @brief Convert self to the minimal equivalent CIDR set, the same as ToCIDR(), but the callback
+         * is inlined and nothing is allocated.
+         *
+         * Each CIDR is the largest block aligned at the next address not covered yet, found by the count of
+         * the trailing zeros of the address and the leading zeros of the addresses left.
+         * @param each_cidr Called as each_cidr(CIDR) for each CIDR, by the order of the addresses.
+         */
+        template <typename F>
+        void ForEachCIDR(F each_cidr) const {
+            if (first > last) {
+                return;
+            }
+            uint32_t from = first;
+            for (;;) {
+                unsigned const host_bits = cidr_host_bits(from, last);
+                each_cidr(CIDR{ to_net_order(from), 32 - host_bits });
+                if (host_bits == 32) {
+                    return;
+                }
+                uint32_t const end = from + ((uint32_t(1) << host_bits) - 1);
+                if (end == last) {
+                    return;
+                }
+                from = end + 1;
+            }
+        }
     };
 
+    /**
+     * @brief Parse a CIDR string, @see Insert(const char *).
+     *
+     * @param cidr_str CIDR string, "a.b.c.d/n", or a single IP address.
+     * @param cidr Receives the CIDR, the host bits of the prefix are kept as they are.
+     * @return Returning false if the string is not valid.
+     */
+    static bool ParseCIDR(const char * cidr_str, CIDR & cidr);
+
     /**
      * @brief Add a match rule by IP range
      *
@@ -76,6 +122,161 @@ public:
      */
     bool Insert(IpRange range);
 
+    /**
+     * @brief Remove the addresses of a range, the existing rules overlapping it are trimmed or split.
+     *
+     * @return Returning false if range parameter is not valid.
+     */
+    bool Erase(IpRange range);
+
+    /**
+     * @brief Remove the addresses of a CIDR, @see Insert(uint32_t, unsigned).
+     */
+    bool Erase(uint32_t prefix_net_order, unsigned network_bits);
+
+    /**
+     * @brief Remove the addresses of a CIDR string, @see Insert(const char *).
+     */
+    bool Erase(const char * cidr_str);
+
+    /**
+     * @brief Add and remove many rules in a single pass over the table.
+     *
+     * Only the ranges near the changed addresses are rebuilt, the others are copied as they are. If the table is
+     * compiled, the index is patched for the /24 blocks of the changed addresses instead of being dropped,
+     * an index shared with a copy of the table is copied first.
+     * @param adds The rules added, the invalid ones are skipped.
+     * @param add_count Number of the rules added.
+     * @param removes The rules removed, the invalid ones are skipped. They are removed before the adds, so
+     *                an address in both is kept.
+     * @param remove_count Number of the rules removed.
+     */
+    void ApplyDelta(const IpRange * adds, size_t add_count, const IpRange * removes, size_t remove_count);
+
+    /**
+     * @brief Add many match rules at once, the result is the same as inserting them one by one.
+     *
+     * The rules are sorted, by several threads for large inputs, then merged with the existing ones in a single
+     * pass. It takes O(n log n + m) for n new rules and m existing ones, instead of O(n * m) by Insert().
+     * @param ranges The rules, the invalid ones are skipped.
+     * @param count Number of the rules.
+     * @param max_threads Number of threads sorting at most, the calling thread and the workers of a shared pool.
+     *                    Zero for the count of the hardware threads.
+     * @return Returning the number of the valid rules.
+     */
+    size_t BulkInsert(const IpRange * ranges, size_t count, unsigned max_threads = 0);
+
+    /**
+     * @brief Add many match rules by CIDR at once, @see BulkInsert(const IpRange *, size_t, unsigned).
+     *
+     * @param cidrs The rules, those with 'network_bits' large than 32 are skipped.
+     */
+    size_t BulkInsert(const CIDR * cidrs, size_t count, unsigned max_threads = 0);
+
+    /**
+     * @brief Called for each malformed line by LoadFromBuffer() and LoadFromFile(), the line is skipped.
+     *
+     * @param line_number Number of the line, from 1.
+     * @param line The line, without the line break.
+     */
+    typedef std::function<void (size_t line_number, const std::string & line)> LoadErrorCallback;
+
+    /**
+     * @brief Add the match rules in a text, one per line.
+     *
+     * Each line is a CIDR "a.b.c.d/n", a single IP address "a.b.c.d", or a range "a.b.c.d-e.f.g.h".
+     * Stricter than Insert(const char *), n is one or two digits, with no sign or blanks before it.
+     * Blank lines and comments from '#' to the end of line are skipped, so are the spaces around the entry.
+     * The rules are added by BulkInsert().
+     * @param data The text, not necessarily null-terminated.
+     * @param len Length of the text.
+     * @param on_error Called for each malformed line, may be empty.
+     * @return Returning the number of the rules added.
+     */
+    size_t LoadFromBuffer(const char * data, size_t len, const LoadErrorCallback & on_error = nullptr);
+
+    /**
+     * @brief Add the match rules in a text file, streamed by chunks, @see LoadFromBuffer().
+     *
+     * @param path Path of the file.
+     * @param on_error Called for each malformed line, may be empty.
+     * @param loaded Receives the number of the rules added, may be null.
+     * @return Returning false if the file can not be read, the table is not changed.
+     */
+    bool LoadFromFile(const char * path, const LoadErrorCallback & on_error = nullptr, size_t * loaded = nullptr);
+
+    /**
+     * @brief The addresses in either table.
+     *
+     * The set operations take a single merge pass over the sorted ranges of both tables, O(n + m).
+     */
+    static RouteTable Union(const RouteTable & a, const RouteTable & b);
+
+    /**
+     * @brief The addresses in both tables.
+     */
+    static RouteTable Intersection(const RouteTable & a, const RouteTable & b);
+
+    /**
+     * @brief The addresses in table 'a' but not in table 'b'.
+     */
+    static RouteTable Difference(const RouteTable & a, const RouteTable & b);
+
+    /**
+     * @brief The addresses not in the table.
+     */
+    static RouteTable Complement(const RouteTable & a);
+
+    /**
+     * @brief In-place Union(), the result is built in the storage of this table, which is not reallocated
+     * if its capacity is enough for GetCount() + other.GetCount() + 1 ranges.
+     */
+    void UnionWith(const RouteTable & other);
+
+    /**
+     * @brief In-place Intersection(), @see UnionWith().
+     */
+    void IntersectWith(const RouteTable & other);
+
+    /**
+     * @brief In-place Difference(), @see UnionWith().
+     */
+    void Subtract(const RouteTable & other);
+
+    /**
+     * @brief In-place Complement(), @see UnionWith().
+     */
+    void Invert();
+
+    /**
+     * @brief Write the minimal CIDR set of the table, @see IpRange::ForEachCIDR().
+     *
+     * @param out Output iterator of CIDR, such as a pointer to CountCIDRs() entries or a back inserter.
+     * @return Returning the iterator past the last CIDR written.
+     */
+    template <typename OutputIt>
+    OutputIt ExportCIDRs(OutputIt out) const {
+        for (const IpRange & r : containers) {
+            r.ForEachCIDR([&out](CIDR cidr) {
+                *out++ = cidr;
+            });
+        }
+        return out;
+    }
+
+    /**
+     * @brief Number of the CIDRs written by ExportCIDRs().
+     */
+    size_t CountCIDRs() const {
+        size_t count = 0;
+        for (const IpRange & r : containers) {
+            r.ForEachCIDR([&count](CIDR) {
+                ++count;
+            });
+        }
+        return count;
+    }
+
     /**
      * @brief Check if the given IP address matches in the routing table.
      *
@@ -86,8 +287,66 @@ public:
      */
     bool Find(uint32_t ip, bool host_order) const;
 
+    /**
+     * @brief Check a burst of IP addresses, the same as calling Find() for each of them, but faster.
+     *
+     * The lookups of the burst are interleaved, so the cache misses of them overlap.
+     * @param ips The IP addresses.
+     * @param n Number of the IP addresses.
+     * @param host_order Are the IP addresses host or net bits order.
+     * @param out Receives the results, 1 for match, 0 for not, 'n' bytes.
+     */
+    void FindBatch(const uint32_t * ips, size_t n, bool host_order, uint8_t * out) const;
+
+    /**
+     * @brief Statistics of RouteTable::Compile().
+     */
+    struct CompileStats {
+        size_t memory_bytes;        // Memory used by the compiled index.
+        size_t group_count;         // Number of the /24 blocks partially matched, each takes a 256-bit group.
+        uint64_t build_time_ns;     // Time spent building the index.
+    };
+
+    /**
+     * @brief Build a DIR-24-8 index from the ranges, then Find() takes one or two memory accesses
+     * instead of a binary search.
+     *
+     * The index takes 64 MiB for the /24 blocks, plus 32 bytes for each /24 block partially matched.
+     * The ranges are still the source of truth, the changes by Insert() or Erase() drop the index, call Compile()
+     * again after them. ApplyDelta() patches the index instead.
+     */
+    CompileStats Compile();
+
+    /**
+     * @brief Does Find() use the compiled index.
+     */
+    bool IsCompiled() const {
+        return compiled != nullptr;
+    }
+
+    /**
+     * @brief Save the ranges, and the compiled index if any, to a binary snapshot file, which can be
+     * mapped and queried in place by MappedRouteTable.
+     *
+     * The file is written to "<path>.tmp" first then renamed, so the processes still mapping the old file
+     * are not disturbed.
+     * @param path Path of the file.
+     * @return Returning false if the file can not be written.
+     */
+    bool SaveSnapshot(const char * path) const;
+
+    /**
+     * @brief Write the snapshot to an open stream, @see SaveSnapshot().
+     *
+     * @param fp The stream, at the start and seekable, such as a file or a shared memory object opened
+     *           by fdopen(). The header is written last, after seeking back to the start.
+     * @return Returning false if it can not be written.
+     */
+    bool WriteSnapshot(FILE * fp) const;
+
     void Clear() {
         containers.clear();
+        compiled.reset();
     }
 
     bool IsEmpty() const {
@@ -108,6 +367,51 @@ public:
 
 private:
 
+    /**
+     * @brief Number of the host bits of the largest CIDR starting at 'from' and ending not after 'last',
+     * 'from' must not be after 'last'.
+     */
+    static unsigned cidr_host_bits(uint32_t from, uint32_t last) {
+        uint32_t const span = last - from;
+        unsigned fit = 32;
+        unsigned align = 32;
+#if defined(__GNUC__)
+        if (span != 0xffffffff) {
+            fit = 31 - __builtin_clz(span + 1);
+        }
+        if (from != 0) {
+            align = __builtin_ctz(from);
+        }
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (span != 0xffffffff) {
+            _BitScanReverse(&index, span + 1);
+            fit = index;
+        }
+        if (_BitScanForward(&index, from)) {
+            align = index;
+        }
+#else
+        if (span != 0xffffffff) {
+            for (fit = 0; ((span + 1) >> (fit + 1)) != 0; ++fit) {
+            }
+        }
+        if (from != 0) {
+            for (align = 0; ((from >> align) & 1) == 0; ++align) {
+            }
+        }
+#endif
+        return fit < align ? fit : align;
+    }
+
+    static uint32_t to_net_order(uint32_t ip_host_order) {
+        uint8_t const bytes[4] = { static_cast<uint8_t>(ip_host_order >> 24), static_cast<uint8_t>(ip_host_order >> 16),
+            static_cast<uint8_t>(ip_host_order >> 8), static_cast<uint8_t>(ip_host_order) };
+        uint32_t r;
+        memcpy(&r, bytes, sizeof(r));
+        return r;
+    }
+
     /**
      * @brief A predicate used for merging entries, determining if A is a strict predecessor of B,
      * if and only if A comes before B, and the scope of A and B does not intersect and is not adjacent.
@@ -129,7 +433,27 @@ private:
     }
 
 private:
+    struct Dir24_8;
+
+    /**
+     * @brief Merge the ranges sorted by the starting addresses into the table.
+     */
+    void MergeSorted(const std::vector<IpRange> & sorted);
+
+    /**
+     * @brief Replace the ranges by those where op(in self, in other) is true, @see UnionWith().
+     */
+    template <typename Op>
+    void CombineInPlace(const RouteTable & other, Op op);
+
+    /**
+     * @brief The ranges where op(in a, in b) is true.
+     */
+    template <typename Op>
+    static RouteTable Combine(const RouteTable & a, const RouteTable & b, Op op);
+
     std::vector<IpRange> containers;
+    std::shared_ptr<const Dir24_8> compiled;    // Shared by the copies, it's immutable.
 
     FRIEND_GTEST(CIDR, IpRange);
     FRIEND_GTEST(CIDR, Insert);
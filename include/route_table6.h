@@ -0,0 +1,228 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_ROUTE_TABLE6_H
+#define YHB_ROUTE_TABLE6_H
+
+#include "yhb_common.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <memory>
+
+namespace yhb {
+
+/**
+ * @brief The IPv6 counterpart of RouteTable, the ranges are merged the same way.
+ */
+class RouteTable6 {
+public:
+    RouteTable6();
+
+    /**
+     * @brief A 128-bit IPv6 address as two integers, by host bits order.
+     */
+    struct Address {
+        uint64_t hi;    // The upper 64 bits, the network prefix mostly.
+        uint64_t lo;    // The lower 64 bits.
+
+        /**
+         * @brief Convert from the 16 bytes by net bits order, such as 'in6_addr::s6_addr'.
+         */
+        static Address FromBytes(const uint8_t bytes[16]);
+
+        /**
+         * @brief Convert to the 16 bytes by net bits order.
+         */
+        void ToBytes(uint8_t bytes[16]) const;
+
+        friend bool operator == (const Address & lv, const Address & rv) {
+            return lv.hi == rv.hi && lv.lo == rv.lo;
+        }
+        friend bool operator != (const Address & lv, const Address & rv) {
+            return !(lv == rv);
+        }
+        friend bool operator < (const Address & lv, const Address & rv) {
+            return lv.hi < rv.hi || (lv.hi == rv.hi && lv.lo < rv.lo);
+        }
+        friend bool operator <= (const Address & lv, const Address & rv) {
+            return !(rv < lv);
+        }
+        friend bool operator > (const Address & lv, const Address & rv) {
+            return rv < lv;
+        }
+        friend bool operator >= (const Address & lv, const Address & rv) {
+            return !(lv < rv);
+        }
+    };
+
+    struct CIDR {
+        uint8_t prefix[16];    // Network address prefix, by net bits order.
+        uint32_t network_bits; // Net mask length. [0,128].
+        friend bool operator == (const CIDR & lv, const CIDR & rv);
+    };
+
+    struct IpRange {
+        Address first;      // Starting IP, inclusive, should be less or equal than the 'last'.
+        Address last;       // Ending IP, inclusive, should be large or equal than the 'first'.
+
+        friend bool operator < (const IpRange &, const IpRange &) = delete;
+        friend bool operator == (const IpRange & lv, const IpRange & rv) {
+            return lv.first == rv.first && lv.last == rv.last;
+        }
+        friend bool operator != (const IpRange & lv, const IpRange & rv) {
+            return !(operator==(lv, rv));
+        }
+        operator bool() const {
+            return first <= last;
+        }
+        bool operator!() const {
+            return !operator bool();
+        }
+
+        /**
+         * @brief Convert self to equivalent CIDR set, @see RouteTable::IpRange::ToCIDR().
+         */
+        void ToCIDR(std::function<void (const CIDR &)> each_cidr_callback) const;
+    };
+
+    /**
+     * @brief Add a route match rule by CIDR string.
+     *
+     * @param cidr_str CIDR string, "addr/n" (such as "2001:db8::/32"). If "/n" not present, it's a single
+     *                 IP address (equivalent to "/128"). "addr" is any form of RFC 4291, the embedded IPv4
+     *                 such as "::ffff:1.2.3.4" included, and n must between in range [0,128].
+     * @return Returning true when succeeded. Returning false indicates failure,
+     *          such as when the input parameters are invalid.
+     */
+    bool Insert(const char * cidr_str);
+
+    /**
+     * @brief Add a route match rule by address prefix and length.
+     *
+     * @param prefix IPv6 address prefix, 16 bytes by net bits order.
+     * @param network_bits Length of the prefix. In [0,128].
+     * @return Returning true if success, otherwise return false (when network_bits large than 128).
+     */
+    bool Insert(const uint8_t prefix[16], unsigned network_bits);
+
+    /**
+     * @brief Add a match rule by IP range.
+     *
+     * @return Returning false if range parameter is not valid.
+     */
+    bool Insert(const IpRange & range);
+
+    /**
+     * @brief Check if the given IP address matches in the routing table.
+     *
+     * @param ip The IP, 16 bytes by net bits order.
+     * @return Returning true when match.
+     */
+    bool Find(const uint8_t ip[16]) const {
+        return Find(Address::FromBytes(ip));
+    }
+
+    /**
+     * @brief Check if the given IP address matches in the routing table.
+     */
+    bool Find(const Address & ip) const;
+
+    /**
+     * @brief Statistics of RouteTable6::Compile().
+     */
+    struct CompileStats {
+        size_t memory_bytes;        // Memory used by the compiled index.
+        size_t node_count;          // Number of the trie nodes.
+        uint64_t build_time_ns;     // Time spent building the index.
+    };
+
+    /**
+     * @brief Build a multibit trie over the upper 64 bits of the addresses, then Find() walks a few small
+     * nodes instead of a binary search.
+     *
+     * The first 16 bits index a flat table of 256 KiB, then each node of the trie takes 8 bits, with the
+     * children and the leaves packed by bitmaps like a poptrie. Only the blocks intersecting several ranges are
+     * split, a block intersecting one range ends with it, so a lookup checks at most one range but for the /64
+     * blocks shared by several ranges, which are searched.
+     * Any change of the table drops the index, call Compile() again after the changes.
+     */
+    CompileStats Compile();
+
+    /**
+     * @brief Does Find() use the compiled index.
+     */
+    bool IsCompiled() const {
+        return compiled != nullptr;
+    }
+
+    void Clear() {
+        containers.clear();
+        compiled.reset();
+    }
+
+    bool IsEmpty() const {
+        return containers.empty();
+    }
+
+    size_t GetCount() const {
+        return containers.size();
+    }
+
+    std::vector<IpRange>::const_iterator begin() const {
+        return containers.cbegin();
+    }
+
+    std::vector<IpRange>::const_iterator end() const {
+        return containers.cend();
+    }
+
+private:
+    /**
+     * @brief A predicate used for merging entries, @see RouteTable::pred_for_merge().
+     */
+    static bool pred_for_merge(const IpRange & lv, const IpRange & rv);
+
+    /**
+     * @brief A predicate used for match, @see RouteTable::pred_for_search().
+     */
+    static bool pred_for_search(const IpRange & lv, const IpRange & rv) {
+        return lv.last < rv.first;
+    }
+
+    /**
+     * @brief Find by the binary search of the ranges.
+     */
+    bool Search(const Address & ip) const;
+
+    struct Trie;
+
+    std::vector<IpRange> containers;
+    std::shared_ptr<const Trie> compiled;       // Shared by the copies, it's immutable.
+};
+
+} // End of namespace 'yhb'
+
+#endif
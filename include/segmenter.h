@@ -0,0 +1,195 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef YHB_SEGMENTER_H
+#define YHB_SEGMENTER_H
+
+#include "packet_template.h"
+#include <type_traits>
+
+namespace yhb {
+
+/**
+ * @brief Software GSO/TSO, cut a large IPv4 TCP or UDP payload into segments of at most MSS bytes.
+ *
+ * The payload is not copied, each segment gets its own headers, pointing to its chunk of the original payload.
+ * The checksums of a segment are derived from the sum of its payload chunk and the changed header fields,
+ * upon the sums cached by IPv4PacketTemplate.
+ *
+ * The IPv4 identification is increased by one for each segment. For TCP, the sequence number is advanced by the
+ * length of the previous segments, FIN and PSH are kept in the last segment only, and CWR in the first one only,
+ * the same as Linux does. For UDP, each segment is a datagram by itself, like UDP_SEGMENT of Linux.
+ *
+ * @tparam Protocol     TCP (6) or UDP (17).
+ */
+template <uint8_t Protocol>
+class IPv4Segmenter {
+public:
+    typedef IPv4PacketTemplate<Protocol> Template;
+
+    /**
+     * @brief A segment, headers and payload are to be sent together, by a scatter-gather I/O for example.
+     */
+    struct Segment {
+        void * header;          // In the buffer of headers given to Split().
+        size_t header_len;
+        const void * payload;   // In the original payload.
+        size_t payload_len;
+    };
+
+    /**
+     * @brief Create a segmenter.
+     *
+     * @param header    The IPv4 header without options, followed by the UDP header or the TCP header
+     *                  (options included) of the large packet. The lengths and the checksums in it are ignored.
+     * @param len       Length of the available data, at least the length of the headers.
+     * @param mss       The maximum length of the payload of a segment.
+     */
+    IPv4Segmenter(const void * header, size_t len, size_t mss)
+        : tpl(header, len)
+        , mss(mss)
+        , first_id(0)
+        , first_seq(0)
+        , flags(0)
+    {
+        if (!tpl.IsValid()) {
+            return;
+        }
+        const uint8_t * const p = (const uint8_t *)header;
+        first_id = (uint16_t)((p[Template::IP_ID] << 8) | p[Template::IP_ID + 1]);
+        if (Protocol == 6) {
+            first_seq = ((uint32_t)p[Template::TCP_SEQ] << 24) | ((uint32_t)p[Template::TCP_SEQ + 1] << 16)
+                | ((uint32_t)p[Template::TCP_SEQ + 2] << 8) | p[Template::TCP_SEQ + 3];
+            flags = (uint16_t)((p[Template::TCP_FLAGS] << 8) | p[Template::TCP_FLAGS + 1]);
+        }
+    }
+
+    /**
+     * @brief Was the segmenter created from a valid header and MSS.
+     */
+    bool IsValid() const {
+        return tpl.IsValid() && mss != 0 && tpl.GetHeaderLength() + mss <= 0xffff;
+    }
+
+    /**
+     * @brief Length of the headers of each segment.
+     */
+    size_t GetHeaderLength() const {
+        return tpl.GetHeaderLength();
+    }
+
+    /**
+     * @brief Number of segments of a payload, an empty payload makes one segment of headers only.
+     * Zero if the segmenter is not valid.
+     */
+    size_t GetSegmentCount(size_t payload_len) const {
+        if (!IsValid()) {
+            return 0;
+        }
+        return payload_len == 0 ? 1 : (payload_len + mss - 1) / mss;
+    }
+
+    /**
+     * @brief Split a payload into segments.
+     *
+     * @param payload       The large payload.
+     * @param payload_len   Length of the payload.
+     * @param headers       Buffer for the headers of the segments, GetSegmentCount() * GetHeaderLength() bytes.
+     * @param segments      Receives the segments, GetSegmentCount() entries.
+     * @return Returning the number of segments, zero if the segmenter is not valid.
+     */
+    size_t Split(const void * payload, size_t payload_len, void * headers, Segment * segments) const {
+        size_t const count = GetSegmentCount(payload_len);
+        size_t const header_len = tpl.GetHeaderLength();
+        const uint8_t * chunk = (const uint8_t *)payload;
+        uint8_t * header = (uint8_t *)headers;
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t const chunk_len = payload_len - offset < mss ? payload_len - offset : mss;
+            typename Template::Builder builder = tpl.Build(header);
+            builder.template Set16<Template::IP_ID>(ToNet16((uint16_t)(first_id + i)));
+            SetTcpFields(builder, offset, i == 0, i == count - 1, std::integral_constant<bool, Protocol == 6>());
+            builder.Finish(chunk_len, Checksum::Calculate(chunk, chunk_len));
+
+            segments[i].header = header;
+            segments[i].header_len = header_len;
+            segments[i].payload = chunk;
+            segments[i].payload_len = chunk_len;
+            header += header_len;
+            chunk += chunk_len;
+            offset += chunk_len;
+        }
+        return count;
+    }
+
+private:
+    enum : uint16_t {
+        TCP_FIN = 0x01,
+        TCP_PSH = 0x08,
+        TCP_CWR = 0x80,
+    };
+
+    void SetTcpFields(typename Template::Builder & builder, size_t offset, bool first, bool last,
+        std::true_type) const
+    {
+        uint16_t segment_flags = flags;
+        if (!first) {
+            segment_flags &= ~TCP_CWR;
+        }
+        if (!last) {
+            segment_flags &= ~(TCP_FIN | TCP_PSH);
+        }
+        builder.template Set32<Template::TCP_SEQ>(ToNet32(first_seq + (uint32_t)offset))
+            .template Set16<Template::TCP_FLAGS>(ToNet16(segment_flags));
+    }
+
+    void SetTcpFields(typename Template::Builder &, size_t, bool, bool, std::false_type) const {}
+
+    static uint16_t ToNet16(uint16_t v) {
+        uint8_t const bytes[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+        uint16_t r;
+        memcpy(&r, bytes, sizeof(r));
+        return r;
+    }
+
+    static uint32_t ToNet32(uint32_t v) {
+        uint8_t const bytes[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+        uint32_t r;
+        memcpy(&r, bytes, sizeof(r));
+        return r;
+    }
+
+    Template tpl;
+    size_t mss;
+    uint16_t first_id;      // By host bits order
+    uint32_t first_seq;     // By host bits order
+    uint16_t flags;         // Data offset and TCP flags, by host bits order
+};
+
+typedef IPv4Segmenter<6> TCPv4Segmenter;
+typedef IPv4Segmenter<17> UDPv4Segmenter;
+
+} // End of namespace
+
+#endif
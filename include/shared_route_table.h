@@ -0,0 +1,142 @@
+/*
+MIT License
+
+Copyright (c) 2023 YinHaiBo
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef YHB_SHARED_ROUTE_TABLE_H
+#define YHB_SHARED_ROUTE_TABLE_H
+
+#include "route_table.h"
+#include "mapped_route_table.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace yhb {
+
+/**
+ * @brief A RouteTable in POSIX shared memory, published by a writer process and queried in place by many
+ * reader processes, so the workers of a host share one copy of a large compiled table.
+ *
+ * Each generation of the table is a snapshot, @see RouteTable::SaveSnapshot(), in the shared memory object
+ * "<name>.<generation>". The snapshot has only offsets, so it's valid at any address it's mapped at.
+ * A control object "<name>" holds the number of the current generation. The writer fills a new generation
+ * wholly, then stores its number, then unlinks the generation before. A reader picks the new generation
+ * up by Refresh(), while the old one stays mapped by the readers still using it until they unmap it.
+ *
+ * There must be one writer at a time. Not supported on Windows, the functions fail.
+ */
+class SharedRouteTable {
+public:
+    SharedRouteTable();
+    ~SharedRouteTable();
+
+    /**
+     * @brief Publish a table as a new generation, by the writer.
+     *
+     * The index is published if the table is compiled, otherwise the readers binary search the ranges.
+     * @param name Name of the control object, such as "/routes", @see shm_open().
+     * @param tab The table.
+     * @param generation Receives the number of the new generation, from 1, may be null.
+     * @return Returning false if the shared memory can not be created or written, the generation before
+     *         is kept.
+     */
+    static bool Publish(const char * name, const RouteTable & tab, uint64_t * generation = nullptr);
+
+    /**
+     * @brief Remove the shared memory objects of the name, the readers mapping them are not disturbed.
+     */
+    static void Unlink(const char * name);
+
+    /**
+     * @brief Map the current generation, by a reader, the one opened before is closed.
+     *
+     * @param name Name of the control object.
+     * @param verify Check the CRC of each generation mapped, @see MappedRouteTable::Open().
+     * @return Returning false if nothing has been published by the name, or the generation is not valid.
+     */
+    bool Open(const char * name, bool verify = true);
+
+    /**
+     * @brief Map the current generation if it's a new one, the one mapped before is unmapped.
+     *
+     * A call checks the generation number only, unless it has changed, so it may be called as often as
+     * per burst of lookups.
+     * @return Returning true if a new generation is mapped.
+     */
+    bool Refresh();
+
+    /**
+     * @brief Unmap the table and the control object.
+     */
+    void Close();
+
+    bool IsOpen() const {
+        return control != nullptr;
+    }
+
+    /**
+     * @brief Number of the generation mapped.
+     */
+    uint64_t GetGeneration() const {
+        return generation;
+    }
+
+    /**
+     * @brief Check if the given IP address matches in the generation mapped, @see RouteTable::Find().
+     */
+    bool Find(uint32_t ip, bool host_order) const {
+        return table.Find(ip, host_order);
+    }
+
+    /**
+     * @brief The generation mapped.
+     */
+    const MappedRouteTable & GetTable() const {
+        return table;
+    }
+
+private:
+    SharedRouteTable(const SharedRouteTable &) = delete;
+    SharedRouteTable & operator = (const SharedRouteTable &) = delete;
+
+    struct Control;
+
+    /**
+     * @brief Map the control object of the name.
+     *
+     * @param writable Map it for writing, and create it if it does not exist.
+     * @return Returning null if it can not be mapped, or it's not a control object.
+     */
+    static Control * MapControl(const char * name, bool writable);
+
+    std::string name;
+    const Control * control;
+    MappedRouteTable table;
+    uint64_t generation;
+    bool verify;
+};
+
+} // End of namespace 'yhb'
+
+#endif
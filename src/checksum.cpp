@@ -7,6 +7,14 @@
  */
 
 #include "checksum.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 /** Split an u32_t in two u16_ts and add them up */
 #define FOLD_U32T(u) \
@@ -16,33 +24,451 @@
 #define SWAP_BYTES_IN_WORD(w) \
     (((w) & 0xff) << 8) | (((w) & 0xff00) >> 8)
 
-uint16_t yhb::Checksum::Calculate(const void * dataptr, size_t len, uint16_t additional) {
-    const uint8_t * pb = (const uint8_t *)dataptr;
-    const int odd = ((intptr_t)pb & 1);
+namespace yhb {
+
+/*
+ * All the kernels below return the one's complement sum of the given memory block in 64 bits,
+ * taking the data as 16-bit words in host byte order, starting from the first byte no matter
+ * how the address is aligned. A left-over byte is the low addressed byte of the last word.
+ *
+ * The 64-bit one's complement sum folds to the same 16-bit value as adding the words one by one,
+ * because 2^16, 2^32 and 2^48 are all congruent to 1 modulo 0xffff. It also never folds a non-zero
+ * sum to zero, so the result stays bit-identical to the 32-bit accumulator of the original code.
+ */
+typedef uint64_t (*sum_kernel_t)(const uint8_t * p, size_t len);
 
-    uint16_t t = 0;
+/** Same as sum_kernel_t, and copy the block to 'dst' at the same time. The blocks must not overlap. */
+typedef uint64_t (*copy_sum_kernel_t)(uint8_t * dst, const uint8_t * src, size_t len);
 
-    /* Get aligned to uint16_t */
-    if (odd && len > 0) {
-        ((uint8_t *)&t)[1] = *pb++;
-        len--;
-    }
+/** Add two 64-bit one's complement numbers, with the end-around carry. */
+static inline uint64_t add_with_carry(uint64_t sum, uint64_t value) {
+    sum += value;
+    return sum + (sum < value);
+}
+
+/** Fold a 64-bit one's complement sum to 32 bits. */
+static inline uint32_t fold_u64(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xffffffffULL);
+    sum = (sum >> 32) + (sum & 0xffffffffULL);
+    return (uint32_t)sum;
+}
+
+/**
+ * @brief Swap the bytes in every 16-bit word of a 64-bit one's complement sum.
+ *
+ * It's the same as multiplying by 256 modulo 0xffff, that is, the sum of the data moved by one byte.
+ */
+static inline uint64_t swap_bytes_in_words(uint64_t sum) {
+    return ((sum & 0x00ff00ff00ff00ffULL) << 8) | ((sum >> 8) & 0x00ff00ff00ff00ffULL);
+}
 
-    /* Add the bulk of the data */
-    const uint16_t * ps = (const uint16_t *)(const void *)pb;
-    uint32_t sum = 0;
+static inline uint64_t load_u64(const uint8_t * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t sum_scalar(const uint8_t * p, size_t len) {
+    // Two accumulators to break the dependency chain of the carries.
+    uint64_t s0 = 0;
+    uint64_t s1 = 0;
+    while (len >= 32) {
+        s0 = add_with_carry(s0, load_u64(p));
+        s1 = add_with_carry(s1, load_u64(p + 8));
+        s0 = add_with_carry(s0, load_u64(p + 16));
+        s1 = add_with_carry(s1, load_u64(p + 24));
+        p += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        s0 = add_with_carry(s0, load_u64(p));
+        p += 8;
+        len -= 8;
+    }
     while (len > 1) {
-        sum += *ps++;
+        uint16_t w;
+        memcpy(&w, p, sizeof(w));
+        s1 = add_with_carry(s1, w);
+        p += 2;
         len -= 2;
     }
-
-    /* Consume left-over byte, if any */
     if (len > 0) {
-        ((uint8_t *)&t)[0] = *(const uint8_t *)ps;
+        uint16_t t = 0;
+        ((uint8_t *)&t)[0] = *p;
+        s1 = add_with_carry(s1, t);
+    }
+    return add_with_carry(s0, s1);
+}
+
+static inline void store_u64(uint8_t * p, uint64_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint64_t copy_sum_scalar(uint8_t * dst, const uint8_t * src, size_t len) {
+    uint64_t s0 = 0;
+    uint64_t s1 = 0;
+    while (len >= 32) {
+        uint64_t const v0 = load_u64(src);
+        uint64_t const v1 = load_u64(src + 8);
+        uint64_t const v2 = load_u64(src + 16);
+        uint64_t const v3 = load_u64(src + 24);
+        store_u64(dst, v0);
+        store_u64(dst + 8, v1);
+        store_u64(dst + 16, v2);
+        store_u64(dst + 24, v3);
+        s0 = add_with_carry(s0, v0);
+        s1 = add_with_carry(s1, v1);
+        s0 = add_with_carry(s0, v2);
+        s1 = add_with_carry(s1, v3);
+        src += 32;
+        dst += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t const v = load_u64(src);
+        store_u64(dst, v);
+        s0 = add_with_carry(s0, v);
+        src += 8;
+        dst += 8;
+        len -= 8;
+    }
+    // The rest is short, copy it at once and sum it in place.
+    memcpy(dst, src, len);
+    return add_with_carry(add_with_carry(s0, s1), sum_scalar(src, len));
+}
+
+#if YHB_X86
+
+/*
+ * The SIMD kernels split each 64-bit lane into its two 32-bit halves and add them up in 64-bit lanes,
+ * which can not overflow within SIMD_BLOCK_ITERATIONS iterations. Each kernel has 4 accumulators
+ * to hide the latency of the additions, and leaves the blocks too short for it to the scalar one.
+ */
+static size_t const SIMD_BLOCK_ITERATIONS = (size_t)1 << 30;
+
+static inline uint64_t add_lanes(const uint64_t * lanes, size_t count, uint64_t sum) {
+    for (size_t i = 0; i < count; ++i) {
+        sum = add_with_carry(sum, lanes[i]);
+    }
+    return sum;
+}
+
+YHB_TARGET("sse2")
+static uint64_t sum_sse2(const uint8_t * p, size_t len) {
+    __m128i const low_mask = _mm_set1_epi64x(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 32) {
+        size_t n = len / 32;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 32;
+
+        __m128i a0 = _mm_setzero_si128();
+        __m128i a1 = _mm_setzero_si128();
+        __m128i a2 = _mm_setzero_si128();
+        __m128i a3 = _mm_setzero_si128();
+        for (; n > 0; --n) {
+            __m128i const v0 = _mm_loadu_si128((const __m128i *)p);
+            __m128i const v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+            a0 = _mm_add_epi64(a0, _mm_and_si128(v0, low_mask));
+            a1 = _mm_add_epi64(a1, _mm_srli_epi64(v0, 32));
+            a2 = _mm_add_epi64(a2, _mm_and_si128(v1, low_mask));
+            a3 = _mm_add_epi64(a3, _mm_srli_epi64(v1, 32));
+            p += 32;
+        }
+
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(_mm_add_epi64(a0, a1), _mm_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 2, sum);
+    }
+    return add_with_carry(sum, sum_scalar(p, len));
+}
+
+YHB_TARGET("avx2")
+static uint64_t sum_avx2(const uint8_t * p, size_t len) {
+    if (len < 128) {
+        return sum_scalar(p, len);
+    }
+    __m256i const low_mask = _mm256_set1_epi64x(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 64) {
+        size_t n = len / 64;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 64;
+
+        __m256i a0 = _mm256_setzero_si256();
+        __m256i a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256();
+        __m256i a3 = _mm256_setzero_si256();
+        for (; n > 0; --n) {
+            __m256i const v0 = _mm256_loadu_si256((const __m256i *)p);
+            __m256i const v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+            a0 = _mm256_add_epi64(a0, _mm256_and_si256(v0, low_mask));
+            a1 = _mm256_add_epi64(a1, _mm256_srli_epi64(v0, 32));
+            a2 = _mm256_add_epi64(a2, _mm256_and_si256(v1, low_mask));
+            a3 = _mm256_add_epi64(a3, _mm256_srli_epi64(v1, 32));
+            p += 64;
+        }
+
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 4, sum);
+    }
+    return add_with_carry(sum, sum_scalar(p, len));
+}
+
+YHB_TARGET("avx512f")
+static uint64_t sum_avx512(const uint8_t * p, size_t len) {
+    if (len < 512) {
+        return len < 128 ? sum_scalar(p, len) : sum_avx2(p, len);
+    }
+    __m512i const low_mask = _mm512_set1_epi64(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 128) {
+        size_t n = len / 128;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 128;
+
+        __m512i a0 = _mm512_setzero_si512();
+        __m512i a1 = _mm512_setzero_si512();
+        __m512i a2 = _mm512_setzero_si512();
+        __m512i a3 = _mm512_setzero_si512();
+        for (; n > 0; --n) {
+            __m512i const v0 = _mm512_loadu_si512((const void *)p);
+            __m512i const v1 = _mm512_loadu_si512((const void *)(p + 64));
+            a0 = _mm512_add_epi64(a0, _mm512_and_si512(v0, low_mask));
+            a1 = _mm512_add_epi64(a1, _mm512_srli_epi64(v0, 32));
+            a2 = _mm512_add_epi64(a2, _mm512_and_si512(v1, low_mask));
+            a3 = _mm512_add_epi64(a3, _mm512_srli_epi64(v1, 32));
+            p += 128;
+        }
+
+        uint64_t lanes[8];
+        _mm512_storeu_si512((void *)lanes, _mm512_add_epi64(_mm512_add_epi64(a0, a1), _mm512_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 8, sum);
+    }
+    return add_with_carry(sum, sum_avx2(p, len));
+}
+
+YHB_TARGET("sse2")
+static uint64_t copy_sum_sse2(uint8_t * dst, const uint8_t * src, size_t len) {
+    __m128i const low_mask = _mm_set1_epi64x(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 32) {
+        size_t n = len / 32;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 32;
+
+        __m128i a0 = _mm_setzero_si128();
+        __m128i a1 = _mm_setzero_si128();
+        __m128i a2 = _mm_setzero_si128();
+        __m128i a3 = _mm_setzero_si128();
+        for (; n > 0; --n) {
+            __m128i const v0 = _mm_loadu_si128((const __m128i *)src);
+            __m128i const v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+            _mm_storeu_si128((__m128i *)dst, v0);
+            _mm_storeu_si128((__m128i *)(dst + 16), v1);
+            a0 = _mm_add_epi64(a0, _mm_and_si128(v0, low_mask));
+            a1 = _mm_add_epi64(a1, _mm_srli_epi64(v0, 32));
+            a2 = _mm_add_epi64(a2, _mm_and_si128(v1, low_mask));
+            a3 = _mm_add_epi64(a3, _mm_srli_epi64(v1, 32));
+            src += 32;
+            dst += 32;
+        }
+
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(_mm_add_epi64(a0, a1), _mm_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 2, sum);
+    }
+    return add_with_carry(sum, copy_sum_scalar(dst, src, len));
+}
+
+YHB_TARGET("avx2")
+static uint64_t copy_sum_avx2(uint8_t * dst, const uint8_t * src, size_t len) {
+    if (len < 128) {
+        return copy_sum_scalar(dst, src, len);
     }
+    __m256i const low_mask = _mm256_set1_epi64x(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 64) {
+        size_t n = len / 64;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 64;
 
-    /* Add end bytes */
-    sum += t;
+        __m256i a0 = _mm256_setzero_si256();
+        __m256i a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256();
+        __m256i a3 = _mm256_setzero_si256();
+        for (; n > 0; --n) {
+            __m256i const v0 = _mm256_loadu_si256((const __m256i *)src);
+            __m256i const v1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+            _mm256_storeu_si256((__m256i *)dst, v0);
+            _mm256_storeu_si256((__m256i *)(dst + 32), v1);
+            a0 = _mm256_add_epi64(a0, _mm256_and_si256(v0, low_mask));
+            a1 = _mm256_add_epi64(a1, _mm256_srli_epi64(v0, 32));
+            a2 = _mm256_add_epi64(a2, _mm256_and_si256(v1, low_mask));
+            a3 = _mm256_add_epi64(a3, _mm256_srli_epi64(v1, 32));
+            src += 64;
+            dst += 64;
+        }
+
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(_mm256_add_epi64(a0, a1), _mm256_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 4, sum);
+    }
+    return add_with_carry(sum, copy_sum_scalar(dst, src, len));
+}
+
+YHB_TARGET("avx512f")
+static uint64_t copy_sum_avx512(uint8_t * dst, const uint8_t * src, size_t len) {
+    if (len < 512) {
+        return len < 128 ? copy_sum_scalar(dst, src, len) : copy_sum_avx2(dst, src, len);
+    }
+    __m512i const low_mask = _mm512_set1_epi64(0xffffffff);
+    uint64_t sum = 0;
+    while (len >= 128) {
+        size_t n = len / 128;
+        if (n > SIMD_BLOCK_ITERATIONS) {
+            n = SIMD_BLOCK_ITERATIONS;
+        }
+        len -= n * 128;
+
+        __m512i a0 = _mm512_setzero_si512();
+        __m512i a1 = _mm512_setzero_si512();
+        __m512i a2 = _mm512_setzero_si512();
+        __m512i a3 = _mm512_setzero_si512();
+        for (; n > 0; --n) {
+            __m512i const v0 = _mm512_loadu_si512((const void *)src);
+            __m512i const v1 = _mm512_loadu_si512((const void *)(src + 64));
+            _mm512_storeu_si512((void *)dst, v0);
+            _mm512_storeu_si512((void *)(dst + 64), v1);
+            a0 = _mm512_add_epi64(a0, _mm512_and_si512(v0, low_mask));
+            a1 = _mm512_add_epi64(a1, _mm512_srli_epi64(v0, 32));
+            a2 = _mm512_add_epi64(a2, _mm512_and_si512(v1, low_mask));
+            a3 = _mm512_add_epi64(a3, _mm512_srli_epi64(v1, 32));
+            src += 128;
+            dst += 128;
+        }
+
+        uint64_t lanes[8];
+        _mm512_storeu_si512((void *)lanes, _mm512_add_epi64(_mm512_add_epi64(a0, a1), _mm512_add_epi64(a2, a3)));
+        sum = add_lanes(lanes, 8, sum);
+    }
+    return add_with_carry(sum, copy_sum_avx2(dst, src, len));
+}
+
+#endif // YHB_X86
+
+/** The set of kernels of one instruction set. */
+struct KernelSet {
+    sum_kernel_t sum;
+    copy_sum_kernel_t copy_sum;
+};
+
+/**
+ * @brief Get the kernels of the given kind.
+ *
+ * @return Returning nullptr if the running CPU does not support it.
+ */
+static const KernelSet * get_kernel_set(Checksum::Kernel kernel) {
+    static const KernelSet scalar = { sum_scalar, copy_sum_scalar };
+#if YHB_X86
+    static const KernelSet sse2 = { sum_sse2, copy_sum_sse2 };
+    static const KernelSet avx2 = { sum_avx2, copy_sum_avx2 };
+    static const KernelSet avx512 = { sum_avx512, copy_sum_avx512 };
+#endif
+    switch (kernel) {
+    case Checksum::Kernel::SCALAR:
+        return &scalar;
+#if YHB_X86
+    case Checksum::Kernel::SSE2:
+        return get_cpu_features().sse2 ? &sse2 : nullptr;
+    case Checksum::Kernel::AVX2:
+        return get_cpu_features().avx2 ? &avx2 : nullptr;
+    case Checksum::Kernel::AVX512:
+        return get_cpu_features().avx512f ? &avx512 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+static Checksum::Kernel detect_best_kernel() {
+    Checksum::Kernel const candidates[] = {
+        Checksum::Kernel::AVX512,
+        Checksum::Kernel::AVX2,
+        Checksum::Kernel::SSE2,
+    };
+    for (Checksum::Kernel k : candidates) {
+        if (get_kernel_set(k) != nullptr) {
+            return k;
+        }
+    }
+    return Checksum::Kernel::SCALAR;
+}
+
+// Constant initialized, so the calculations invoked by other static initializers still work.
+static sum_kernel_t sum_kernel = sum_scalar;
+static copy_sum_kernel_t copy_sum_kernel = copy_sum_scalar;
+static Checksum::Kernel active_kernel = Checksum::Kernel::SCALAR;
+
+static void use_kernel_set(Checksum::Kernel kernel, const KernelSet & set) {
+    sum_kernel = set.sum;
+    copy_sum_kernel = set.copy_sum;
+    active_kernel = kernel;
+}
+
+static Checksum::Kernel select_best_kernel() {
+    Checksum::Kernel const k = detect_best_kernel();
+    use_kernel_set(k, *get_kernel_set(k));
+    return k;
+}
+
+// Picked once at startup, may be overridden by Checksum::SetKernel().
+static Checksum::Kernel const best_kernel = select_best_kernel();
+
+bool Checksum::SetKernel(Kernel kernel) {
+    if (kernel == Kernel::AUTO) {
+        kernel = best_kernel;
+    }
+    const KernelSet * const set = get_kernel_set(kernel);
+    if (set == nullptr) {
+        return false;
+    }
+    use_kernel_set(kernel, *set);
+    return true;
+}
+
+Checksum::Kernel Checksum::GetKernel() {
+    return active_kernel;
+}
+
+/**
+ * @brief Turn the sum of the data into the result of Calculate().
+ *
+ * @param data_sum      The sum of the data, taken as if it started at an even address.
+ * @param odd           Was the data at an odd address.
+ * @param additional    The 'additional' parameter of Calculate().
+ */
+static uint16_t finish_sum(uint64_t data_sum, int odd, uint16_t additional) {
+    uint32_t sum = fold_u64(data_sum);
+
+    /* The original code summed an odd aligned block with its bytes swapped, and added the
+       'additional' in that swapped form, then swapped back. Keep this behavior. */
+    sum = FOLD_U32T(sum);
+    sum = FOLD_U32T(sum);
+    if (odd) {
+        sum = SWAP_BYTES_IN_WORD(sum);
+    }
 
     sum += additional;
 
@@ -58,3 +484,493 @@ uint16_t yhb::Checksum::Calculate(const void * dataptr, size_t len, uint16_t add
 
     return (uint16_t)sum;
 }
+
+uint16_t Checksum::Calculate(const void * dataptr, size_t len, uint16_t additional) {
+    const uint8_t * pb = (const uint8_t *)dataptr;
+    const int odd = ((intptr_t)pb & 1);
+    return finish_sum(sum_kernel(pb, len), odd, additional);
+}
+
+// Number of the memory blocks summed together by CalculateBatch().
+static size_t const BATCH_WIDTH = 4;
+
+// Longer blocks are summed faster one by one with the SIMD kernels.
+static size_t const BATCH_INTERLEAVE_MAX_LEN = 256;
+
+void Checksum::CalculateBatch(const void * const * dataptrs, const size_t * lens, const uint16_t * additionals,
+                              uint16_t * results, size_t count) {
+    size_t i = 0;
+    for (; i + BATCH_WIDTH <= count; i += BATCH_WIDTH) {
+        // Warm up the cache for the next group while summing this one.
+        for (size_t k = i + BATCH_WIDTH; k < i + 2 * BATCH_WIDTH && k < count; ++k) {
+            prefetch_for_read(dataptrs[k]);
+        }
+
+        const uint8_t * const p0 = (const uint8_t *)dataptrs[i];
+        const uint8_t * const p1 = (const uint8_t *)dataptrs[i + 1];
+        const uint8_t * const p2 = (const uint8_t *)dataptrs[i + 2];
+        const uint8_t * const p3 = (const uint8_t *)dataptrs[i + 3];
+
+        size_t common = lens[i];
+        for (size_t k = i + 1; k < i + BATCH_WIDTH; ++k) {
+            if (lens[k] < common) {
+                common = lens[k];
+            }
+        }
+        common = common <= BATCH_INTERLEAVE_MAX_LEN ? (common & ~(size_t)7) : 0;
+
+        // Four independent carry chains, one per block.
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (size_t off = 0; off < common; off += 8) {
+            s0 = add_with_carry(s0, load_u64(p0 + off));
+            s1 = add_with_carry(s1, load_u64(p1 + off));
+            s2 = add_with_carry(s2, load_u64(p2 + off));
+            s3 = add_with_carry(s3, load_u64(p3 + off));
+        }
+
+        uint64_t sums[BATCH_WIDTH] = { s0, s1, s2, s3 };
+        for (size_t k = 0; k < BATCH_WIDTH; ++k) {
+            const uint8_t * const p = (const uint8_t *)dataptrs[i + k];
+            size_t const rest = lens[i + k] - common;
+            if (rest != 0) {
+                sums[k] = add_with_carry(sums[k], rest < 64 ? sum_scalar(p + common, rest) : sum_kernel(p + common, rest));
+            }
+            results[i + k] = finish_sum(sums[k], (intptr_t)p & 1, additionals ? additionals[i + k] : 0);
+        }
+    }
+    for (; i < count; ++i) {
+        results[i] = Calculate(dataptrs[i], lens[i], additionals ? additionals[i] : 0);
+    }
+}
+
+// Minimum bytes per thread for CalculateParallel(), below it the threads cost more than they save.
+static size_t const PARALLEL_MIN_CHUNK = 256 * 1024;
+
+uint16_t Checksum::CalculateParallel(const void * dataptr, size_t len, uint16_t additional, unsigned max_threads) {
+    const uint8_t * const pb = (const uint8_t *)dataptr;
+    const int odd = ((intptr_t)pb & 1);
+
+    WorkerPool & pool = WorkerPool::Instance();
+    size_t chunks = max_threads != 0 ? max_threads : pool.GetConcurrency();
+    if (len / PARALLEL_MIN_CHUNK < chunks) {
+        chunks = len / PARALLEL_MIN_CHUNK;
+    }
+    if (chunks <= 1) {
+        return Calculate(dataptr, len, additional);
+    }
+
+    // Chunk boundaries at cache line addresses, so no cache line is shared between threads.
+    // Relative to the beginning of the block they may be odd.
+    size_t const chunk_len = (len / chunks) & ~(size_t)63;
+    uintptr_t const first_boundary = (((uintptr_t)pb + chunk_len) & ~(uintptr_t)63) - (uintptr_t)pb;
+    std::vector<uint64_t> partial(chunks);
+    pool.Run(chunks, [&](size_t i) {
+        size_t const begin = i == 0 ? 0 : first_boundary + (i - 1) * chunk_len;
+        size_t const end = i + 1 == chunks ? len : first_boundary + i * chunk_len;
+        uint64_t s = sum_kernel(pb + begin, end - begin);
+        // A chunk starting at an odd offset starts in the middle of a word.
+        partial[i] = (begin & 1) ? swap_bytes_in_words(s) : s;
+    });
+
+    uint64_t sum = 0;
+    for (uint64_t s : partial) {
+        sum = add_with_carry(sum, s);
+    }
+    return finish_sum(sum, odd, additional);
+}
+
+#ifndef _WIN32
+uint16_t Checksum::Calculate(const struct iovec * iov, size_t count, uint16_t additional) {
+    uint64_t sum = 0;
+    size_t odd = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t s = sum_kernel((const uint8_t *)iov[i].iov_base, iov[i].iov_len);
+        // A block following an odd number of bytes starts in the middle of a word.
+        if (odd) {
+            s = swap_bytes_in_words(s);
+        }
+        sum = add_with_carry(sum, s);
+        odd ^= iov[i].iov_len & 1;
+    }
+    return finish_sum(sum, 0, additional);
+}
+#endif
+
+uint16_t Checksum::CopyAndCalculate(void * dst, const void * src, size_t len, uint16_t additional) {
+    const int odd = ((intptr_t)dst & 1);
+    return finish_sum(copy_sum_kernel((uint8_t *)dst, (const uint8_t *)src, len), odd, additional);
+}
+
+uint16_t Checksum::Update16(uint16_t checksum, uint16_t old_value, uint16_t new_value) {
+    // HC' = ~(~HC + ~m + m')
+    uint32_t sum = (uint16_t)~checksum;
+    sum += (uint16_t)~old_value;
+    sum += new_value;
+    sum = FOLD_U32T(sum);
+    sum = FOLD_U32T(sum);
+    return (uint16_t)~sum;
+}
+
+uint16_t Checksum::Update32(uint16_t checksum, uint32_t old_value, uint32_t new_value) {
+    uint32_t sum = (uint16_t)~checksum;
+    sum += (uint16_t)~(old_value >> 16);
+    sum += (uint16_t)~old_value;
+    sum += new_value >> 16;
+    sum += new_value & 0xffff;
+    sum = FOLD_U32T(sum);
+    sum = FOLD_U32T(sum);
+    return (uint16_t)~sum;
+}
+
+//////////////////////////////////////////////////
+
+static size_t const IPV4_CHECKSUM_OFFSET = 10;
+static size_t const IPV4_SRC_OFFSET = 12;
+static size_t const IPV4_DST_OFFSET = 16;
+static size_t const TCP_CHECKSUM_OFFSET = 16;
+static size_t const UDP_CHECKSUM_OFFSET = 6;
+static uint8_t const IP_PROTO_ICMP = 1;
+static uint8_t const IP_PROTO_TCP = 6;
+static uint8_t const IP_PROTO_UDP = 17;
+static uint8_t const IP_PROTO_ICMPV6 = 58;
+
+static inline uint16_t read_u16(const uint8_t * p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void write_u16(uint8_t * p, uint16_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+/**
+ * @brief Locate the TCP/UDP checksum field of an IPv4 packet.
+ *
+ * @return Pointer to the checksum field, or nullptr if there is no TCP/UDP header
+ *         (other protocols, non-first fragments or truncated).
+ */
+static uint8_t * locate_l4_checksum(uint8_t * ip, size_t len, size_t header_len, bool * is_udp) {
+    uint16_t const frag_offset = (uint16_t)(((ip[6] & 0x1f) << 8) | ip[7]);
+    if (frag_offset != 0) {
+        return nullptr;
+    }
+    size_t offset;
+    if (ip[9] == IP_PROTO_TCP) {
+        offset = header_len + TCP_CHECKSUM_OFFSET;
+    } else if (ip[9] == IP_PROTO_UDP) {
+        offset = header_len + UDP_CHECKSUM_OFFSET;
+    } else {
+        return nullptr;
+    }
+    if (offset + 2 > len) {
+        return nullptr;
+    }
+    *is_udp = ip[9] == IP_PROTO_UDP;
+    return ip + offset;
+}
+
+/**
+ * @brief Get the length of a valid IPv4 header.
+ *
+ * @return Returning 0 if the header is malformed or truncated.
+ */
+static size_t get_ipv4_header_len(const uint8_t * ip, size_t len) {
+    if (len < 20 || (ip[0] >> 4) != 4) {
+        return 0;
+    }
+    size_t const header_len = (ip[0] & 0x0f) * 4;
+    if (header_len < 20 || header_len > len) {
+        return 0;
+    }
+    return header_len;
+}
+
+static void patch_l4_checksum(uint8_t * field, bool is_udp, uint32_t old_value, uint32_t new_value, bool is_32bits) {
+    uint16_t const old_checksum = read_u16(field);
+    if (is_udp && old_checksum == 0) {
+        return;     // No checksum
+    }
+    uint16_t new_checksum = is_32bits
+        ? Checksum::Update32(old_checksum, old_value, new_value)
+        : Checksum::Update16(old_checksum, (uint16_t)old_value, (uint16_t)new_value);
+    if (is_udp && new_checksum == 0) {
+        new_checksum = 0xffff;  // Zero is reserved for "no checksum" in UDP
+    }
+    write_u16(field, new_checksum);
+}
+
+static bool set_ipv4_address(void * ip_header, size_t len, size_t addr_offset, uint32_t addr) {
+    uint8_t * const ip = (uint8_t *)ip_header;
+    size_t const header_len = get_ipv4_header_len(ip, len);
+    if (header_len == 0) {
+        return false;
+    }
+
+    uint32_t old_addr;
+    memcpy(&old_addr, ip + addr_offset, sizeof(old_addr));
+    memcpy(ip + addr_offset, &addr, sizeof(addr));
+
+    uint8_t * const ip_checksum = ip + IPV4_CHECKSUM_OFFSET;
+    write_u16(ip_checksum, Checksum::Update32(read_u16(ip_checksum), old_addr, addr));
+
+    // The TCP/UDP checksum covers the address through the pseudo header.
+    bool is_udp;
+    uint8_t * const l4_checksum = locate_l4_checksum(ip, len, header_len, &is_udp);
+    if (l4_checksum != nullptr) {
+        patch_l4_checksum(l4_checksum, is_udp, old_addr, addr, true);
+    }
+    return true;
+}
+
+static bool set_l4_port(void * ip_header, size_t len, size_t port_offset, uint16_t port) {
+    uint8_t * const ip = (uint8_t *)ip_header;
+    size_t const header_len = get_ipv4_header_len(ip, len);
+    if (header_len == 0) {
+        return false;
+    }
+    bool is_udp;
+    uint8_t * const l4_checksum = locate_l4_checksum(ip, len, header_len, &is_udp);
+    if (l4_checksum == nullptr) {
+        return false;
+    }
+
+    uint8_t * const field = ip + header_len + port_offset;
+    uint16_t const old_port = read_u16(field);
+    write_u16(field, port);
+    patch_l4_checksum(l4_checksum, is_udp, old_port, port, false);
+    return true;
+}
+
+/** Fold a 64-bit one's complement sum to 16 bits. */
+static inline uint16_t fold_to_u16(uint64_t sum) {
+    uint32_t s = fold_u64(sum);
+    s = FOLD_U32T(s);
+    s = FOLD_U32T(s);
+    return (uint16_t)s;
+}
+
+static inline uint32_t read_u32(const uint8_t * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/** A 16-bit word of the given two bytes, by host bits order as if it was loaded from memory. */
+static inline uint16_t make_word(uint8_t first, uint8_t second) {
+    uint8_t const bytes[2] = { first, second };
+    return read_u16(bytes);
+}
+
+/** Where the transport layer packet is, and the sum of its pseudo header. */
+struct L4Location {
+    size_t offset;          // Offset from the IP header.
+    size_t len;             // Length of the transport layer packet.
+    uint8_t protocol;
+    bool is_ipv6;
+    size_t ip_header_len;   // Length of the IPv4 header, zero for IPv6.
+    uint64_t pseudo_sum;
+};
+
+static size_t checksum_offset_of(uint8_t protocol) {
+    return protocol == IP_PROTO_TCP ? TCP_CHECKSUM_OFFSET
+        : protocol == IP_PROTO_UDP ? UDP_CHECKSUM_OFFSET
+        : 2;    // ICMP and ICMPv6
+}
+
+static bool locate_ipv4_l4(const uint8_t * ip, size_t len, L4Location * loc) {
+    size_t const header_len = get_ipv4_header_len(ip, len);
+    if (header_len == 0) {
+        return false;
+    }
+    size_t const total_len = ((size_t)ip[2] << 8) | ip[3];
+    uint16_t const frag = (uint16_t)(((ip[6] & 0x3f) << 8) | ip[7]);    // MF flag and offset
+    if (total_len < header_len || total_len > len || frag != 0) {
+        return false;
+    }
+    uint8_t const protocol = ip[9];
+    if (protocol != IP_PROTO_TCP && protocol != IP_PROTO_UDP && protocol != IP_PROTO_ICMP) {
+        return false;
+    }
+    loc->offset = header_len;
+    loc->len = total_len - header_len;
+    loc->protocol = protocol;
+    loc->is_ipv6 = false;
+    loc->ip_header_len = header_len;
+
+    // ICMP has no pseudo header.
+    uint64_t sum = 0;
+    if (protocol != IP_PROTO_ICMP) {
+        sum += read_u32(ip + IPV4_SRC_OFFSET);
+        sum += read_u32(ip + IPV4_DST_OFFSET);
+        sum += make_word(0, protocol);
+        sum += make_word((uint8_t)(loc->len >> 8), (uint8_t)loc->len);
+    }
+    loc->pseudo_sum = sum;
+    return true;
+}
+
+static bool locate_ipv6_l4(const uint8_t * ip, size_t len, L4Location * loc) {
+    size_t const IPV6_HEADER_LEN = 40;
+    if (len < IPV6_HEADER_LEN) {
+        return false;
+    }
+    size_t const payload_len = ((size_t)ip[4] << 8) | ip[5];
+    if (payload_len == 0 || IPV6_HEADER_LEN + payload_len > len) {
+        return false;   // Jumbo payload is not supported
+    }
+    size_t const end = IPV6_HEADER_LEN + payload_len;
+
+    // Walk through the extension headers.
+    uint8_t next = ip[6];
+    size_t offset = IPV6_HEADER_LEN;
+    for (;;) {
+        if (next == IP_PROTO_TCP || next == IP_PROTO_UDP || next == IP_PROTO_ICMPV6) {
+            break;
+        }
+        size_t ext_len;
+        if (offset + 8 > end) {
+            return false;
+        }
+        if (next == 0 || next == 43 || next == 60) {        // Hop-by-Hop, Routing, Destination Options
+            ext_len = ((size_t)ip[offset + 1] + 1) * 8;
+        } else if (next == 51) {                            // Authentication Header
+            ext_len = ((size_t)ip[offset + 1] + 2) * 4;
+        } else {
+            return false;
+        }
+        next = ip[offset];
+        offset += ext_len;
+    }
+    if (offset > end) {
+        return false;
+    }
+
+    loc->offset = offset;
+    loc->len = end - offset;
+    loc->protocol = next;
+    loc->is_ipv6 = true;
+    loc->ip_header_len = 0;
+
+    uint64_t sum = 0;
+    for (size_t i = 8; i < 40; i += 4) {    // Source and destination addresses
+        sum += read_u32(ip + i);
+    }
+    sum += make_word((uint8_t)(loc->len >> 24), (uint8_t)(loc->len >> 16));
+    sum += make_word((uint8_t)(loc->len >> 8), (uint8_t)loc->len);
+    sum += make_word(0, next);
+    loc->pseudo_sum = sum;
+    return true;
+}
+
+static bool locate_l4(const uint8_t * ip, size_t len, L4Location * loc) {
+    if (len == 0) {
+        return false;
+    }
+    switch (ip[0] >> 4) {
+    case 4:
+        return locate_ipv4_l4(ip, len, loc);
+    case 6:
+        return locate_ipv6_l4(ip, len, loc);
+    default:
+        return false;
+    }
+}
+
+/** The sum of the transport layer packet, the pseudo header included, or -1 if the header is truncated. */
+static int32_t sum_l4(const uint8_t * ip, const L4Location & loc) {
+    if (loc.len < checksum_offset_of(loc.protocol) + 2) {
+        return -1;
+    }
+    return fold_to_u16(add_with_carry(loc.pseudo_sum, sum_kernel(ip + loc.offset, loc.len)));
+}
+
+bool L4Checksum::Calculate(const void * ip_header, size_t len, uint16_t * checksum) {
+    const uint8_t * const ip = (const uint8_t *)ip_header;
+    L4Location loc;
+    if (!locate_l4(ip, len, &loc)) {
+        return false;
+    }
+    int32_t const sum = sum_l4(ip, loc);
+    if (sum < 0) {
+        return false;
+    }
+    // Take the checksum field as zero.
+    uint16_t const field = read_u16(ip + loc.offset + checksum_offset_of(loc.protocol));
+    uint16_t result = (uint16_t)~fold_to_u16((uint64_t)sum + (uint16_t)~field);
+    if (loc.protocol == IP_PROTO_UDP && result == 0) {
+        result = 0xffff;    // Zero is reserved for "no checksum" in UDP
+    }
+    *checksum = result;
+    return true;
+}
+
+bool L4Checksum::Update(void * ip_header, size_t len) {
+    uint16_t checksum;
+    if (!Calculate(ip_header, len, &checksum)) {
+        return false;
+    }
+    uint8_t * const ip = (uint8_t *)ip_header;
+    L4Location loc;
+    locate_l4(ip, len, &loc);
+    write_u16(ip + loc.offset + checksum_offset_of(loc.protocol), checksum);
+    return true;
+}
+
+static bool verify_l4(const uint8_t * ip, const L4Location & loc) {
+    if (loc.protocol == IP_PROTO_UDP && !loc.is_ipv6 && loc.len >= 8
+            && read_u16(ip + loc.offset + UDP_CHECKSUM_OFFSET) == 0) {
+        return true;    // No checksum
+    }
+    return sum_l4(ip, loc) == 0xffff;
+}
+
+bool L4Checksum::Verify(const void * ip_header, size_t len) {
+    const uint8_t * const ip = (const uint8_t *)ip_header;
+    L4Location loc;
+    return locate_l4(ip, len, &loc) && verify_l4(ip, loc);
+}
+
+bool L4Checksum::VerifyPacket(const void * ip_header, size_t len) {
+    const uint8_t * const ip = (const uint8_t *)ip_header;
+    L4Location loc;
+    if (!locate_l4(ip, len, &loc)) {
+        return false;
+    }
+    if (!loc.is_ipv6 && fold_to_u16(sum_scalar(ip, loc.ip_header_len)) != 0xffff) {
+        return false;
+    }
+    return verify_l4(ip, loc);
+}
+
+bool IPv4Rewriter::SetSourceAddress(void * ip_header, size_t len, uint32_t addr_net_order) {
+    return set_ipv4_address(ip_header, len, IPV4_SRC_OFFSET, addr_net_order);
+}
+
+bool IPv4Rewriter::SetDestinationAddress(void * ip_header, size_t len, uint32_t addr_net_order) {
+    return set_ipv4_address(ip_header, len, IPV4_DST_OFFSET, addr_net_order);
+}
+
+bool IPv4Rewriter::SetSourcePort(void * ip_header, size_t len, uint16_t port_net_order) {
+    return set_l4_port(ip_header, len, 0, port_net_order);
+}
+
+bool IPv4Rewriter::SetDestinationPort(void * ip_header, size_t len, uint16_t port_net_order) {
+    return set_l4_port(ip_header, len, 2, port_net_order);
+}
+
+bool IPv4Rewriter::DecreaseTTL(void * ip_header, size_t len) {
+    uint8_t * const ip = (uint8_t *)ip_header;
+    if (get_ipv4_header_len(ip, len) == 0 || ip[8] == 0) {
+        return false;
+    }
+    // The TTL shares a 16-bit word with the protocol.
+    uint16_t const old_word = read_u16(ip + 8);
+    --ip[8];
+    uint16_t const new_word = read_u16(ip + 8);
+    uint8_t * const ip_checksum = ip + IPV4_CHECKSUM_OFFSET;
+    write_u16(ip_checksum, Checksum::Update16(read_u16(ip_checksum), old_word, new_word));
+    return true;
+}
+
+} // End of namespace 'yhb'
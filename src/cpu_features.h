@@ -0,0 +1,147 @@
+#ifndef YHB_CPU_FEATURES_H
+#define YHB_CPU_FEATURES_H
+
+// Internal helpers for run-time instruction set dispatch. Not part of the public interface.
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   define YHB_X86 1
+#   include <immintrin.h>
+#else
+#   define YHB_X86 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#   include <intrin.h>
+#endif
+
+// GCC and Clang only emit instructions of an extension inside functions that enable it explicitly,
+// MSVC accepts any intrinsic anywhere.
+#if defined(__GNUC__)
+#   define YHB_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define YHB_TARGET(isa)
+#endif
+
+namespace yhb {
+
+struct CpuFeatures {
+    bool sse2;
+    bool sse42;
+    bool avx2;
+    bool avx512f;   // Foundation only, includes the OS support of the ZMM state.
+};
+
+#if YHB_X86 && defined(_MSC_VER) && !defined(__clang__)
+
+static inline CpuFeatures detect_cpu_features() {
+    CpuFeatures f = {};
+    int r[4];
+    __cpuid(r, 0);
+    int const max_leaf = r[0];
+
+    __cpuid(r, 1);
+    f.sse2 = (r[3] & (1 << 26)) != 0;
+    f.sse42 = (r[2] & (1 << 20)) != 0;
+    bool const osxsave = (r[2] & (1 << 27)) != 0;
+    if (!osxsave || max_leaf < 7) {
+        return f;
+    }
+
+    unsigned long long const xcr0 = _xgetbv(0);
+    bool const os_avx = (xcr0 & 0x06) == 0x06;          // XMM and YMM state
+    bool const os_avx512 = (xcr0 & 0xe6) == 0xe6;       // Plus opmask and ZMM state
+
+    __cpuidex(r, 7, 0);
+    f.avx2 = os_avx && (r[1] & (1 << 5)) != 0;
+    f.avx512f = os_avx512 && (r[1] & (1 << 16)) != 0;
+    return f;
+}
+
+#elif YHB_X86 && defined(__GNUC__)
+
+static inline CpuFeatures detect_cpu_features() {
+    // The builtins check the OS support of the extended register state as well.
+    __builtin_cpu_init();
+    CpuFeatures f;
+    f.sse2 = __builtin_cpu_supports("sse2");
+    f.sse42 = __builtin_cpu_supports("sse4.2");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.avx512f = __builtin_cpu_supports("avx512f");
+    return f;
+}
+
+#else
+
+static inline CpuFeatures detect_cpu_features() {
+    CpuFeatures f = {};
+    return f;
+}
+
+#endif
+
+/**
+ * @brief Hint the CPU to load the cache line of the given address for reading.
+ */
+static inline void prefetch_for_read(const void * p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p, 0, 3);
+#elif YHB_X86
+    _mm_prefetch((const char *)p, _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+/**
+ * @brief Number of the trailing zero bits, 'x' must not be zero.
+ */
+static inline unsigned count_trailing_zeros(uint32_t x) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(x);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (unsigned)index;
+#else
+    unsigned n = 0;
+    for (; (x & 1) == 0; x >>= 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/**
+ * @brief Number of the bits set.
+ */
+static inline unsigned count_ones(uint64_t x) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (unsigned)((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/**
+ * @brief Number of the trailing zero bits, 64 if 'x' is zero.
+ */
+static inline unsigned count_trailing_zeros64(uint64_t x) {
+    return count_ones((x & (0 - x)) - 1);
+}
+
+/**
+ * @brief Get the features of the running CPU, detected once on the first call.
+ */
+static inline const CpuFeatures & get_cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+} // End of namespace 'yhb'
+
+#endif
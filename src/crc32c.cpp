@@ -0,0 +1,254 @@
+#include "crc32c.h"
+#include "cpu_features.h"
+#include <cstring>
+
+namespace yhb {
+
+// The reflected polynomial of CRC-32C.
+static uint32_t const POLY = 0x82f63b78;
+
+/*
+ * In the functions below a 'raw' CRC is the register value, without the pre and post inversions.
+ * Appending data is linear on it: raw(c, A + B) == shift(raw(c, A), len(B)) ^ raw(0, B), where
+ * shift(c, n) multiplies c by x^(8n) modulo the polynomial.
+ */
+
+/** Multiply two polynomials modulo the CRC polynomial, both are reflected. */
+static uint32_t multiply_mod_poly(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+/** Lookup tables, built on the first use. */
+struct Tables {
+    uint32_t slice[8][256];         // Slice-by-8
+    uint32_t x2n[32];               // x^(2^n) modulo the polynomial
+    uint32_t shift_long[4][256];    // Multiply by x^(8 * LONG_BLOCK), byte by byte
+    uint32_t shift_short[4][256];   // Multiply by x^(8 * SHORT_BLOCK), byte by byte
+
+    Tables();
+};
+
+// Block lengths of the three interleaved streams.
+static size_t const LONG_BLOCK = 8192;
+static size_t const SHORT_BLOCK = 256;
+
+/** x^(n * 2^k) modulo the polynomial. */
+static uint32_t x_pow_n_mod_poly(const Tables & t, size_t n, unsigned k) {
+    uint32_t p = (uint32_t)1 << 31;     // x^0
+    while (n) {
+        if (n & 1) {
+            p = multiply_mod_poly(t.x2n[k & 31], p);
+        }
+        n >>= 1;
+        ++k;
+    }
+    return p;
+}
+
+static void build_shift_table(uint32_t table[4][256], uint32_t factor) {
+    for (unsigned k = 0; k < 4; ++k) {
+        for (uint32_t b = 0; b < 256; ++b) {
+            table[k][b] = multiply_mod_poly(factor, b << (8 * k));
+        }
+    }
+}
+
+Tables::Tables() {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+        }
+        slice[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+        for (int k = 1; k < 8; ++k) {
+            slice[k][n] = (slice[k - 1][n] >> 8) ^ slice[0][slice[k - 1][n] & 0xff];
+        }
+    }
+
+    uint32_t p = (uint32_t)1 << 30;     // x^1
+    x2n[0] = p;
+    for (int n = 1; n < 32; ++n) {
+        x2n[n] = p = multiply_mod_poly(p, p);
+    }
+
+    build_shift_table(shift_long, x_pow_n_mod_poly(*this, LONG_BLOCK, 3));
+    build_shift_table(shift_short, x_pow_n_mod_poly(*this, SHORT_BLOCK, 3));
+}
+
+static const Tables & get_tables() {
+    static const Tables tables;
+    return tables;
+}
+
+static inline uint32_t shift_by_table(const uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff]
+        ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static inline uint64_t load_u64(const uint8_t * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+typedef uint32_t (*crc_kernel_t)(uint32_t raw, const uint8_t * p, size_t len);
+
+static uint32_t crc_software(uint32_t crc, const uint8_t * p, size_t len) {
+    const Tables & t = get_tables();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = t.slice[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --len;
+    }
+    while (len >= 8) {
+        uint64_t const w = load_u64(p) ^ crc;
+        crc = t.slice[7][w & 0xff] ^ t.slice[6][(w >> 8) & 0xff]
+            ^ t.slice[5][(w >> 16) & 0xff] ^ t.slice[4][(w >> 24) & 0xff]
+            ^ t.slice[3][(w >> 32) & 0xff] ^ t.slice[2][(w >> 40) & 0xff]
+            ^ t.slice[1][(w >> 48) & 0xff] ^ t.slice[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len > 0) {
+        crc = t.slice[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        --len;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#   define YHB_HAS_SSE42_KERNEL 1
+
+/**
+ * @brief Calculate three streams of 'block' bytes each in parallel, so that the 3 cycles latency
+ * of the 'crc32' instruction are hidden, then combine them.
+ */
+YHB_TARGET("sse4.2")
+static inline uint32_t crc_sse42_3way(uint32_t crc, const uint8_t * p, size_t block, const uint32_t shift[4][256]) {
+    uint64_t c0 = crc;
+    uint64_t c1 = 0;
+    uint64_t c2 = 0;
+    const uint8_t * const end = p + block;
+    do {
+        c0 = _mm_crc32_u64(c0, load_u64(p));
+        c1 = _mm_crc32_u64(c1, load_u64(p + block));
+        c2 = _mm_crc32_u64(c2, load_u64(p + 2 * block));
+        p += 8;
+    } while (p < end);
+    crc = shift_by_table(shift, (uint32_t)c0) ^ (uint32_t)c1;
+    return shift_by_table(shift, crc) ^ (uint32_t)c2;
+}
+
+YHB_TARGET("sse4.2")
+static uint32_t crc_sse42(uint32_t crc, const uint8_t * p, size_t len) {
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --len;
+    }
+    if (len >= 3 * SHORT_BLOCK) {
+        const Tables & t = get_tables();
+        while (len >= 3 * LONG_BLOCK) {
+            crc = crc_sse42_3way(crc, p, LONG_BLOCK, t.shift_long);
+            p += 3 * LONG_BLOCK;
+            len -= 3 * LONG_BLOCK;
+        }
+        while (len >= 3 * SHORT_BLOCK) {
+            crc = crc_sse42_3way(crc, p, SHORT_BLOCK, t.shift_short);
+            p += 3 * SHORT_BLOCK;
+            len -= 3 * SHORT_BLOCK;
+        }
+    }
+    uint64_t c = crc;
+    while (len >= 8) {
+        c = _mm_crc32_u64(c, load_u64(p));
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --len;
+    }
+    return crc;
+}
+
+#else
+#   define YHB_HAS_SSE42_KERNEL 0
+#endif
+
+/**
+ * @brief Get the kernel function of the given kind.
+ *
+ * @return Returning nullptr if the running CPU does not support it.
+ */
+static crc_kernel_t get_crc_kernel(CRC32C::Kernel kernel) {
+    switch (kernel) {
+    case CRC32C::Kernel::SOFTWARE:
+        return crc_software;
+#if YHB_HAS_SSE42_KERNEL
+    case CRC32C::Kernel::SSE42:
+        return get_cpu_features().sse42 ? crc_sse42 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+// Constant initialized, so the calculations invoked by other static initializers still work.
+static crc_kernel_t crc_kernel = crc_software;
+static CRC32C::Kernel active_kernel = CRC32C::Kernel::SOFTWARE;
+
+static CRC32C::Kernel select_best_kernel() {
+    CRC32C::Kernel const k = get_crc_kernel(CRC32C::Kernel::SSE42) != nullptr
+        ? CRC32C::Kernel::SSE42
+        : CRC32C::Kernel::SOFTWARE;
+    crc_kernel = get_crc_kernel(k);
+    active_kernel = k;
+    return k;
+}
+
+// Picked once at startup, may be overridden by CRC32C::SetKernel().
+static CRC32C::Kernel const best_kernel = select_best_kernel();
+
+bool CRC32C::SetKernel(Kernel kernel) {
+    if (kernel == Kernel::AUTO) {
+        kernel = best_kernel;
+    }
+    crc_kernel_t const f = get_crc_kernel(kernel);
+    if (f == nullptr) {
+        return false;
+    }
+    crc_kernel = f;
+    active_kernel = kernel;
+    return true;
+}
+
+CRC32C::Kernel CRC32C::GetKernel() {
+    return active_kernel;
+}
+
+uint32_t CRC32C::Calculate(const void * dataptr, size_t len, uint32_t crc) {
+    return ~crc_kernel(~crc, (const uint8_t *)dataptr, len);
+}
+
+uint32_t CRC32C::Combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    // The inversions cancel out, see the linearity above.
+    return multiply_mod_poly(x_pow_n_mod_poly(get_tables(), len2, 3), crc1) ^ crc2;
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,139 @@
+#ifndef YHB_DIR24_8_H
+#define YHB_DIR24_8_H
+
+// Internal layout and builder of the DIR-24-8 index, shared by RouteTable, ExpiringRouteTable and MappedRouteTable.
+// Not part of the public interface.
+
+#include "yhb_common.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace yhb {
+namespace dir24_8 {
+
+// Each /24 block has an entry in the 'tbl24', which is MISS or HIT if the block is matched wholly or not at all,
+// otherwise it's FIRST_GROUP plus the index of a 256-bit group, one bit per address.
+enum : uint32_t {
+    MISS = 0,
+    HIT = 1,
+    FIRST_GROUP = 2,
+};
+
+size_t const TBL24_SIZE = size_t(1) << 24;
+
+struct Group {
+    uint64_t bits[4];
+};
+
+static inline bool test_group(const Group & group, uint32_t ip) {
+    uint32_t const offset = ip & 0xff;
+    return (group.bits[offset >> 6] >> (offset & 63)) & 1;
+}
+
+static inline bool find(const uint32_t * tbl24, const Group * groups, uint32_t ip) {
+    uint32_t const entry = tbl24[ip >> 8];
+    if (LIKELY(entry < FIRST_GROUP)) {
+        return entry == HIT;
+    }
+    return test_group(groups[entry - FIRST_GROUP], ip);
+}
+
+/**
+ * @brief A DIR-24-8 index being built or changed, the addresses are marked or unmarked by ranges.
+ *
+ * A group emptied or filled wholly is turned back to MISS or HIT, its storage is kept for reuse.
+ */
+struct Index {
+    typedef dir24_8::Group Group;
+
+    std::vector<uint32_t> tbl24;
+    std::vector<Group> groups;
+    std::vector<uint32_t> free_groups;      // Indexes of the groups not used.
+
+    bool Find(uint32_t ip) const {
+        return find(tbl24.data(), groups.data(), ip);
+    }
+
+    // Nothing matched.
+    void Reset() {
+        tbl24.assign(TBL24_SIZE, MISS);
+        groups.clear();
+        free_groups.clear();
+    }
+
+    // Mark the addresses of [first, last] as matched.
+    void Fill(uint32_t first, uint32_t last) {
+        Update(first, last, true);
+    }
+
+    // Mark the addresses of [first, last] as not matched.
+    void Clear(uint32_t first, uint32_t last) {
+        Update(first, last, false);
+    }
+
+private:
+    void Update(uint32_t first, uint32_t last, bool hit) {
+        uint32_t const first_block = first >> 8;
+        uint32_t const last_block = last >> 8;
+        for (uint32_t block = first_block; ; ++block) {
+            unsigned const lo = block == first_block ? first & 0xff : 0;
+            unsigned const hi = block == last_block ? last & 0xff : 0xff;
+            if (lo == 0 && hi == 0xff) {
+                SetEntry(block, hit ? HIT : MISS);
+            } else {
+                SetBits(block, lo, hi, hit);
+            }
+            if (block == last_block) {
+                break;
+            }
+        }
+    }
+
+    void SetEntry(uint32_t block, uint32_t entry) {
+        if (tbl24[block] >= FIRST_GROUP) {
+            free_groups.push_back(tbl24[block] - FIRST_GROUP);
+        }
+        tbl24[block] = entry;
+    }
+
+    // Set or clear the bits [lo, hi] of the block.
+    void SetBits(uint32_t block, unsigned lo, unsigned hi, bool hit) {
+        uint32_t entry = tbl24[block];
+        if (entry == (hit ? HIT : MISS)) {
+            return;
+        }
+        if (entry < FIRST_GROUP) {
+            Group const group = { { entry == HIT ? ~uint64_t(0) : 0, entry == HIT ? ~uint64_t(0) : 0,
+                entry == HIT ? ~uint64_t(0) : 0, entry == HIT ? ~uint64_t(0) : 0 } };
+            if (free_groups.empty()) {
+                entry = FIRST_GROUP + static_cast<uint32_t>(groups.size());
+                groups.push_back(group);
+            } else {
+                entry = FIRST_GROUP + free_groups.back();
+                free_groups.pop_back();
+                groups[entry - FIRST_GROUP] = group;
+            }
+            tbl24[block] = entry;
+        }
+        uint64_t * const bits = groups[entry - FIRST_GROUP].bits;
+        for (unsigned w = lo >> 6; w <= (hi >> 6); ++w) {
+            unsigned const from = w == (lo >> 6) ? lo & 63 : 0;
+            unsigned const to = w == (hi >> 6) ? hi & 63 : 63;
+            uint64_t const mask = (~uint64_t(0) >> (63 - to)) & (~uint64_t(0) << from);
+            bits[w] = hit ? bits[w] | mask : bits[w] & ~mask;
+        }
+        uint64_t const all = bits[0] & bits[1] & bits[2] & bits[3];
+        uint64_t const any = bits[0] | bits[1] | bits[2] | bits[3];
+        if (all == ~uint64_t(0)) {
+            SetEntry(block, HIT);
+        } else if (any == 0) {
+            SetEntry(block, MISS);
+        }
+    }
+};
+
+} // End of namespace 'dir24_8'
+} // End of namespace 'yhb'
+
+#endif
@@ -0,0 +1,186 @@
+#include "expiring_route_table.h"
+#include "yhb_common.h"
+#include "timing_wheel.h"
+#include "dir24_8.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace yhb {
+
+ExpiringRouteTable::ExpiringRouteTable(uint64_t now)
+    : wheel(new TimingWheel<SegmentTimer>(now))
+    , index(new dir24_8::Index())
+{
+    index->Reset();
+}
+
+ExpiringRouteTable::~ExpiringRouteTable() = default;
+
+uint64_t ExpiringRouteTable::GetTime() const {
+    return wheel->GetTime();
+}
+
+bool ExpiringRouteTable::Insert(const char * cidr_str, uint64_t expire_at) {
+    RouteTable::CIDR cidr;
+    if (LIKELY(RouteTable::ParseCIDR(cidr_str, cidr))) {
+        return Insert(cidr.prefix, cidr.network_bits, expire_at);
+    } else {
+        return false;
+    }
+}
+
+bool ExpiringRouteTable::Insert(uint32_t prefix_net_order, unsigned network_bits, uint64_t expire_at) {
+    if (network_bits > 32) {
+        return false;
+    }
+    uint32_t const mask = network_bits == 0 ? 0 : uint32_t(-1) << (32 - network_bits);
+    RouteTable::IpRange range;
+    range.first = ntohl(prefix_net_order) & mask;
+    range.last = range.first | (~mask);
+    return Insert(range, expire_at);
+}
+
+bool ExpiringRouteTable::Insert(const RouteTable::IpRange range, uint64_t expire_at) {
+    if (!range) {
+        return false;
+    }
+    if (expire_at <= wheel->GetTime()) {
+        return true;
+    }
+
+    // Split the segments overlapping the range at its bounds, the parts inside get the later deadline,
+    // the gaps between them get the new one.
+    struct Piece {
+        uint32_t first;
+        uint32_t last;
+        uint64_t expire_at;
+        bool changed;       // Not the same as an existing segment, so its timer is to be scheduled.
+    };
+    std::vector<Piece> pieces;
+    auto it = segments.upper_bound(range.first);
+    if (it != segments.begin() && std::prev(it)->second.last >= range.first) {
+        --it;
+    }
+    auto const overlapped = it;
+    uint64_t pos = range.first;
+    for (; it != segments.end() && it->first <= range.last; ++it) {
+        uint32_t const first = it->first;
+        Segment const & seg = it->second;
+        if (first < range.first) {
+            pieces.push_back(Piece{ first, range.first - 1, seg.expire_at, true });
+        }
+        if (pos < first) {
+            pieces.push_back(Piece{ static_cast<uint32_t>(pos), first - 1, expire_at, true });
+        }
+        uint32_t const inner_first = std::max(first, range.first);
+        uint32_t const inner_last = std::min(seg.last, range.last);
+        bool const kept = inner_first == first && inner_last == seg.last && seg.expire_at >= expire_at;
+        pieces.push_back(Piece{ inner_first, inner_last, std::max(seg.expire_at, expire_at), !kept });
+        if (seg.last > range.last) {
+            pieces.push_back(Piece{ range.last + 1, seg.last, seg.expire_at, true });
+        }
+        pos = uint64_t(seg.last) + 1;
+    }
+    if (pos <= range.last) {
+        pieces.push_back(Piece{ static_cast<uint32_t>(pos), range.last, expire_at, true });
+    }
+
+    // Merge the adjacent pieces of the same deadline, the neighbors of the range included.
+    auto before = overlapped;
+    if (before != segments.begin()) {
+        --before;
+        if (before->second.last + 1 == pieces.front().first && before->second.expire_at == pieces.front().expire_at) {
+            pieces.front().first = before->first;
+            pieces.front().changed = true;
+        } else {
+            ++before;
+        }
+    }
+    auto after = it;
+    if (after != segments.end() && pieces.back().last + 1 == after->first
+        && after->second.expire_at == pieces.back().expire_at)
+    {
+        pieces.back().last = after->second.last;
+        pieces.back().changed = true;
+        ++after;
+    }
+    segments.erase(before, after);
+
+    auto hint = after;
+    size_t w = 0;
+    for (size_t i = 1; i < pieces.size(); ++i) {
+        if (pieces[i].first == pieces[w].last + 1 && pieces[i].expire_at == pieces[w].expire_at) {
+            pieces[w].last = pieces[i].last;
+            pieces[w].changed = true;
+        } else {
+            pieces[++w] = pieces[i];
+        }
+    }
+    pieces.resize(w + 1);
+    for (const Piece & p : pieces) {
+        segments.emplace_hint(hint, p.first, Segment{ p.last, p.expire_at });
+        if (p.changed) {
+            wheel->Schedule(p.expire_at, SegmentTimer{ p.first, p.last });
+        }
+    }
+
+    index->Fill(range.first, range.last);
+    return true;
+}
+
+size_t ExpiringRouteTable::Advance(uint64_t now) {
+    size_t expired = 0;
+    wheel->Advance(now, [this, &expired](uint64_t deadline, const SegmentTimer & timer) {
+        auto const it = segments.find(timer.first);
+        if (it != segments.end() && it->second.last == timer.last && it->second.expire_at == deadline) {
+            // The segments are disjoint, the addresses of the others are not touched.
+            index->Clear(timer.first, timer.last);
+            segments.erase(it);
+            ++expired;
+        }
+    });
+    return expired;
+}
+
+bool ExpiringRouteTable::Find(uint32_t ip, bool host_order) const {
+    return index->Find(host_order ? ip : ntohl(ip));
+}
+
+bool ExpiringRouteTable::GetExpiry(uint32_t ip, uint64_t & expire_at) const {
+    auto it = segments.upper_bound(ip);
+    if (it == segments.begin()) {
+        return false;
+    }
+    --it;
+    if (it->second.last < ip) {
+        return false;
+    }
+    expire_at = it->second.expire_at;
+    return true;
+}
+
+RouteTable ExpiringRouteTable::ToRouteTable() const {
+    std::vector<RouteTable::IpRange> ranges;
+    ranges.reserve(segments.size());
+    for (auto const & seg : segments) {
+        ranges.push_back(RouteTable::IpRange{ seg.first, seg.second.last });
+    }
+    RouteTable tab;
+    tab.BulkInsert(ranges.data(), ranges.size(), 1);
+    return tab;
+}
+
+void ExpiringRouteTable::Clear() {
+    segments.clear();
+    wheel.reset(new TimingWheel<SegmentTimer>(wheel->GetTime()));
+    index->Reset();
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,191 @@
+#include "frozen_route_table.h"
+#include "yhb_common.h"
+#include "cpu_features.h"
+#include <cstdint>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace yhb {
+
+// Keys per node, 64 bytes, a cache line.
+static size_t const NODE_KEYS = 16;
+static size_t const NODE_CHILDREN = NODE_KEYS + 1;
+
+static uint32_t const KEY_BIAS = 0x80000000;
+static uint32_t const KEY_PADDING = 0xffffffff ^ KEY_BIAS;
+
+// What the kernels need to walk the tree.
+struct SearchTree {
+    const uint32_t * tree;
+    const size_t * layer_offsets;
+    size_t height;
+};
+
+// Returns the number of the keys less or equal than the given key, in the whole leaf layer.
+typedef size_t (*search_kernel_t)(const SearchTree & t, int32_t key);
+
+static inline size_t rank_scalar(const uint32_t * node, int32_t key) {
+    size_t r = 0;
+    for (size_t i = 0; i < NODE_KEYS; ++i) {
+        r += static_cast<int32_t>(node[i]) <= key;
+    }
+    return r;
+}
+
+static size_t search_scalar(const SearchTree & t, int32_t key) {
+    size_t k = 0;
+    for (size_t h = t.height - 1; h > 0; --h) {
+        k = k * NODE_CHILDREN + rank_scalar(t.tree + t.layer_offsets[h] + k * NODE_KEYS, key);
+    }
+    return k * NODE_KEYS + rank_scalar(t.tree + t.layer_offsets[0] + k * NODE_KEYS, key);
+}
+
+#if YHB_X86
+
+YHB_TARGET("avx2")
+static inline size_t rank_avx2(const uint32_t * node, __m256i key) {
+    __m256i const lo = _mm256_loadu_si256((const __m256i *)node);
+    __m256i const hi = _mm256_loadu_si256((const __m256i *)(node + 8));
+    unsigned const greater = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lo, key)))
+        | ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(hi, key))) << 8);
+    // The keys are sorted, so the greater ones are the trailing ones.
+    return count_trailing_zeros(greater | (1u << NODE_KEYS));
+}
+
+YHB_TARGET("avx2")
+static size_t search_avx2(const SearchTree & t, int32_t key) {
+    __m256i const k8 = _mm256_set1_epi32(key);
+    size_t k = 0;
+    for (size_t h = t.height - 1; h > 0; --h) {
+        k = k * NODE_CHILDREN + rank_avx2(t.tree + t.layer_offsets[h] + k * NODE_KEYS, k8);
+    }
+    return k * NODE_KEYS + rank_avx2(t.tree + t.layer_offsets[0] + k * NODE_KEYS, k8);
+}
+
+#endif
+
+/**
+ * @brief Get the kernel function of the given kind.
+ *
+ * @return Returning nullptr if the running CPU does not support it.
+ */
+static search_kernel_t get_search_kernel(FrozenRouteTable::Kernel kernel) {
+    switch (kernel) {
+    case FrozenRouteTable::Kernel::SCALAR:
+        return search_scalar;
+#if YHB_X86
+    case FrozenRouteTable::Kernel::AVX2:
+        return get_cpu_features().avx2 ? search_avx2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+static search_kernel_t search_kernel = search_scalar;
+static FrozenRouteTable::Kernel active_kernel = FrozenRouteTable::Kernel::SCALAR;
+
+static FrozenRouteTable::Kernel select_best_kernel() {
+    FrozenRouteTable::Kernel const k = get_search_kernel(FrozenRouteTable::Kernel::AVX2) != nullptr
+        ? FrozenRouteTable::Kernel::AVX2
+        : FrozenRouteTable::Kernel::SCALAR;
+    search_kernel = get_search_kernel(k);
+    active_kernel = k;
+    return k;
+}
+
+// Picked once at startup, may be overridden by FrozenRouteTable::SetKernel().
+static FrozenRouteTable::Kernel const best_kernel = select_best_kernel();
+
+bool FrozenRouteTable::SetKernel(Kernel kernel) {
+    if (kernel == Kernel::AUTO) {
+        kernel = best_kernel;
+    }
+    search_kernel_t const f = get_search_kernel(kernel);
+    if (f == nullptr) {
+        return false;
+    }
+    search_kernel = f;
+    active_kernel = kernel;
+    return true;
+}
+
+FrozenRouteTable::Kernel FrozenRouteTable::GetKernel() {
+    return active_kernel;
+}
+
+FrozenRouteTable::FrozenRouteTable() : tree_offset(0) {}
+
+FrozenRouteTable::FrozenRouteTable(const RouteTable & tab) : tree_offset(0) {
+    size_t const n = tab.GetCount();
+    if (n == 0) {
+        return;
+    }
+    lasts.reserve(n);
+    for (const RouteTable::IpRange & r : tab) {
+        lasts.push_back(r.last);
+    }
+
+    // Number of the nodes of each layer, the leaves first, up to the single root.
+    std::vector<size_t> nodes(1, (n + NODE_KEYS - 1) / NODE_KEYS);
+    while (nodes.back() > 1) {
+        nodes.push_back((nodes.back() + NODE_CHILDREN - 1) / NODE_CHILDREN);
+    }
+    size_t const height = nodes.size();
+
+    // The top layer comes first, the leaves last.
+    layer_offsets.resize(height);
+    size_t total = 0;
+    for (size_t h = height; h-- > 0;) {
+        layer_offsets[h] = total;
+        total += nodes[h] * NODE_KEYS;
+    }
+
+    // Spare room for aligning the tree to a cache line. A copy of the table may be misaligned, which is
+    // slightly slower, but still correct.
+    storage.assign(total + NODE_KEYS, KEY_PADDING);
+    uintptr_t const misalign = reinterpret_cast<uintptr_t>(storage.data()) % (NODE_KEYS * sizeof(uint32_t));
+    tree_offset = misalign == 0 ? 0 : (NODE_KEYS * sizeof(uint32_t) - misalign) / sizeof(uint32_t);
+    uint32_t * const tree = storage.data() + tree_offset;
+
+    uint32_t * const leaves = tree + layer_offsets[0];
+    size_t i = 0;
+    for (const RouteTable::IpRange & r : tab) {
+        leaves[i++] = r.first ^ KEY_BIAS;
+    }
+
+    // Key i of an inner node is the smallest key of its child i + 1, the leftmost leaf of that subtree.
+    size_t leaves_per_child = 1;    // Leaf nodes under a node of the layer below.
+    for (size_t h = 1; h < height; ++h) {
+        uint32_t * const layer = tree + layer_offsets[h];
+        for (size_t k = 0; k < nodes[h]; ++k) {
+            for (size_t j = 0; j < NODE_KEYS; ++j) {
+                size_t const child = k * NODE_CHILDREN + j + 1;
+                size_t const first = child * leaves_per_child * NODE_KEYS;
+                layer[k * NODE_KEYS + j] = child < nodes[h - 1] && first < n ? leaves[first] : KEY_PADDING;
+            }
+        }
+        leaves_per_child *= NODE_CHILDREN;
+    }
+}
+
+bool FrozenRouteTable::Find(uint32_t ip, bool host_order) const {
+    if (UNLIKELY(lasts.empty())) {
+        return false;
+    }
+    uint32_t const key = host_order ? ip : ntohl(ip);
+    if (UNLIKELY(key == 0xffffffff)) {
+        // Not distinguishable from the padding, and it can only be in the last range.
+        return lasts.back() == 0xffffffff;
+    }
+
+    SearchTree const t = { storage.data() + tree_offset, layer_offsets.data(), layer_offsets.size() };
+    size_t const pos = search_kernel(t, static_cast<int32_t>(key ^ KEY_BIAS));
+    return pos != 0 && lasts[pos - 1] >= key;
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,81 @@
+#ifndef YHB_IP_TEXT_H
+#define YHB_IP_TEXT_H
+
+// Internal parsers of the textual IP addresses, shared by RouteTable and RouteTable6. Not part of the public interface.
+
+#include <cstdint>
+
+namespace yhb {
+
+static inline bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+/**
+ * @brief Parse a dotted-quad IPv4 address, as strict as inet_pton(), leading zeros are not allowed.
+ *
+ * @param p The text, moved to the end of the address on success.
+ * @param end End of the text.
+ * @param ip_host_order Receives the address, by host bits order.
+ * @return Returning false if there's no valid address at the beginning of the text.
+ */
+static inline bool parse_ipv4(const char * & p, const char * end, uint32_t & ip_host_order) {
+    const char * s = p;
+    uint32_t ip = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (i != 0) {
+            if (s == end || *s != '.') {
+                return false;
+            }
+            ++s;
+        }
+        if (s == end || !is_digit(*s)) {
+            return false;
+        }
+        unsigned octet = *s++ - '0';
+        for (int digits = 1; s != end && is_digit(*s); ++digits) {
+            if (digits == 3 || octet == 0) {
+                return false;
+            }
+            octet = octet * 10 + (*s++ - '0');
+        }
+        if (octet > 255) {
+            return false;
+        }
+        ip = (ip << 8) | octet;
+    }
+    ip_host_order = ip;
+    p = s;
+    return true;
+}
+
+/**
+ * @brief Parse a prefix length in [0,max_bits], with no more digits than 'max_bits' has.
+ *
+ * @param p The text, moved to the end of the number on success.
+ * @param end End of the text.
+ * @param max_bits The maximum prefix length, 32 for IPv4 or 128 for IPv6.
+ * @param bits Receives the prefix length.
+ * @return Returning false if there's no valid prefix length at the beginning of the text.
+ */
+static inline bool parse_prefix_len(const char * & p, const char * end, unsigned max_bits, unsigned & bits) {
+    int const max_digits = max_bits >= 100 ? 3 : 2;
+    const char * s = p;
+    unsigned n = 0;
+    for (int digits = 0; s != end && is_digit(*s); ++digits) {
+        if (digits == max_digits) {
+            return false;
+        }
+        n = n * 10 + (*s++ - '0');
+    }
+    if (s == p || n > max_bits) {
+        return false;
+    }
+    bits = n;
+    p = s;
+    return true;
+}
+
+} // End of namespace 'yhb'
+
+#endif
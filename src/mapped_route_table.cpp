@@ -0,0 +1,173 @@
+#include "mapped_route_table.h"
+#include "route_table_snapshot.h"
+#include "dir24_8.h"
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace yhb {
+
+using IpRange = RouteTable::IpRange;
+
+#ifndef _WIN32
+/**
+ * @brief Map the whole file of a descriptor for reading, shared with the other processes, then close it.
+ *
+ * @return Returning null on failure.
+ */
+static void * map_fd(int fd, size_t & size) {
+    if (fd < 0) {
+        return nullptr;
+    }
+    void * view = nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) {
+            view = nullptr;
+        }
+        size = static_cast<size_t>(st.st_size);
+    }
+    close(fd);     // The mapping keeps the file.
+    return view;
+}
+#endif
+
+/**
+ * @brief Map a whole file for reading, shared with the other processes.
+ *
+ * @return Returning null on failure.
+ */
+static void * map_file(const char * path, size_t & size) {
+#ifdef _WIN32
+    HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    void * view = nullptr;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        HANDLE const mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);   // The view keeps the mapping.
+        }
+        size = static_cast<size_t>(file_size.QuadPart);
+    }
+    CloseHandle(file);
+    return view;
+#else
+    return map_fd(open(path, O_RDONLY), size);
+#endif
+}
+
+static void unmap_file(void * base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+MappedRouteTable::MappedRouteTable()
+    : base(nullptr)
+    , size(0)
+    , ranges(nullptr)
+    , count(0)
+    , tbl24(nullptr)
+    , groups(nullptr)
+    , group_count(0) {}
+
+MappedRouteTable::~MappedRouteTable() {
+    Close();
+}
+
+bool MappedRouteTable::Open(const char * path, bool verify) {
+    Close();
+    size_t file_size = 0;
+    void * const view = map_file(path, file_size);
+    return view != nullptr && Attach(view, file_size, verify);
+}
+
+bool MappedRouteTable::OpenSharedMemory(const char * name, bool verify) {
+    Close();
+#ifdef _WIN32
+    (void)name;
+    (void)verify;
+    return false;
+#else
+    size_t object_size = 0;
+    void * const view = map_fd(shm_open(name, O_RDONLY, 0), object_size);
+    return view != nullptr && Attach(view, object_size, verify);
+#endif
+}
+
+bool MappedRouteTable::Attach(void * view, size_t file_size, bool verify) {
+    snapshot::View parts;
+    if (!snapshot::parse(view, file_size, verify, parts)) {
+        unmap_file(view, file_size);
+        return false;
+    }
+    base = view;
+    size = file_size;
+    ranges = parts.ranges;
+    count = parts.range_count;
+    tbl24 = parts.tbl24;
+    groups = parts.groups;
+    group_count = parts.group_count;
+    return true;
+}
+
+void MappedRouteTable::Close() {
+    if (base != nullptr) {
+        unmap_file(base, size);
+    }
+    base = nullptr;
+    size = 0;
+    ranges = nullptr;
+    count = 0;
+    tbl24 = nullptr;
+    groups = nullptr;
+    group_count = 0;
+}
+
+void MappedRouteTable::Swap(MappedRouteTable & other) {
+    std::swap(base, other.base);
+    std::swap(size, other.size);
+    std::swap(ranges, other.ranges);
+    std::swap(count, other.count);
+    std::swap(tbl24, other.tbl24);
+    std::swap(groups, other.groups);
+    std::swap(group_count, other.group_count);
+}
+
+bool MappedRouteTable::Find(uint32_t ip, bool host_order) const {
+    uint32_t const key = host_order ? ip : ntohl(ip);
+    if (tbl24 != nullptr) {
+        uint32_t const entry = tbl24[key >> 8];
+        if (LIKELY(entry < dir24_8::FIRST_GROUP)) {
+            return entry == dir24_8::HIT;
+        }
+        // Bounded, the index of a snapshot opened without verifying may be corrupted.
+        size_t const group = entry - dir24_8::FIRST_GROUP;
+        return group < group_count && dir24_8::test_group(static_cast<const dir24_8::Group *>(groups)[group], key);
+    }
+    // The last range starting at or before the key.
+    const IpRange * const pos = std::upper_bound(ranges, ranges + count, key,
+        [](uint32_t k, const IpRange & r) { return k < r.first; });
+    return pos != ranges && pos[-1].last >= key;
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,384 @@
+#include "packet_classifier.h"
+#include "yhb_common.h"
+#include "cpu_features.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace yhb {
+
+uint32_t const PacketClassifier::NO_MATCH;
+
+enum : unsigned {
+    FIELD_SRC,
+    FIELD_DST,
+    FIELD_SRC_PORT,
+    FIELD_DST_PORT,
+    FIELD_PROTOCOL,
+    FIELD_COUNT,
+    ADDRESS_FIELD_COUNT = FIELD_SRC_PORT,   // The fields before are searched, the others are looked up by value.
+};
+
+// The lookups of a batch are interleaved by groups of this many packets.
+static size_t const BATCH_SIZE = 16;
+
+static void get_field_range(const PacketClassifier::Rule & rule, unsigned field, uint32_t & first, uint32_t & last) {
+    switch (field) {
+    case FIELD_SRC:
+        first = rule.src.first;
+        last = rule.src.last;
+        break;
+    case FIELD_DST:
+        first = rule.dst.first;
+        last = rule.dst.last;
+        break;
+    case FIELD_SRC_PORT:
+        first = rule.src_port.first;
+        last = rule.src_port.last;
+        break;
+    case FIELD_DST_PORT:
+        first = rule.dst_port.first;
+        last = rule.dst_port.last;
+        break;
+    default:
+        first = rule.protocol.first;
+        last = rule.protocol.last;
+        break;
+    }
+}
+
+static inline uint32_t get_field_value(const PacketClassifier::Packet & packet, unsigned field) {
+    switch (field) {
+    case FIELD_SRC:
+        return packet.src;
+    case FIELD_DST:
+        return packet.dst;
+    case FIELD_SRC_PORT:
+        return packet.src_port;
+    case FIELD_DST_PORT:
+        return packet.dst_port;
+    default:
+        return packet.protocol;
+    }
+}
+
+static bool cidr_to_range(const char * cidr_str, RouteTable::IpRange & range) {
+    RouteTable::CIDR cidr;
+    if (!RouteTable::ParseCIDR(cidr_str, cidr)) {
+        return false;
+    }
+    uint32_t const mask = cidr.network_bits == 0 ? 0 : uint32_t(-1) << (32 - cidr.network_bits);
+    range.first = ntohl(cidr.prefix) & mask;
+    range.last = range.first | (~mask);
+    return true;
+}
+
+/**
+ * @brief The bit vectors of the rules, the bit i of a vector is the i-th rule by priority.
+ */
+struct PacketClassifier::Compiled {
+    struct Field {
+        std::vector<uint32_t> starts;       // First values of the intervals, from 0, of the address fields only.
+        std::vector<uint32_t> vectors;      // Offsets in 'bits' of the vector of each interval, of each value
+                                            // for the ports and the protocol.
+        std::vector<uint64_t> bits;         // The distinct vectors, the summary words and then the words of each.
+    };
+
+    Field fields[FIELD_COUNT];
+    size_t summary_words;                   // A bit for each word of a vector, set if the word is not zero.
+    size_t words;
+    std::vector<uint32_t> ids;              // IDs of the rules by priority.
+
+    void Build(const std::vector<Rule> & sorted);
+
+    void BuildField(const std::vector<Rule> & sorted, unsigned field, uint32_t max_value);
+
+    const uint64_t * GetVector(unsigned field, size_t pos) const {
+        const Field & f = fields[field];
+        return f.bits.data() + f.vectors[pos];
+    }
+
+    // The interval of the value of an address field.
+    size_t Search(unsigned field, uint32_t value) const {
+        const std::vector<uint32_t> & starts = fields[field].starts;
+        size_t pos = 0;
+        size_t len = starts.size();
+        while (len > 1) {
+            size_t const half = len / 2;
+            pos = starts[pos + half] <= value ? pos + half : pos;
+            len -= half;
+        }
+        return pos;
+    }
+
+    // The rule of the first bit set in all the vectors, the summaries pick the words to check.
+    uint32_t Match(const uint64_t * const (&v)[FIELD_COUNT]) const {
+        for (size_t s = 0; s < summary_words; ++s) {
+            uint64_t candidates = v[0][s] & v[1][s] & v[2][s] & v[3][s] & v[4][s];
+            while (candidates != 0) {
+                size_t const w = s * 64 + count_trailing_zeros64(candidates);
+                size_t const at = summary_words + w;
+                uint64_t const matched = v[0][at] & v[1][at] & v[2][at] & v[3][at] & v[4][at];
+                if (matched != 0) {
+                    return ids[w * 64 + count_trailing_zeros64(matched)];
+                }
+                candidates &= candidates - 1;
+            }
+        }
+        return NO_MATCH;
+    }
+
+    size_t GetMemorySize() const {
+        size_t size = ids.size() * sizeof(ids[0]);
+        for (const Field & f : fields) {
+            size += f.starts.size() * sizeof(f.starts[0]) + f.vectors.size() * sizeof(f.vectors[0])
+                + f.bits.size() * sizeof(f.bits[0]);
+        }
+        return size;
+    }
+
+    size_t GetVectorCount() const {
+        size_t count = 0;
+        for (const Field & f : fields) {
+            count += words == 0 ? 0 : f.bits.size() / (summary_words + words);
+        }
+        return count;
+    }
+};
+
+void PacketClassifier::Compiled::Build(const std::vector<Rule> & sorted) {
+    words = (sorted.size() + 63) / 64;
+    summary_words = (words + 63) / 64;
+    ids.reserve(sorted.size());
+    for (const Rule & rule : sorted) {
+        ids.push_back(rule.id);
+    }
+    BuildField(sorted, FIELD_SRC, 0xffffffff);
+    BuildField(sorted, FIELD_DST, 0xffffffff);
+    BuildField(sorted, FIELD_SRC_PORT, 0xffff);
+    BuildField(sorted, FIELD_DST_PORT, 0xffff);
+    BuildField(sorted, FIELD_PROTOCOL, 0xff);
+}
+
+void PacketClassifier::Compiled::BuildField(const std::vector<Rule> & sorted, unsigned field, uint32_t max_value) {
+    Field & f = fields[field];
+    std::vector<uint32_t> & starts = f.starts;
+    starts.reserve(sorted.size() * 2 + 1);
+    starts.push_back(0);
+    for (const Rule & rule : sorted) {
+        uint32_t first, last;
+        get_field_range(rule, field, first, last);
+        starts.push_back(first);
+        if (last < max_value) {
+            starts.push_back(last + 1);
+        }
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    // The bit of a rule flips at its first interval and at the one after its last, by the interval then the rule.
+    std::vector<uint64_t> flips;
+    flips.reserve(sorted.size() * 2);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        uint32_t first, last;
+        get_field_range(sorted[i], field, first, last);
+        flips.push_back(uint64_t(std::lower_bound(starts.begin(), starts.end(), first) - starts.begin()) << 32 | i);
+        if (last < max_value) {
+            flips.push_back(uint64_t(std::lower_bound(starts.begin(), starts.end(), last + 1) - starts.begin()) << 32
+                | i);
+        }
+    }
+    std::sort(flips.begin(), flips.end());
+
+    // Sweep the intervals, a vector is stored if not the same as one stored already.
+    size_t const stride = summary_words + words;
+    std::vector<uint64_t> current(words, 0);
+    std::unordered_multimap<uint64_t, uint32_t> stored;     // Offsets of the vectors by hash.
+    std::vector<uint32_t> offsets(starts.size());
+    size_t next_flip = 0;
+    for (size_t pos = 0; pos < starts.size(); ++pos) {
+        bool changed = pos == 0;
+        for (; next_flip < flips.size() && (flips[next_flip] >> 32) == pos; ++next_flip) {
+            uint32_t const rule = static_cast<uint32_t>(flips[next_flip]);
+            current[rule / 64] ^= uint64_t(1) << (rule % 64);
+            changed = true;
+        }
+        if (!changed) {
+            offsets[pos] = offsets[pos - 1];
+            continue;
+        }
+        uint64_t hash = 14695981039346656037ull;
+        for (uint64_t word : current) {
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        bool found = false;
+        auto const same = stored.equal_range(hash);
+        for (auto it = same.first; it != same.second; ++it) {
+            if (memcmp(f.bits.data() + it->second + summary_words, current.data(), words * sizeof(uint64_t)) == 0) {
+                offsets[pos] = it->second;
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            continue;
+        }
+        uint32_t const offset = static_cast<uint32_t>(f.bits.size());
+        f.bits.resize(f.bits.size() + stride, 0);
+        uint64_t * const vector = f.bits.data() + offset;
+        for (size_t w = 0; w < words; ++w) {
+            vector[summary_words + w] = current[w];
+            if (current[w] != 0) {
+                vector[w / 64] |= uint64_t(1) << (w % 64);
+            }
+        }
+        stored.emplace(hash, offset);
+        offsets[pos] = offset;
+    }
+    f.bits.shrink_to_fit();
+
+    if (field < ADDRESS_FIELD_COUNT) {
+        f.vectors.swap(offsets);
+        return;
+    }
+    // The ports and the protocol are few values, each value has its vector, so no search.
+    f.vectors.resize(size_t(max_value) + 1);
+    for (size_t pos = 0; pos < starts.size(); ++pos) {
+        size_t const end = pos + 1 < starts.size() ? starts[pos + 1] : f.vectors.size();
+        std::fill(f.vectors.begin() + starts[pos], f.vectors.begin() + end, offsets[pos]);
+    }
+    std::vector<uint32_t>().swap(starts);
+}
+
+bool PacketClassifier::AddRule(const Rule & rule) {
+    if (!rule.src || !rule.dst || rule.src_port.first > rule.src_port.last
+        || rule.dst_port.first > rule.dst_port.last || rule.protocol.first > rule.protocol.last
+        || rule.id == NO_MATCH)
+    {
+        return false;
+    }
+    rules.push_back(rule);
+    compiled.reset();
+    return true;
+}
+
+bool PacketClassifier::AddRule(const char * src_cidr, const char * dst_cidr, PortRange src_port,
+    PortRange dst_port, ProtocolRange protocol, uint32_t priority, uint32_t id)
+{
+    Rule rule;
+    if (!cidr_to_range(src_cidr, rule.src) || !cidr_to_range(dst_cidr, rule.dst)) {
+        return false;
+    }
+    rule.src_port = src_port;
+    rule.dst_port = dst_port;
+    rule.protocol = protocol;
+    rule.priority = priority;
+    rule.id = id;
+    return AddRule(rule);
+}
+
+void PacketClassifier::Clear() {
+    rules.clear();
+    compiled.reset();
+}
+
+PacketClassifier::CompileStats PacketClassifier::Compile() {
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<Rule> sorted(rules);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Rule & lv, const Rule & rv) {
+        return lv.priority < rv.priority;
+    });
+    std::shared_ptr<Compiled> vectors = std::make_shared<Compiled>();
+    vectors->Build(sorted);
+    compiled = vectors;
+
+    CompileStats stats;
+    stats.memory_bytes = vectors->GetMemorySize();
+    stats.vector_count = vectors->GetVectorCount();
+    stats.build_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+uint32_t PacketClassifier::Scan(const Packet & packet) const {
+    const Rule * best = nullptr;
+    for (const Rule & rule : rules) {
+        bool matched = best == nullptr || rule.priority < best->priority;
+        for (unsigned field = 0; matched && field < FIELD_COUNT; ++field) {
+            uint32_t first, last;
+            get_field_range(rule, field, first, last);
+            uint32_t const value = get_field_value(packet, field);
+            matched = first <= value && value <= last;
+        }
+        if (matched) {
+            best = &rule;
+        }
+    }
+    return best == nullptr ? NO_MATCH : best->id;
+}
+
+uint32_t PacketClassifier::Classify(const Packet & packet) const {
+    if (!compiled) {
+        return Scan(packet);
+    }
+    const Compiled & c = *compiled;
+    const uint64_t * const v[FIELD_COUNT] = {
+        c.GetVector(FIELD_SRC, c.Search(FIELD_SRC, packet.src)),
+        c.GetVector(FIELD_DST, c.Search(FIELD_DST, packet.dst)),
+        c.GetVector(FIELD_SRC_PORT, packet.src_port),
+        c.GetVector(FIELD_DST_PORT, packet.dst_port),
+        c.GetVector(FIELD_PROTOCOL, packet.protocol),
+    };
+    return c.Match(v);
+}
+
+void PacketClassifier::ClassifyBatch(const Packet * packets, size_t n, uint32_t * ids) const {
+    if (!compiled) {
+        for (size_t i = 0; i < n; ++i) {
+            ids[i] = Scan(packets[i]);
+        }
+        return;
+    }
+    const Compiled & c = *compiled;
+    for (size_t base = 0; base < n; base += BATCH_SIZE) {
+        size_t const m = std::min(BATCH_SIZE, n - base);
+        const Packet * const p = packets + base;
+        const uint64_t * v[BATCH_SIZE][FIELD_COUNT];
+
+        // The binary searches of the packets go step by step together, the loads of a step are independent.
+        for (unsigned field = 0; field < ADDRESS_FIELD_COUNT; ++field) {
+            const uint32_t * const starts = c.fields[field].starts.data();
+            size_t pos[BATCH_SIZE] = {};
+            size_t len = c.fields[field].starts.size();
+            while (len > 1) {
+                size_t const half = len / 2;
+                for (size_t k = 0; k < m; ++k) {
+                    pos[k] = starts[pos[k] + half] <= get_field_value(p[k], field) ? pos[k] + half : pos[k];
+                }
+                len -= half;
+            }
+            for (size_t k = 0; k < m; ++k) {
+                v[k][field] = c.GetVector(field, pos[k]);
+                prefetch_for_read(v[k][field]);
+            }
+        }
+        for (size_t k = 0; k < m; ++k) {
+            for (unsigned field = ADDRESS_FIELD_COUNT; field < FIELD_COUNT; ++field) {
+                v[k][field] = c.GetVector(field, get_field_value(p[k], field));
+                prefetch_for_read(v[k][field]);
+            }
+        }
+        for (size_t k = 0; k < m; ++k) {
+            ids[base + k] = c.Match(v[k]);
+        }
+    }
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,47 @@
+#include "rcu_holder.h"
+#include <new>
+#include <thread>
+
+namespace yhb {
+
+// Each thread takes the next slot on its first read, the same slot of all the holders.
+static size_t this_thread_slot() {
+    static std::atomic<size_t> next_slot(0);
+    thread_local size_t const slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+RcuReaders::RcuReaders()
+    : phase(0)
+    , storage(new char[(SLOT_COUNT + 1) * CACHE_LINE_SIZE])
+{
+    uintptr_t const addr = reinterpret_cast<uintptr_t>(storage.get());
+    slots = reinterpret_cast<Slot *>((addr + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+    for (size_t i = 0; i < SLOT_COUNT; ++i) {
+        new (&slots[i]) Slot();
+        slots[i].counters[0].store(0, std::memory_order_relaxed);
+        slots[i].counters[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::atomic<uint32_t> * RcuReaders::Enter() {
+    Slot & slot = slots[this_thread_slot() % SLOT_COUNT];
+    // Sequentially consistent, so that a reader counted after the writer checked its counter sees
+    // the new object.
+    uint32_t const p = phase.load(std::memory_order_seq_cst) & 1;
+    slot.counters[p].fetch_add(1, std::memory_order_seq_cst);
+    return &slot.counters[p];
+}
+
+void RcuReaders::Synchronize() {
+    for (int round = 0; round < 2; ++round) {
+        uint32_t const old_phase = phase.fetch_add(1, std::memory_order_seq_cst) & 1;
+        for (size_t i = 0; i < SLOT_COUNT; ++i) {
+            while (slots[i].counters[old_phase].load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+} // End of namespace 'yhb'
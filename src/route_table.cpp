@@ -1,13 +1,20 @@
 ﻿#include "route_table.h"
 #include "yhb_common.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
+#include "dir24_8.h"
+#include "route_table_snapshot.h"
+#include "ip_text.h"
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <utility>
 
 #ifdef _WIN32
 #include <WinSock2.h>
-#include <ws2tcpip.h>
 #else
 #include <arpa/inet.h>
 #endif
@@ -16,6 +23,30 @@ namespace yhb {
 
 using CIDR = RouteTable::CIDR;
 
+/**
+ * @brief The DIR-24-8 index, @see dir24_8.h.
+ */
+struct RouteTable::Dir24_8 : dir24_8::Index {
+    void Build(const std::vector<IpRange> & ranges) {
+        Reset();
+        for (const IpRange & r : ranges) {
+            Fill(r.first, r.last);
+        }
+    }
+
+    // Rebuild the entries of the /24 blocks from the first to the last from the ranges.
+    void Patch(const std::vector<IpRange> & ranges, uint32_t first_block, uint32_t last_block) {
+        uint32_t const lo = first_block << 8;
+        uint32_t const hi = (last_block << 8) | 0xff;
+        Clear(lo, hi);
+        IpRange const span = { lo, lo };
+        auto it = std::lower_bound(ranges.cbegin(), ranges.cend(), span, pred_for_search);
+        for (; it != ranges.cend() && it->first <= hi; ++it) {
+            Fill(std::max(it->first, lo), std::min(it->last, hi));
+        }
+    }
+};
+
 RouteTable::RouteTable() {
     containers.reserve(64);
 }
@@ -23,76 +54,73 @@ RouteTable::RouteTable() {
 /**
  * @brief Parse a given CIDR string.
  *
- * @param str The CIDR string, should be "xx.xxx.x.xx/n".
- * @return Return the CIDR. If the str parameter is not valid, the prefix field of the result is 0.
+ * @param str The CIDR string, should be "xx.xxx.x.xx/n", or a single IP address. The address is as strict as
+ *            inet_pton(), the 'n' is as lenient as strtol().
+ * @param result Receives the CIDR.
+ * @return Returning false if the str parameter is not valid.
  */
-static CIDR parse_cidr_str(const char * str) {
-    CIDR result;
+static bool parse_cidr_str(const char * str, CIDR & result) {
     const char * p = str;
-    for (;; ++p) {
-        char const ch = *p;
-        if (ch == '/') {
-            break;
-        } else if (UNLIKELY(ch == '\0')) {
-            // No '/' present, it's a single IP address
-            if (UNLIKELY(1 != inet_pton(AF_INET, str, &result.prefix))) {
-                // It's a invalid CIDR object.
-                result.prefix = result.network_bits = 0;
-            } else {
-                result.network_bits = 32;
-            }
-            return result;
-        }
+    const char * const end = str + strlen(str);
+    uint32_t ip;
+    if (UNLIKELY(!parse_ipv4(p, end, ip))) {
+        return false;
     }
-
-    // Parse the network bits followed by '/'.
-    do {
-        char * end;
-        auto const bits = strtol(p + 1, &end, 10);
-        if (UNLIKELY(*end != '\0' || end == p + 1 || bits < 0 || bits > 32)) {
-            break;
+    unsigned bits = 32;
+    if (p != end) {
+        // Parse the network bits followed by '/'.
+        if (UNLIKELY(*p != '/')) {
+            return false;
         }
-
-        char buf[128];
-        auto const len = std::min<size_t>(sizeof(buf) - 1, p - str);
-        memcpy(buf, str, len);
-        buf[len] = '\0';
-        if (UNLIKELY(1 != inet_pton(AF_INET, buf, &result.prefix))) {
-            break;
+        ++p;
+        // By strtol() as ever, so the leading blanks, sign and zeros of the number are accepted.
+        char * num_end;
+        long const n = strtol(p, &num_end, 10);
+        if (UNLIKELY(num_end == p || num_end != end || n < 0 || n > 32)) {
+            return false;
         }
-        result.network_bits = bits;
-        return result;
-    } while (false);
+        bits = static_cast<unsigned>(n);
+    }
+    result.prefix = htonl(ip);
+    result.network_bits = bits;
+    return true;
+}
 
-    result.prefix = result.network_bits = 0;
-    return result;
+bool RouteTable::ParseCIDR(const char * cidr_str, CIDR & cidr) {
+    return parse_cidr_str(cidr_str, cidr);
 }
 
 bool RouteTable::Insert(const char cidr_str[]) {
-    const CIDR cidr = parse_cidr_str(cidr_str);
-    if (LIKELY(cidr.prefix != 0 || cidr.network_bits != 0)) {
+    CIDR cidr;
+    if (LIKELY(parse_cidr_str(cidr_str, cidr))) {
         return this->Insert(cidr.prefix, cidr.network_bits);
     } else {
         return false;
     }
 }
 
+// Convert a CIDR to the IP range, the network bits must be in [0,32].
+static RouteTable::IpRange cidr_to_range(uint32_t prefix_net_order, unsigned network_bits) {
+    uint32_t const prfix_host_order = ntohl(prefix_net_order);
+    uint32_t const mask = network_bits == 0 ? 0 : uint32_t(-1) << (32 - network_bits);
+    RouteTable::IpRange range;
+    range.first = prfix_host_order & mask;
+    range.last = range.first | (~mask);
+    return range;
+}
+
 bool RouteTable::Insert(uint32_t prefix_net_order, unsigned network_bits) {
     if (network_bits > 32) {
         return false;
     }
-    uint32_t const prfix_host_order = ntohl(prefix_net_order);
-    uint32_t const mask = uint32_t(-1) << (32 - network_bits);
-    IpRange range;
-    range.first = prfix_host_order & mask;
-    range.last = range.first | (~mask);
-    return Insert(range);
+    return Insert(cidr_to_range(prefix_net_order, network_bits));
 }
 
 bool RouteTable::Insert(const IpRange range) {
     if (!range) {
         return false;
     }
+    compiled.reset();
 
     // Find the insertion point in the ordered list to maintain the sorted order.
     // If the element at the found position is not equivalent to the range,
@@ -129,70 +157,765 @@ bool RouteTable::Insert(const IpRange range) {
     return true;
 }
 
-bool RouteTable::Find(uint32_t ip, bool host_order) const {
-    IpRange r;
-    r.first = host_order ? ip : ntohl(ip);
-    r.last = r.first;
+// Minimum ranges per thread for sorting in parallel, below it the threads cost more than they save.
+static size_t const PARALLEL_SORT_MIN_CHUNK = 64 * 1024;
 
-    auto const pos = std::lower_bound(containers.cbegin(), containers.cend(), r, pred_for_search);
-    return containers.cend() != pos && !pred_for_search(r, *pos);
+static bool less_by_first(const RouteTable::IpRange & lv, const RouteTable::IpRange & rv) {
+    return lv.first < rv.first;
 }
 
-//////////////////////////////////////////////////
+// Sort the ranges by the starting addresses. Large inputs are split into chunks sorted by the worker pool,
+// then merged pairwise, also by the pool.
+static void sort_ranges(std::vector<RouteTable::IpRange> & ranges, unsigned max_threads) {
+    size_t const n = ranges.size();
+    WorkerPool & pool = WorkerPool::Instance();
+    size_t chunks = max_threads != 0 ? max_threads : pool.GetConcurrency();
+    if (n / PARALLEL_SORT_MIN_CHUNK < chunks) {
+        chunks = n / PARALLEL_SORT_MIN_CHUNK;
+    }
+    if (chunks <= 1) {
+        std::sort(ranges.begin(), ranges.end(), less_by_first);
+        return;
+    }
+
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i = 0; i <= chunks; ++i) {
+        bounds[i] = n * i / chunks;
+    }
+    pool.Run(chunks, [&](size_t i) {
+        std::sort(ranges.begin() + bounds[i], ranges.begin() + bounds[i + 1], less_by_first);
+    });
+
+    std::vector<RouteTable::IpRange> buffer(n);
+    RouteTable::IpRange * src = ranges.data();
+    RouteTable::IpRange * dst = buffer.data();
+    for (size_t width = 1; width < chunks; width *= 2) {
+        pool.Run((chunks + 2 * width - 1) / (2 * width), [&](size_t i) {
+            size_t const lo = bounds[i * 2 * width];
+            size_t const mid = bounds[std::min(i * 2 * width + width, chunks)];
+            size_t const hi = bounds[std::min(i * 2 * width + 2 * width, chunks)];
+            std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo, less_by_first);
+        });
+        std::swap(src, dst);
+    }
+    if (src != ranges.data()) {
+        ranges.swap(buffer);
+    }
+}
+
+void RouteTable::MergeSorted(const std::vector<IpRange> & sorted) {
+    compiled.reset();
+    std::vector<IpRange> merged;
+    merged.reserve(containers.size() + sorted.size());
+    auto const append = [&merged](const IpRange & r) {
+        if (merged.empty() || pred_for_merge(merged.back(), r)) {
+            merged.push_back(r);
+        } else if (r.last > merged.back().last) {
+            merged.back().last = r.last;
+        }
+    };
+
+    auto a = containers.cbegin();
+    auto b = sorted.cbegin();
+    while (a != containers.cend() && b != sorted.cend()) {
+        append(b->first < a->first ? *b++ : *a++);
+    }
+    for (; a != containers.cend(); ++a) {
+        append(*a);
+    }
+    for (; b != sorted.cend(); ++b) {
+        append(*b);
+    }
+    containers.swap(merged);
+}
+
+size_t RouteTable::BulkInsert(const IpRange * ranges, size_t count, unsigned max_threads) {
+    std::vector<IpRange> sorted;
+    sorted.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (ranges[i]) {
+            sorted.push_back(ranges[i]);
+        }
+    }
+    sort_ranges(sorted, max_threads);
+    MergeSorted(sorted);
+    return sorted.size();
+}
 
-// Estimate the CIDR length based on the number of trailing zeros in the given IP (host bits order)
-static int estimate_cidr_len(uint32_t ip) {
-    uint32_t mask = 1;
-    for (int i = 32; i > 0; --i) {
-        if ((ip & mask) != 0) {
-            return i;
+size_t RouteTable::BulkInsert(const CIDR * cidrs, size_t count, unsigned max_threads) {
+    std::vector<IpRange> sorted;
+    sorted.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (cidrs[i].network_bits <= 32) {
+            sorted.push_back(cidr_to_range(cidrs[i].prefix, cidrs[i].network_bits));
         }
-        mask <<= 1;
     }
-    return 0;
+    sort_ranges(sorted, max_threads);
+    MergeSorted(sorted);
+    return sorted.size();
+}
+
+bool RouteTable::Erase(const char * cidr_str) {
+    CIDR cidr;
+    if (LIKELY(parse_cidr_str(cidr_str, cidr))) {
+        return Erase(cidr.prefix, cidr.network_bits);
+    } else {
+        return false;
+    }
 }
 
-// Calculate the maximum IP value (host bits order) that can be represented by a given CIDR
-static inline uint32_t get_cidr_max_ip(uint32_t ip_host_order, uint32_t prefix_len) {
-    if (prefix_len >= 32) {
-        return ip_host_order;
+bool RouteTable::Erase(uint32_t prefix_net_order, unsigned network_bits) {
+    if (network_bits > 32) {
+        return false;
     }
-    uint32_t const mask = static_cast<uint32_t>(-1) >> prefix_len;
-    return ip_host_order | mask;
+    return Erase(cidr_to_range(prefix_net_order, network_bits));
+}
+
+bool RouteTable::Erase(const IpRange range) {
+    if (!range) {
+        return false;
+    }
+    compiled.reset();
+
+    // The ranges overlapping the erased one, only the first and the last of them may keep a part.
+    auto const first = std::lower_bound(containers.begin(), containers.end(), range, pred_for_search);
+    auto last = first;
+    while (last != containers.end() && last->first <= range.last) {
+        ++last;
+    }
+    if (first == last) {
+        return true;
+    }
+    IpRange pieces[2];
+    size_t count = 0;
+    if (first->first < range.first) {
+        pieces[count++] = IpRange{ first->first, range.first - 1 };
+    }
+    if (last[-1].last > range.last) {
+        pieces[count++] = IpRange{ range.last + 1, last[-1].last };
+    }
+    if (count <= static_cast<size_t>(last - first)) {
+        std::copy(pieces, pieces + count, first);
+        containers.erase(first + count, last);
+    } else {
+        // A range split into two.
+        *first = pieces[0];
+        containers.insert(first + 1, pieces[1]);
+    }
+    return true;
+}
+
+static inline bool is_blank(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r';
 }
 
 /**
- * Convert IP range to CIDR segments
+ * @brief Parse a line of a rule list, @see RouteTable::LoadFromBuffer().
  *
- * @param from Host order starting IP, inclusive
- * @param to Host order ending IP, inclusive
- * @param result Processor to append resulting CIDRs
+ * @param p Beginning of the line.
+ * @param end End of the line, the line break excluded.
+ * @param range Receives the rule.
+ * @return Returning 1 for a rule, 0 for a blank or comment line, -1 for a malformed line.
  */
-static void convert_ip_range_to_cidr(uint32_t from, uint32_t to, std::function<void (CIDR)> result_processor) {
-    if (from > to) {
-        return;
+static int parse_rule_line(const char * p, const char * end, RouteTable::IpRange & range) {
+    const char * const comment = static_cast<const char *>(memchr(p, '#', end - p));
+    if (comment != nullptr) {
+        end = comment;
     }
-    if (from == to) {
-        result_processor({htonl(from), 32});
-        return;
+    while (p != end && is_blank(*p)) {
+        ++p;
+    }
+    while (p != end && is_blank(end[-1])) {
+        --end;
+    }
+    if (p == end) {
+        return 0;
+    }
+
+    uint32_t first;
+    if (!parse_ipv4(p, end, first)) {
+        return -1;
+    }
+    if (p == end) {
+        range.first = range.last = first;
+        return 1;
+    }
+    if (*p == '/') {
+        unsigned bits;
+        ++p;
+        if (!parse_prefix_len(p, end, 32, bits) || p != end) {
+            return -1;
+        }
+        range = cidr_to_range(htonl(first), bits);
+        return 1;
+    }
+
+    while (p != end && is_blank(*p)) {
+        ++p;
+    }
+    if (p == end || *p != '-') {
+        return -1;
+    }
+    ++p;
+    while (p != end && is_blank(*p)) {
+        ++p;
+    }
+    uint32_t last;
+    if (!parse_ipv4(p, end, last) || p != end || last < first) {
+        return -1;
+    }
+    range.first = first;
+    range.last = last;
+    return 1;
+}
+
+/**
+ * @brief Parse the complete lines of a text into the rules.
+ *
+ * @param line_number Number of the line before the text, updated to the last parsed one.
+ * @return Returning the length of the parsed lines, the rest is an incomplete line.
+ */
+static size_t parse_rule_lines(const char * data, size_t len, bool last_chunk, size_t & line_number,
+    std::vector<RouteTable::IpRange> & ranges, const RouteTable::LoadErrorCallback & on_error)
+{
+    const char * p = data;
+    const char * const end = data + len;
+    while (p != end) {
+        const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr) {
+            if (!last_chunk) {
+                break;
+            }
+            eol = end;
+        }
+        ++line_number;
+        RouteTable::IpRange range;
+        int const r = parse_rule_line(p, eol, range);
+        if (r > 0) {
+            ranges.push_back(range);
+        } else if (r < 0 && on_error) {
+            const char * line_end = eol;
+            if (line_end != p && line_end[-1] == '\r') {
+                --line_end;
+            }
+            on_error(line_number, std::string(p, line_end));
+        }
+        p = eol == end ? end : eol + 1;
     }
+    return p - data;
+}
+
+size_t RouteTable::LoadFromBuffer(const char * data, size_t len, const LoadErrorCallback & on_error) {
+    std::vector<IpRange> ranges;
+    size_t line_number = 0;
+    parse_rule_lines(data, len, true, line_number, ranges, on_error);
+    sort_ranges(ranges, 0);
+    MergeSorted(ranges);
+    return ranges.size();
+}
+
+// Size of the chunks read by LoadFromFile().
+static size_t const LOAD_CHUNK_SIZE = 1024 * 1024;
 
-    uint32_t len = estimate_cidr_len(from);
+bool RouteTable::LoadFromFile(const char * path, const LoadErrorCallback & on_error, size_t * loaded) {
+    FILE * const fp = fopen(path, "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+    std::vector<IpRange> ranges;
+    std::vector<char> buffer(LOAD_CHUNK_SIZE);
+    size_t pending = 0;     // Length of the incomplete line at the beginning of the buffer.
+    size_t line_number = 0;
+    bool ok = true;
     for (;;) {
-        uint32_t max_ip = get_cidr_max_ip(from, len);
-        if (max_ip <= to) {
-            result_processor({htonl(from), len});
-            if (max_ip < to) {
-                convert_ip_range_to_cidr(max_ip + 1, to, result_processor);
+        if (buffer.size() - pending < LOAD_CHUNK_SIZE / 2) {
+            buffer.resize(buffer.size() * 2);   // A very long line
+        }
+        size_t const n = fread(buffer.data() + pending, 1, buffer.size() - pending, fp);
+        if (n == 0 && ferror(fp)) {
+            ok = false;
+            break;
+        }
+        bool const eof = n == 0;
+        size_t const len = pending + n;
+        size_t const parsed = parse_rule_lines(buffer.data(), len, eof, line_number, ranges, on_error);
+        pending = len - parsed;
+        memmove(buffer.data(), buffer.data() + parsed, pending);
+        if (eof) {
+            break;
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        return false;
+    }
+
+    sort_ranges(ranges, 0);
+    MergeSorted(ranges);
+    if (loaded != nullptr) {
+        *loaded = ranges.size();
+    }
+    return true;
+}
+
+namespace {
+
+// A sorted and merged list of ranges being swept, the current range is the first one not ending before the
+// position of the sweep. The current range is copied, so the output of the sweep may take its storage.
+class RangeCursor {
+public:
+    RangeCursor(const RouteTable::IpRange * begin, const RouteTable::IpRange * end)
+        : next(begin), end(end), current(), valid(begin != end)
+    {
+        if (valid) {
+            current = *next++;
+        }
+    }
+
+    bool Contains(uint64_t pos) const {
+        return valid && current.first <= pos;
+    }
+
+    // The next position where Contains() may change.
+    uint64_t NextBoundary(uint64_t pos) const {
+        if (!valid) {
+            return SWEEP_END;
+        }
+        return Contains(pos) ? uint64_t(current.last) + 1 : current.first;
+    }
+
+    void Advance(uint64_t pos) {
+        if (!valid || pos > current.last) {
+            valid = next != end;
+            if (valid) {
+                current = *next++;
             }
-            return;
         }
-        ++len;
+    }
+
+    static uint64_t const SWEEP_END = uint64_t(1) << 32;
+
+private:
+    const RouteTable::IpRange * next;
+    const RouteTable::IpRange * end;
+    RouteTable::IpRange current;
+    bool valid;
+};
+
+} // End of namespace
+
+/**
+ * @brief Sweep the boundaries of several sorted and merged lists of ranges, output the ranges where
+ * op(in list 0, in list 1 ...) is true, merged as well.
+ *
+ * The output may take the storage of list 0, if it starts at least as many ranges before the list as the
+ * other lists have plus one: the output starting at the first address of a range of list 0, or at a boundary
+ * of the other lists, never outruns the input.
+ * @param out Start of the output, the range before 'w' is merged with the next one if they are adjacent.
+ * @param w Where to write the next range.
+ * @return Returning the end of the output.
+ */
+template <size_t N, typename Op>
+static RouteTable::IpRange * sweep_ranges(RangeCursor (&lists)[N], Op op, RouteTable::IpRange * out,
+    RouteTable::IpRange * w)
+{
+    for (uint64_t pos = 0; pos < RangeCursor::SWEEP_END;) {
+        bool in[N];
+        uint64_t next = RangeCursor::SWEEP_END;
+        for (size_t i = 0; i < N; ++i) {
+            in[i] = lists[i].Contains(pos);
+            next = std::min(next, lists[i].NextBoundary(pos));
+        }
+        if (op(in)) {
+            if (w != out && uint64_t(w[-1].last) + 1 == pos) {
+                w[-1].last = static_cast<uint32_t>(next - 1);
+            } else {
+                w->first = static_cast<uint32_t>(pos);
+                w->last = static_cast<uint32_t>(next - 1);
+                ++w;
+            }
+        }
+        pos = next;
+        for (size_t i = 0; i < N; ++i) {
+            lists[i].Advance(pos);
+        }
+    }
+    return w;
+}
+
+// Output the ranges where op(in a, in b) is true, @see sweep_ranges().
+template <typename Op>
+static size_t combine_ranges(const RouteTable::IpRange * a, const RouteTable::IpRange * a_end,
+    const RouteTable::IpRange * b, const RouteTable::IpRange * b_end, Op op, RouteTable::IpRange * out)
+{
+    RangeCursor lists[2] = { RangeCursor(a, a_end), RangeCursor(b, b_end) };
+    RouteTable::IpRange * const w = sweep_ranges(lists, [&op](const bool (&in)[2]) {
+        return op(in[0], in[1]);
+    }, out, out);
+    return static_cast<size_t>(w - out);
+}
+
+template <typename Op>
+RouteTable RouteTable::Combine(const RouteTable & a, const RouteTable & b, Op op) {
+    RouteTable result;
+    result.containers.resize(a.containers.size() + b.containers.size() + 1);
+    size_t const count = combine_ranges(a.containers.data(), a.containers.data() + a.containers.size(),
+        b.containers.data(), b.containers.data() + b.containers.size(), op, result.containers.data());
+    result.containers.resize(count);
+    return result;
+}
+
+template <typename Op>
+void RouteTable::CombineInPlace(const RouteTable & other, Op op) {
+    if (&other == this) {
+        RouteTable const copy = other;
+        CombineInPlace(copy, op);
+        return;
+    }
+    compiled.reset();
+    size_t const n = containers.size();
+    size_t const offset = other.containers.size() + 1;
+    // Move the ranges of self to the back, the output starts from the front.
+    containers.resize(n + offset);
+    std::copy_backward(containers.begin(), containers.begin() + n, containers.end());
+    const IpRange * const a = containers.data() + offset;
+    size_t const count = combine_ranges(a, a + n, other.containers.data(),
+        other.containers.data() + other.containers.size(), op, containers.data());
+    containers.resize(count);
+}
+
+void RouteTable::UnionWith(const RouteTable & other) {
+    CombineInPlace(other, [](bool in_a, bool in_b) { return in_a || in_b; });
+}
+
+void RouteTable::IntersectWith(const RouteTable & other) {
+    CombineInPlace(other, [](bool in_a, bool in_b) { return in_a && in_b; });
+}
+
+void RouteTable::Subtract(const RouteTable & other) {
+    CombineInPlace(other, [](bool in_a, bool in_b) { return in_a && !in_b; });
+}
+
+void RouteTable::Invert() {
+    CombineInPlace(RouteTable(), [](bool in_a, bool) { return !in_a; });
+}
+
+RouteTable RouteTable::Union(const RouteTable & a, const RouteTable & b) {
+    return Combine(a, b, [](bool in_a, bool in_b) { return in_a || in_b; });
+}
+
+RouteTable RouteTable::Intersection(const RouteTable & a, const RouteTable & b) {
+    return Combine(a, b, [](bool in_a, bool in_b) { return in_a && in_b; });
+}
+
+RouteTable RouteTable::Difference(const RouteTable & a, const RouteTable & b) {
+    return Combine(a, b, [](bool in_a, bool in_b) { return in_a && !in_b; });
+}
+
+RouteTable RouteTable::Complement(const RouteTable & a) {
+    return Combine(a, RouteTable(), [](bool in_a, bool) { return !in_a; });
+}
+
+void RouteTable::ApplyDelta(const IpRange * adds, size_t add_count, const IpRange * removes, size_t remove_count) {
+    RouteTable add_set;
+    add_set.BulkInsert(adds, add_count, 1);
+    RouteTable remove_set;
+    remove_set.BulkInsert(removes, remove_count, 1);
+    RouteTable const touched = Union(add_set, remove_set);
+
+    // Each removed range splits a range at most, each added range adds one at most.
+    std::vector<IpRange> result(containers.size() + add_set.GetCount() + remove_set.GetCount());
+    IpRange * w = result.data();
+    const IpRange * c = containers.data();
+    const IpRange * const c_end = c + containers.size();
+    const IpRange * a = add_set.containers.data();
+    const IpRange * const a_end = a + add_set.containers.size();
+    const IpRange * r = remove_set.containers.data();
+    const IpRange * const r_end = r + remove_set.containers.size();
+    const IpRange * t = touched.containers.data();
+    const IpRange * const t_end = t + touched.containers.size();
+    while (t != t_end) {
+        // The ranges before the window are kept as they are.
+        const IpRange * const window = std::lower_bound(c, c_end, *t, pred_for_merge);
+        w = std::copy(c, window, w);
+
+        // The window spans the touched ranges and the existing ones overlapping or adjacent to them.
+        IpRange hull = *t++;
+        c = window;
+        for (;;) {
+            if (c != c_end && !pred_for_merge(hull, *c)) {
+                hull.last = std::max(hull.last, c->last);
+                ++c;
+            } else if (t != t_end && !pred_for_merge(hull, *t)) {
+                hull.last = std::max(hull.last, t->last);
+                ++t;
+            } else {
+                break;
+            }
+        }
+        const IpRange * const a_next = std::find_if(a, a_end, [&hull](const IpRange & x) {
+            return x.first > hull.last;
+        });
+        const IpRange * const r_next = std::find_if(r, r_end, [&hull](const IpRange & x) {
+            return x.first > hull.last;
+        });
+        RangeCursor lists[3] = { RangeCursor(window, c), RangeCursor(a, a_next), RangeCursor(r, r_next) };
+        w = sweep_ranges(lists, [](const bool (&in)[3]) {
+            return in[1] || (in[0] && !in[2]);
+        }, result.data(), w);
+        a = a_next;
+        r = r_next;
+    }
+    w = std::copy(c, c_end, w);
+    result.resize(static_cast<size_t>(w - result.data()));
+    containers.swap(result);
+
+    if (compiled) {
+        // Copy the index if it's shared by another table.
+        std::shared_ptr<Dir24_8> index = compiled.use_count() == 1
+            ? std::const_pointer_cast<Dir24_8>(compiled) : std::make_shared<Dir24_8>(*compiled);
+        for (const IpRange & changed : touched.containers) {
+            index->Patch(containers, changed.first >> 8, changed.last >> 8);
+        }
+        compiled = index;
+    }
+}
+
+bool RouteTable::Find(uint32_t ip, bool host_order) const {
+    IpRange r;
+    r.first = host_order ? ip : ntohl(ip);
+    if (compiled) {
+        return compiled->Find(r.first);
+    }
+    r.last = r.first;
+
+    auto const pos = std::lower_bound(containers.cbegin(), containers.cend(), r, pred_for_search);
+    return containers.cend() != pos && !pred_for_search(r, *pos);
+}
+
+// Number of the lookups interleaved by FindBatch().
+static size_t const FIND_BATCH_WIDTH = 16;
+
+static void bswap32_scalar(const uint32_t * in, uint32_t * out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = ntohl(in[i]);
     }
 }
 
+#if YHB_X86
+
+YHB_TARGET("avx2")
+static void bswap32_avx2(const uint32_t * in, uint32_t * out, size_t n) {
+    __m256i const shuffle = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i const v = _mm256_loadu_si256((const __m256i *)(in + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(v, shuffle));
+    }
+    bswap32_scalar(in + i, out + i, n - i);
+}
+
+#endif
+
+typedef void (*bswap32_func)(const uint32_t * in, uint32_t * out, size_t n);
+
+static bswap32_func select_bswap32() {
+#if YHB_X86
+    if (get_cpu_features().avx2) {
+        return bswap32_avx2;
+    }
+#endif
+    return bswap32_scalar;
+}
+
+static bswap32_func const bswap32 = select_bswap32();
+
+void RouteTable::FindBatch(const uint32_t * ips, size_t n, bool host_order, uint8_t * out) const {
+    uint32_t keys[FIND_BATCH_WIDTH];
+    const IpRange * bases[FIND_BATCH_WIDTH];
+    uint32_t entries[FIND_BATCH_WIDTH];
+    for (size_t done = 0; done < n; done += FIND_BATCH_WIDTH) {
+        size_t const width = std::min(FIND_BATCH_WIDTH, n - done);
+        if (host_order) {
+            memcpy(keys, ips + done, width * sizeof(keys[0]));
+        } else {
+            bswap32(ips + done, keys, width);
+        }
+        uint8_t * const results = out + done;
+
+        if (compiled) {
+            // Stage 1: load the /24 entries. Stage 2: load the groups of the partially matched blocks.
+            const Dir24_8 & index = *compiled;
+            for (size_t i = 0; i < width; ++i) {
+                prefetch_for_read(&index.tbl24[keys[i] >> 8]);
+            }
+            for (size_t i = 0; i < width; ++i) {
+                entries[i] = index.tbl24[keys[i] >> 8];
+                if (entries[i] >= dir24_8::FIRST_GROUP) {
+                    prefetch_for_read(&index.groups[entries[i] - dir24_8::FIRST_GROUP]);
+                }
+            }
+            for (size_t i = 0; i < width; ++i) {
+                if (LIKELY(entries[i] < dir24_8::FIRST_GROUP)) {
+                    results[i] = entries[i] == dir24_8::HIT;
+                } else {
+                    results[i] = dir24_8::test_group(index.groups[entries[i] - dir24_8::FIRST_GROUP], keys[i]);
+                }
+            }
+            continue;
+        }
+
+        if (containers.empty()) {
+            memset(results, 0, width);
+            continue;
+        }
+
+        // Branchless lower bounds in lockstep, all of them take the same steps. After each step,
+        // prefetch the next probe of every lookup, then the loads of the next step overlap.
+        for (size_t i = 0; i < width; ++i) {
+            bases[i] = containers.data();
+        }
+        size_t len = containers.size();
+        while (len > 1) {
+            size_t const half = len / 2;
+            len -= half;
+            for (size_t i = 0; i < width; ++i) {
+                const IpRange * const base = bases[i];
+                bases[i] = base[half].last < keys[i] ? base + half : base;
+                prefetch_for_read(bases[i] + len / 2);
+            }
+        }
+        const IpRange * const last = containers.data() + containers.size() - 1;
+        for (size_t i = 0; i < width; ++i) {
+            const IpRange * pos = bases[i];
+            if (pos->last < keys[i]) {
+                if (pos == last) {
+                    results[i] = 0;
+                    continue;
+                }
+                ++pos;
+            }
+            results[i] = pos->first <= keys[i];
+        }
+    }
+}
+
+RouteTable::CompileStats RouteTable::Compile() {
+    auto const start = std::chrono::steady_clock::now();
+    std::shared_ptr<Dir24_8> index = std::make_shared<Dir24_8>();
+    index->Build(containers);
+    index->groups.shrink_to_fit();
+    compiled = index;
+
+    CompileStats stats;
+    stats.memory_bytes = index->tbl24.size() * sizeof(index->tbl24[0])
+        + index->groups.size() * sizeof(Dir24_8::Group);
+    stats.group_count = index->groups.size();
+    stats.build_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+namespace {
+
+// Writes a file and calculates the CRC of all the bytes written.
+class ChecksummedWriter {
+public:
+    explicit ChecksummedWriter(FILE * fp) : fp(fp), crc(0), ok(true) {}
+
+    void Write(const void * data, size_t len) {
+        if (ok && len != 0) {
+            ok = fwrite(data, 1, len, fp) == len;
+            crc = CRC32C::Calculate(data, len, crc);
+        }
+    }
+
+    void WriteZeros(size_t len) {
+        static const char zeros[256] = {};
+        while (len != 0) {
+            size_t const n = std::min(len, sizeof(zeros));
+            Write(zeros, n);
+            len -= n;
+        }
+    }
+
+    uint32_t GetCRC() const {
+        return crc;
+    }
+
+    bool IsOk() const {
+        return ok;
+    }
+
+private:
+    FILE * const fp;
+    uint32_t crc;
+    bool ok;
+};
+
+} // End of namespace
+
+bool RouteTable::WriteSnapshot(FILE * fp) const {
+    snapshot::Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, snapshot::MAGIC, sizeof(h.magic));
+    h.version = snapshot::VERSION;
+    h.byte_order = snapshot::BYTE_ORDER_MARK;
+    h.range_count = containers.size();
+    h.ranges_offset = sizeof(h);
+    uint64_t const ranges_end = h.ranges_offset + containers.size() * sizeof(IpRange);
+    h.file_size = ranges_end;
+    if (compiled) {
+        h.index_offset = (ranges_end + snapshot::INDEX_ALIGNMENT - 1) / snapshot::INDEX_ALIGNMENT
+            * snapshot::INDEX_ALIGNMENT;
+        h.group_count = compiled->groups.size();
+        h.file_size = h.index_offset + compiled->tbl24.size() * sizeof(uint32_t)
+            + compiled->groups.size() * sizeof(Dir24_8::Group);
+    }
+
+    // The header is written again at last, with the CRCs.
+    bool const ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    ChecksummedWriter writer(fp);
+    writer.Write(containers.data(), containers.size() * sizeof(IpRange));
+    if (compiled) {
+        writer.WriteZeros(static_cast<size_t>(h.index_offset - ranges_end));
+        writer.Write(compiled->tbl24.data(), compiled->tbl24.size() * sizeof(uint32_t));
+        writer.Write(compiled->groups.data(), compiled->groups.size() * sizeof(Dir24_8::Group));
+    }
+    h.payload_crc = writer.GetCRC();
+    h.header_crc = snapshot::header_crc(h);
+    return ok && writer.IsOk() && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, fp) == 1
+        && fflush(fp) == 0;
+}
+
+bool RouteTable::SaveSnapshot(const char * path) const {
+    std::string const tmp_path = std::string(path) + ".tmp";
+    FILE * const fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+    bool ok = WriteSnapshot(fp);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    remove(path);   // rename() does not replace an existing file on Windows.
+#endif
+    if (rename(tmp_path.c_str(), path) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////
+
 void RouteTable::IpRange::ToCIDR(std::function<void (CIDR)> each_cidr_callback) const {
-    convert_ip_range_to_cidr(this->first, this->last, each_cidr_callback);
+    ForEachCIDR(std::move(each_cidr_callback));
 }
 
 } // End of namespace 'yhb'
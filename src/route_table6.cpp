@@ -0,0 +1,479 @@
+#include "route_table6.h"
+#include "yhb_common.h"
+#include "cpu_features.h"
+#include "ip_text.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+
+namespace yhb {
+
+using Address = RouteTable6::Address;
+using CIDR = RouteTable6::CIDR;
+using IpRange = RouteTable6::IpRange;
+
+static uint64_t const ALL_ONES = ~uint64_t(0);
+
+Address Address::FromBytes(const uint8_t bytes[16]) {
+    Address a = { 0, 0 };
+    for (int i = 0; i < 8; ++i) {
+        a.hi = (a.hi << 8) | bytes[i];
+        a.lo = (a.lo << 8) | bytes[8 + i];
+    }
+    return a;
+}
+
+void Address::ToBytes(uint8_t bytes[16]) const {
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<uint8_t>(hi >> (56 - 8 * i));
+        bytes[8 + i] = static_cast<uint8_t>(lo >> (56 - 8 * i));
+    }
+}
+
+bool operator == (const CIDR & lv, const CIDR & rv) {
+    return memcmp(lv.prefix, rv.prefix, sizeof(lv.prefix)) == 0 && lv.network_bits == rv.network_bits;
+}
+
+static inline Address add_one(Address a) {
+    if (++a.lo == 0) {
+        ++a.hi;
+    }
+    return a;
+}
+
+static inline bool is_all_ones(const Address & a) {
+    return a.hi == ALL_ONES && a.lo == ALL_ONES;
+}
+
+// The host bits of a prefix length in [0,128], the lower (128 - prefix_len) bits set.
+static inline Address host_mask(unsigned prefix_len) {
+    unsigned const bits = 128 - prefix_len;
+    Address mask;
+    if (bits >= 64) {
+        mask.lo = ALL_ONES;
+        mask.hi = bits == 128 ? ALL_ONES : (uint64_t(1) << (bits - 64)) - 1;
+    } else {
+        mask.lo = bits == 0 ? 0 : (uint64_t(1) << bits) - 1;
+        mask.hi = 0;
+    }
+    return mask;
+}
+
+RouteTable6::RouteTable6() {
+    containers.reserve(64);
+}
+
+static inline int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    } else if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parse an IPv6 address of RFC 4291, as strict as inet_pton().
+ *
+ * Up to 8 groups of 1 to 4 hex digits, a "::" for the zero groups, and the last 32 bits may be an IPv4 address.
+ * @param p The text, moved to the end of the address on success.
+ * @param end End of the text.
+ * @param ip Receives the address.
+ * @return Returning false if there's no valid address at the beginning of the text.
+ */
+static bool parse_ipv6(const char * & p, const char * end, Address & ip) {
+    uint16_t groups[8];
+    int count = 0;
+    int gap = -1;       // Index of the group after the "::", if any.
+    const char * s = p;
+    if (end - s >= 2 && s[0] == ':' && s[1] == ':') {
+        gap = 0;
+        s += 2;
+    }
+    while (s != end && hex_value(*s) >= 0) {
+        const char * t = s;
+        while (t != end && hex_value(*t) >= 0) {
+            ++t;
+        }
+        if (t != end && *t == '.') {
+            // The embedded IPv4 address ends the address.
+            uint32_t v4;
+            if (count > 6 || !parse_ipv4(s, end, v4)) {
+                return false;
+            }
+            groups[count++] = static_cast<uint16_t>(v4 >> 16);
+            groups[count++] = static_cast<uint16_t>(v4);
+            break;
+        }
+        if (t - s > 4 || count == 8) {
+            return false;
+        }
+        unsigned group = 0;
+        for (; s != t; ++s) {
+            group = (group << 4) | static_cast<unsigned>(hex_value(*s));
+        }
+        groups[count++] = static_cast<uint16_t>(group);
+
+        if (s == end || *s != ':') {
+            break;
+        }
+        if (end - s >= 2 && s[1] == ':') {
+            if (gap >= 0) {
+                return false;
+            }
+            gap = count;
+            s += 2;
+        } else {
+            ++s;
+            if (s == end || hex_value(*s) < 0) {
+                return false;
+            }
+        }
+    }
+    if (gap < 0 ? count != 8 : count > 7) {
+        return false;
+    }
+
+    uint16_t full[8] = {};
+    int const tail = gap < 0 ? 0 : count - gap;
+    std::copy(groups, groups + count - tail, full);
+    std::copy(groups + count - tail, groups + count, full + 8 - tail);
+    ip.hi = 0;
+    ip.lo = 0;
+    for (int i = 0; i < 4; ++i) {
+        ip.hi = (ip.hi << 16) | full[i];
+        ip.lo = (ip.lo << 16) | full[4 + i];
+    }
+    p = s;
+    return true;
+}
+
+/**
+ * @brief Parse a given CIDR string.
+ *
+ * @param str The CIDR string, should be "addr/n", or a single IP address.
+ * @param result Receives the CIDR.
+ * @return Returning false if the str parameter is not valid.
+ */
+static bool parse_cidr_str(const char * str, CIDR & result) {
+    const char * p = str;
+    const char * const end = str + strlen(str);
+    Address ip;
+    if (UNLIKELY(!parse_ipv6(p, end, ip))) {
+        return false;
+    }
+    unsigned bits = 128;
+    if (p != end) {
+        // Parse the network bits followed by '/'.
+        if (UNLIKELY(*p != '/')) {
+            return false;
+        }
+        ++p;
+        if (UNLIKELY(!parse_prefix_len(p, end, 128, bits) || p != end)) {
+            return false;
+        }
+    }
+    ip.ToBytes(result.prefix);
+    result.network_bits = bits;
+    return true;
+}
+
+bool RouteTable6::Insert(const char * cidr_str) {
+    CIDR cidr;
+    if (LIKELY(parse_cidr_str(cidr_str, cidr))) {
+        return Insert(cidr.prefix, cidr.network_bits);
+    } else {
+        return false;
+    }
+}
+
+bool RouteTable6::Insert(const uint8_t prefix[16], unsigned network_bits) {
+    if (network_bits > 128) {
+        return false;
+    }
+    Address const a = Address::FromBytes(prefix);
+    Address const mask = host_mask(network_bits);
+    IpRange range;
+    range.first.hi = a.hi & ~mask.hi;
+    range.first.lo = a.lo & ~mask.lo;
+    range.last.hi = range.first.hi | mask.hi;
+    range.last.lo = range.first.lo | mask.lo;
+    return Insert(range);
+}
+
+bool RouteTable6::pred_for_merge(const IpRange & lv, const IpRange & rv) {
+    if (UNLIKELY(is_all_ones(lv.last))) {
+        return false;
+    } else {
+        return add_one(lv.last) < rv.first;
+    }
+}
+
+bool RouteTable6::Insert(const IpRange & range) {
+    if (!range) {
+        return false;
+    }
+    compiled.reset();
+
+    // The same as RouteTable::Insert(IpRange), the range is merged with the overlapping or adjacent ones.
+    auto const pos = std::lower_bound(containers.begin(), containers.end(), range, pred_for_merge);
+    if (containers.end() == pos || pred_for_merge(range, *pos)) {
+        containers.insert(pos, range);
+        return true;
+    }
+
+    if (range.first < pos->first) {
+        pos->first = range.first;
+    }
+    if (range.last > pos->last) {
+        pos->last = range.last;
+    }
+
+    auto it = pos + 1;
+    while (it != containers.end()) {
+        if (pred_for_merge(*pos, *it)) {
+            break;
+        }
+        if (it->last > pos->last) {
+            pos->last = it->last;
+        }
+        ++it;
+    }
+    containers.erase(pos + 1, it);
+
+    return true;
+}
+
+bool RouteTable6::Search(const Address & ip) const {
+    IpRange r;
+    r.first = ip;
+    r.last = ip;
+    auto const pos = std::lower_bound(containers.cbegin(), containers.cend(), r, pred_for_search);
+    return containers.cend() != pos && !pred_for_search(r, *pos);
+}
+
+/**
+ * @brief A multibit trie over the upper 64 bits, @see RouteTable6::Compile().
+ *
+ * The top 16 bits index 'top', then a node splits its block into 256 slots by the next 8 bits. A slot with
+ * its bit set in 'children' has a child node, packed after the ones of the slots before it. The other slots
+ * end with a leaf, the runs of the slots of the same leaf share one, like a poptrie, a bit in 'leaf_starts'
+ * marks where a run starts.
+ *
+ * A leaf is MISS or HIT if the block is matched wholly or not at all, otherwise it's FIRST_RANGE plus the
+ * index of the first range intersecting the block. Only the blocks intersecting two ranges or more are split,
+ * down to /64, so a lookup checks at most one range but for the /64 blocks shared by several ranges.
+ */
+struct RouteTable6::Trie {
+    enum : uint32_t {
+        MISS = 0,
+        HIT = 1,
+        FIRST_RANGE = 2,
+        NODE_FLAG = 0x80000000,     // In 'top', the entry is the index of a node instead of a leaf.
+    };
+
+    static unsigned const TOP_BITS = 16;
+    static unsigned const STRIDE = 8;
+
+    struct Node {
+        uint64_t children[4];
+        uint64_t leaf_starts[4];
+        uint32_t child_base;        // Index of the first child.
+        uint32_t leaf_base;         // Index of the first leaf.
+    };
+
+    std::vector<uint32_t> top;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> leaves;
+
+    // Number of the bits set before the given one.
+    static unsigned rank(const uint64_t bits[4], unsigned slot) {
+        unsigned const word = slot >> 6;
+        unsigned n = count_ones(bits[word] & ((uint64_t(1) << (slot & 63)) - 1));
+        for (unsigned i = 0; i < word; ++i) {
+            n += count_ones(bits[i]);
+        }
+        return n;
+    }
+
+    uint32_t FindLeaf(uint64_t hi) const {
+        uint32_t const entry = top[hi >> (64 - TOP_BITS)];
+        if (LIKELY(!(entry & NODE_FLAG))) {
+            return entry;
+        }
+        const Node * node = &nodes[entry & ~NODE_FLAG];
+        for (unsigned shift = 64 - TOP_BITS - STRIDE;; shift -= STRIDE) {
+            unsigned const slot = static_cast<unsigned>(hi >> shift) & 0xff;
+            uint64_t const bit = uint64_t(1) << (slot & 63);
+            if (!(node->children[slot >> 6] & bit)) {
+                // The last run starting at or before the slot.
+                unsigned const starts = rank(node->leaf_starts, slot) + ((node->leaf_starts[slot >> 6] & bit) != 0);
+                return leaves[node->leaf_base + starts - 1];
+            }
+            node = &nodes[node->child_base + rank(node->children, slot)];
+        }
+    }
+
+    // The leaf of the block [lo, hi] of the upper 64 bits, all the lower 64 bits included, or NODE_FLAG if
+    // it has to be split. 'it' is moved to the first range not ending before the block.
+    static uint32_t Classify(const IpRange * & it, const IpRange * begin, const IpRange * end,
+        uint64_t lo, uint64_t hi, bool last_level)
+    {
+        while (it != end && it->last.hi < lo) {
+            ++it;
+        }
+        if (it == end || it->first.hi > hi) {
+            return MISS;
+        }
+        bool const from_start = it->first.hi < lo || (it->first.hi == lo && it->first.lo == 0);
+        bool const to_end = it->last.hi > hi || (it->last.hi == hi && it->last.lo == ALL_ONES);
+        if (from_start && to_end) {
+            return HIT;
+        }
+        if (last_level || it + 1 == end || it[1].first.hi > hi) {
+            return FIRST_RANGE + static_cast<uint32_t>(it - begin);
+        }
+        return NODE_FLAG;
+    }
+
+    // Build the node at 'index' for the block starting at 'base', of which the upper 'depth' bits are fixed.
+    void BuildNode(size_t index, const IpRange * it, const IpRange * begin, const IpRange * end,
+        uint64_t base, unsigned depth)
+    {
+        unsigned const shift = 64 - depth - STRIDE;
+        uint64_t const slot_mask = shift == 0 ? 0 : ALL_ONES >> (64 - shift);
+        Node node = {};
+        node.leaf_base = static_cast<uint32_t>(leaves.size());
+        std::vector<std::pair<uint64_t, const IpRange *>> splits;
+        for (unsigned slot = 0; slot < 256; ++slot) {
+            uint64_t const lo = base | (uint64_t(slot) << shift);
+            const IpRange * const first = it;
+            uint32_t const leaf = Classify(it, begin, end, lo, lo | slot_mask, shift == 0);
+            uint64_t const bit = uint64_t(1) << (slot & 63);
+            if (leaf == NODE_FLAG) {
+                node.children[slot >> 6] |= bit;
+                splits.emplace_back(lo, first);
+            } else if (leaves.size() == node.leaf_base || leaves.back() != leaf) {
+                node.leaf_starts[slot >> 6] |= bit;
+                leaves.push_back(leaf);
+            }
+        }
+        node.child_base = static_cast<uint32_t>(nodes.size());
+        nodes[index] = node;
+        nodes.resize(node.child_base + splits.size());
+        for (size_t k = 0; k < splits.size(); ++k) {
+            BuildNode(node.child_base + k, splits[k].second, begin, end, splits[k].first, depth + STRIDE);
+        }
+    }
+
+    void Build(const std::vector<IpRange> & ranges) {
+        top.assign(size_t(1) << TOP_BITS, MISS);
+        const IpRange * const begin = ranges.data();
+        const IpRange * const end = ranges.data() + ranges.size();
+        const IpRange * it = begin;
+        unsigned const shift = 64 - TOP_BITS;
+        std::vector<std::pair<uint32_t, const IpRange *>> splits;
+        for (uint32_t slot = 0; slot < top.size(); ++slot) {
+            uint64_t const lo = uint64_t(slot) << shift;
+            const IpRange * const first = it;
+            uint32_t const leaf = Classify(it, begin, end, lo, lo | (ALL_ONES >> TOP_BITS), false);
+            if (leaf == NODE_FLAG) {
+                top[slot] = NODE_FLAG | static_cast<uint32_t>(splits.size());
+                splits.emplace_back(slot, first);
+            } else {
+                top[slot] = leaf;
+            }
+        }
+        nodes.resize(splits.size());
+        for (size_t k = 0; k < splits.size(); ++k) {
+            BuildNode(k, splits[k].second, begin, end, uint64_t(splits[k].first) << shift, TOP_BITS);
+        }
+    }
+};
+
+RouteTable6::CompileStats RouteTable6::Compile() {
+    auto const start = std::chrono::steady_clock::now();
+    std::shared_ptr<Trie> trie = std::make_shared<Trie>();
+    trie->Build(containers);
+    trie->nodes.shrink_to_fit();
+    trie->leaves.shrink_to_fit();
+    compiled = trie;
+
+    CompileStats stats;
+    stats.memory_bytes = trie->top.size() * sizeof(uint32_t) + trie->nodes.size() * sizeof(Trie::Node)
+        + trie->leaves.size() * sizeof(uint32_t);
+    stats.node_count = trie->nodes.size();
+    stats.build_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return stats;
+}
+
+bool RouteTable6::Find(const Address & ip) const {
+    if (!compiled) {
+        return Search(ip);
+    }
+    uint32_t const leaf = compiled->FindLeaf(ip.hi);
+    if (LIKELY(leaf < Trie::FIRST_RANGE)) {
+        return leaf == Trie::HIT;
+    }
+    // Check the first range intersecting the block, the others of a /64 block by a galloping search.
+    const IpRange * const first = containers.data() + (leaf - Trie::FIRST_RANGE);
+    if (LIKELY(ip <= first->last)) {
+        return first->first <= ip;
+    }
+    const IpRange * const end = containers.data() + containers.size();
+    size_t step = 1;
+    while (first + step < end && first[step].last < ip) {
+        step *= 2;
+    }
+    IpRange r;
+    r.first = ip;
+    r.last = ip;
+    auto const pos = std::lower_bound(first + step / 2 + 1, first + std::min<size_t>(step + 1, end - first), r,
+        pred_for_search);
+    return pos != end && !pred_for_search(r, *pos);
+}
+
+//////////////////////////////////////////////////
+
+// The shortest prefix length of a CIDR starting at the given IP, by the number of the trailing zeros.
+static unsigned estimate_cidr_len(const Address & ip) {
+    if (ip.lo != 0) {
+        return 128 - count_trailing_zeros64(ip.lo);
+    } else if (ip.hi != 0) {
+        return 64 - count_trailing_zeros64(ip.hi);
+    }
+    return 0;
+}
+
+void RouteTable6::IpRange::ToCIDR(std::function<void (const CIDR &)> each_cidr_callback) const {
+    if (!*this) {
+        return;
+    }
+    Address from = first;
+    for (;;) {
+        Address max_ip;
+        unsigned len = estimate_cidr_len(from);
+        for (;; ++len) {
+            Address const mask = host_mask(len);
+            max_ip.hi = from.hi | mask.hi;
+            max_ip.lo = from.lo | mask.lo;
+            if (max_ip <= last) {
+                break;
+            }
+        }
+        CIDR cidr;
+        from.ToBytes(cidr.prefix);
+        cidr.network_bits = len;
+        each_cidr_callback(cidr);
+        if (max_ip == last) {
+            return;
+        }
+        from = add_one(max_ip);
+    }
+}
+
+} // End of namespace 'yhb'
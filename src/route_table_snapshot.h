@@ -0,0 +1,126 @@
+#ifndef YHB_ROUTE_TABLE_SNAPSHOT_H
+#define YHB_ROUTE_TABLE_SNAPSHOT_H
+
+// Internal binary format of the RouteTable snapshots. Not part of the public interface.
+//
+// Layout, all the fields by the byte order of the writer, which is checked by the readers:
+//   Header                 64 bytes
+//   IpRange[range_count]   Sorted and merged, 8 bytes each, at 'ranges_offset'
+//   (optional index, at 'index_offset' aligned to a page)
+//   uint32_t tbl24[2^24]   @see dir24_8.h
+//   Group groups[group_count]
+
+#include "route_table.h"
+#include "crc32c.h"
+#include "dir24_8.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace yhb {
+namespace snapshot {
+
+char const MAGIC[8] = { 'Y', 'H', 'B', 'R', 'T', 'A', 'B', '\0' };
+uint32_t const VERSION = 1;
+uint32_t const BYTE_ORDER_MARK = 0x01020304;
+uint64_t const INDEX_ALIGNMENT = 4096;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;        // BYTE_ORDER_MARK by the byte order of the writer.
+    uint64_t file_size;
+    uint64_t range_count;
+    uint64_t ranges_offset;
+    uint64_t index_offset;      // Zero if there's no index.
+    uint64_t group_count;
+    uint32_t payload_crc;       // CRC-32C of all the bytes after the header.
+    uint32_t header_crc;        // CRC-32C of the header, with this field taken as zero.
+};
+
+static_assert(sizeof(Header) == 64, "Unexpected padding in the snapshot header");
+static_assert(sizeof(RouteTable::IpRange) == 8, "Unexpected padding in IpRange");
+static_assert(sizeof(dir24_8::Group) == 32, "Unexpected padding in dir24_8::Group");
+
+static inline uint32_t header_crc(const Header & h) {
+    Header copy = h;
+    copy.header_crc = 0;
+    return CRC32C::Calculate(&copy, sizeof(copy));
+}
+
+/**
+ * @brief A snapshot validated by parse().
+ */
+struct View {
+    const RouteTable::IpRange * ranges;
+    size_t range_count;
+    const uint32_t * tbl24;             // Null if there's no index.
+    const dir24_8::Group * groups;
+    size_t group_count;
+};
+
+/**
+ * @brief Validate a snapshot in memory and locate its parts.
+ *
+ * @param data The snapshot, aligned to a page.
+ * @param size Size of the snapshot.
+ * @param verify_payload Check the CRC of the whole payload as well, otherwise only the header is checked.
+ * @param view Receives the parts.
+ * @return Returning false if it's not a valid snapshot.
+ */
+static inline bool parse(const void * data, size_t size, bool verify_payload, View & view) {
+    if (size < sizeof(Header)) {
+        return false;
+    }
+    Header h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION || h.byte_order != BYTE_ORDER_MARK
+        || h.header_crc != header_crc(h) || h.file_size != size)
+    {
+        return false;
+    }
+    if (h.ranges_offset < sizeof(Header) || h.ranges_offset % sizeof(uint32_t) != 0 || h.ranges_offset > size
+        || h.range_count > (size - h.ranges_offset) / sizeof(RouteTable::IpRange))
+    {
+        return false;
+    }
+    uint64_t const ranges_end = h.ranges_offset + h.range_count * sizeof(RouteTable::IpRange);
+    if (h.index_offset == 0) {
+        if (ranges_end != size) {
+            return false;
+        }
+    } else {
+        uint64_t const tbl24_size = dir24_8::TBL24_SIZE * sizeof(uint32_t);
+        if (h.index_offset < ranges_end || h.index_offset % INDEX_ALIGNMENT != 0 || h.index_offset > size
+            || size - h.index_offset < tbl24_size
+            || h.group_count != (size - h.index_offset - tbl24_size) / sizeof(dir24_8::Group)
+            || (size - h.index_offset - tbl24_size) % sizeof(dir24_8::Group) != 0)
+        {
+            return false;
+        }
+    }
+    const uint8_t * const base = static_cast<const uint8_t *>(data);
+    if (verify_payload
+        && CRC32C::Calculate(base + sizeof(Header), size - sizeof(Header)) != h.payload_crc)
+    {
+        return false;
+    }
+
+    view.ranges = reinterpret_cast<const RouteTable::IpRange *>(base + h.ranges_offset);
+    view.range_count = static_cast<size_t>(h.range_count);
+    view.tbl24 = nullptr;
+    view.groups = nullptr;
+    view.group_count = 0;
+    if (h.index_offset != 0) {
+        view.tbl24 = reinterpret_cast<const uint32_t *>(base + h.index_offset);
+        view.groups = reinterpret_cast<const dir24_8::Group *>(base + h.index_offset
+            + dir24_8::TBL24_SIZE * sizeof(uint32_t));
+        view.group_count = static_cast<size_t>(h.group_count);
+    }
+    return true;
+}
+
+} // End of namespace 'snapshot'
+} // End of namespace 'yhb'
+
+#endif
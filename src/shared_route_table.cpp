@@ -0,0 +1,205 @@
+#include "shared_route_table.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace yhb {
+
+static char const CONTROL_MAGIC[8] = { 'Y', 'H', 'B', 'R', 'T', 'C', 'T', 'L' };
+static uint32_t const CONTROL_VERSION = 1;
+static uint32_t const CONTROL_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief The control object, shared by the writer and the readers.
+ */
+struct SharedRouteTable::Control {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;                    // CONTROL_BYTE_ORDER by the byte order of the writer.
+    std::atomic<uint64_t> generation;       // Zero before the first generation is published.
+};
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#   error "The generation number in the shared memory needs a lock-free 64-bit atomic"
+#endif
+
+static std::string generation_name(const std::string & name, uint64_t generation) {
+    return name + "." + std::to_string(generation);
+}
+
+#ifndef _WIN32
+
+SharedRouteTable::Control * SharedRouteTable::MapControl(const char * name, bool writable) {
+    size_t const size = sizeof(Control);
+    int const fd = shm_open(name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    bool const created = ok && st.st_size == 0;
+    if (created) {
+        ok = writable && ftruncate(fd, static_cast<off_t>(size)) == 0;
+    } else {
+        ok = ok && static_cast<size_t>(st.st_size) == size;
+    }
+    void * view = nullptr;
+    if (ok) {
+        view = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) {
+            view = nullptr;
+        }
+    }
+    close(fd);     // The mapping keeps the object.
+    if (view == nullptr) {
+        return nullptr;
+    }
+
+    Control * const control = static_cast<Control *>(view);
+    if (created) {
+        // Zero filled by ftruncate(), so the generation is zero.
+        control->version = CONTROL_VERSION;
+        control->byte_order = CONTROL_BYTE_ORDER;
+        memcpy(control->magic, CONTROL_MAGIC, sizeof(control->magic));
+    } else if (memcmp(control->magic, CONTROL_MAGIC, sizeof(CONTROL_MAGIC)) != 0
+        || control->version != CONTROL_VERSION || control->byte_order != CONTROL_BYTE_ORDER)
+    {
+        munmap(view, size);
+        return nullptr;
+    }
+    return control;
+}
+
+#endif
+
+SharedRouteTable::SharedRouteTable()
+    : control(nullptr)
+    , generation(0)
+    , verify(true) {}
+
+SharedRouteTable::~SharedRouteTable() {
+    Close();
+}
+
+bool SharedRouteTable::Publish(const char * name, const RouteTable & tab, uint64_t * published) {
+#ifdef _WIN32
+    (void)name;
+    (void)tab;
+    (void)published;
+    return false;
+#else
+    Control * const control = MapControl(name, true);
+    if (control == nullptr) {
+        return false;
+    }
+    uint64_t const previous = control->generation.load(std::memory_order_relaxed);
+    uint64_t const next = previous + 1;
+    std::string const next_name = generation_name(name, next);
+
+    // Filled wholly before the readers can see it.
+    bool ok = false;
+    int const fd = shm_open(next_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        FILE * const fp = fdopen(fd, "w+b");
+        if (fp != nullptr) {
+            ok = tab.WriteSnapshot(fp);
+            ok = fclose(fp) == 0 && ok;
+        } else {
+            close(fd);
+        }
+    }
+    if (ok) {
+        control->generation.store(next, std::memory_order_release);
+        if (previous != 0) {
+            shm_unlink(generation_name(name, previous).c_str());
+        }
+        if (published != nullptr) {
+            *published = next;
+        }
+    } else {
+        shm_unlink(next_name.c_str());
+    }
+    munmap(control, sizeof(Control));
+    return ok;
+#endif
+}
+
+void SharedRouteTable::Unlink(const char * name) {
+#ifdef _WIN32
+    (void)name;
+#else
+    const Control * const control = MapControl(name, false);
+    if (control != nullptr) {
+        uint64_t const current = control->generation.load(std::memory_order_acquire);
+        if (current != 0) {
+            shm_unlink(generation_name(name, current).c_str());
+        }
+        munmap(const_cast<Control *>(control), sizeof(Control));
+    }
+    shm_unlink(name);
+#endif
+}
+
+bool SharedRouteTable::Open(const char * control_name, bool verify_generations) {
+    Close();
+#ifdef _WIN32
+    (void)control_name;
+    (void)verify_generations;
+    return false;
+#else
+    control = MapControl(control_name, false);
+    if (control == nullptr) {
+        return false;
+    }
+    name = control_name;
+    verify = verify_generations;
+    if (!Refresh()) {
+        Close();
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool SharedRouteTable::Refresh() {
+    if (control == nullptr) {
+        return false;
+    }
+    uint64_t current = control->generation.load(std::memory_order_acquire);
+    while (current != generation && current != 0) {
+        MappedRouteTable next;
+        if (next.OpenSharedMemory(generation_name(name, current).c_str(), verify)) {
+            table.Swap(next);
+            generation = current;
+            return true;
+        }
+        // Unlinked by a newer generation meanwhile, otherwise it's not valid.
+        uint64_t const latest = control->generation.load(std::memory_order_acquire);
+        if (latest == current) {
+            return false;
+        }
+        current = latest;
+    }
+    return false;
+}
+
+void SharedRouteTable::Close() {
+#ifndef _WIN32
+    if (control != nullptr) {
+        munmap(const_cast<Control *>(control), sizeof(Control));
+    }
+#endif
+    control = nullptr;
+    table.Close();
+    name.clear();
+    generation = 0;
+}
+
+} // End of namespace 'yhb'
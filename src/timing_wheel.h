@@ -0,0 +1,178 @@
+#ifndef YHB_TIMING_WHEEL_H
+#define YHB_TIMING_WHEEL_H
+
+// Internal hierarchical timing wheel. Not part of the public interface.
+
+#include "cpu_features.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace yhb {
+
+/**
+ * @brief A hierarchical timing wheel, timers of any value type fired by the ticks of a clock given by the caller.
+ *
+ * Each level has 64 slots, a slot of level L spans 64^L ticks. A timer is put on the lowest level where its
+ * deadline and the current time differ only in the bits of that level, and moved down a level each time the
+ * clock reaches its slot, so a timer is touched at most once per level. Scheduling is O(1). The empty slots of
+ * all the levels are skipped by bitmaps, so advancing the clock costs the slots reached with timers in them,
+ * not the ticks passed.
+ */
+template <typename T>
+class TimingWheel {
+public:
+    explicit TimingWheel(uint64_t now = 0) : now(now), count(0) {
+        for (uint64_t & bits : occupied) {
+            bits = 0;
+        }
+    }
+
+    /**
+     * @brief The current time, in ticks.
+     */
+    uint64_t GetTime() const {
+        return now;
+    }
+
+    /**
+     * @brief Number of the timers not fired yet.
+     */
+    size_t GetCount() const {
+        return count;
+    }
+
+    /**
+     * @brief Add a timer, fired by the first Advance() reaching its deadline, the next one if it has passed.
+     */
+    void Schedule(uint64_t deadline, const T & value) {
+        Place(Timer{ deadline, value }, now + 1);
+        ++count;
+    }
+
+    /**
+     * @brief Move the clock forward, fire the timers due by on_expired(deadline, value), tick by tick.
+     * Timers may be scheduled by on_expired().
+     *
+     * @param to The new time, a time before the current one is ignored.
+     */
+    template <typename F>
+    void Advance(uint64_t to, F on_expired) {
+        while (now < to) {
+            if (count == 0) {
+                now = to;
+                break;
+            }
+            uint64_t const next = NextEvent();
+            if (next > to) {
+                now = to;
+                break;
+            }
+            now = next;
+            if ((now & SLOT_MASK) == 0) {
+                Cascade();
+            }
+            Fire(on_expired);
+        }
+    }
+
+private:
+    enum : unsigned {
+        SLOT_BITS = 6,
+        SLOT_COUNT = 1u << SLOT_BITS,
+        SLOT_MASK = SLOT_COUNT - 1,
+        LEVELS = 6,                     // 2^36 ticks, the later timers wait in the overflow list.
+    };
+
+    struct Timer {
+        uint64_t deadline;
+        T value;
+    };
+
+    // The time of the next occupied slot of the lowest level having one, where it's fired or cascaded. The slots
+    // of a level occupied are all after the current one of the level, and before the next slot of the level above.
+    // The overflow list waits for the next span of the top level.
+    uint64_t NextEvent() const {
+        for (unsigned level = 0; level < LEVELS; ++level) {
+            unsigned const shift = SLOT_BITS * level;
+            unsigned const pos = static_cast<unsigned>(now >> shift) & SLOT_MASK;
+            uint64_t const later = pos == SLOT_MASK ? 0 : occupied[level] & (~uint64_t(0) << (pos + 1));
+            if (later != 0) {
+                uint64_t const span = now >> (shift + SLOT_BITS) << (shift + SLOT_BITS);
+                return span + (uint64_t(count_trailing_zeros64(later)) << shift);
+            }
+        }
+        return ((now >> (SLOT_BITS * LEVELS)) + 1) << (SLOT_BITS * LEVELS);
+    }
+
+    // Put the timer in the slot of its deadline, or of the given time if the deadline is earlier.
+    void Place(const Timer & timer, uint64_t earliest) {
+        uint64_t const at = timer.deadline > earliest ? timer.deadline : earliest;
+        uint64_t const diff = at ^ now;
+        unsigned level = 0;
+        while (level < LEVELS && (diff >> (SLOT_BITS * (level + 1))) != 0) {
+            ++level;
+        }
+        if (level == LEVELS) {
+            overflow.push_back(timer);
+            return;
+        }
+        unsigned const slot = static_cast<unsigned>(at >> (SLOT_BITS * level)) & SLOT_MASK;
+        slots[level][slot].push_back(timer);
+        occupied[level] |= uint64_t(1) << slot;
+    }
+
+    // Move the timers of the slots just reached by the clock down, from level 1 up while the clock wraps
+    // the level below.
+    void Cascade() {
+        for (unsigned level = 1; level < LEVELS; ++level) {
+            unsigned const slot = static_cast<unsigned>(now >> (SLOT_BITS * level)) & SLOT_MASK;
+            Replace(slots[level][slot]);
+            occupied[level] &= ~(uint64_t(1) << slot);
+            if (slot != 0) {
+                return;
+            }
+        }
+        Replace(overflow);
+    }
+
+    void Replace(std::vector<Timer> & list) {
+        if (list.empty()) {
+            return;
+        }
+        scratch.swap(list);
+        // The timers due now go to the slot of level 0 fired next.
+        for (const Timer & timer : scratch) {
+            Place(timer, now);
+        }
+        scratch.clear();
+    }
+
+    template <typename F>
+    void Fire(F & on_expired) {
+        unsigned const slot = static_cast<unsigned>(now) & SLOT_MASK;
+        if ((occupied[0] & (uint64_t(1) << slot)) == 0) {
+            return;
+        }
+        occupied[0] &= ~(uint64_t(1) << slot);
+        // Swapped out, so on_expired() may schedule timers, the capacity of both lists is reused.
+        firing.swap(slots[0][slot]);
+        count -= firing.size();
+        for (const Timer & timer : firing) {
+            on_expired(timer.deadline, timer.value);
+        }
+        firing.clear();
+    }
+
+    uint64_t now;
+    size_t count;
+    uint64_t occupied[LEVELS];              // Bitmaps of the slots not empty.
+    std::vector<Timer> slots[LEVELS][SLOT_COUNT];
+    std::vector<Timer> overflow;
+    std::vector<Timer> scratch;
+    std::vector<Timer> firing;
+};
+
+} // End of namespace 'yhb'
+
+#endif
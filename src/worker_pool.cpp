@@ -0,0 +1,100 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+namespace yhb {
+
+WorkerPool & WorkerPool::Instance() {
+    static WorkerPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+WorkerPool::WorkerPool(unsigned worker_count)
+    : stopping(false)
+{
+    workers.reserve(worker_count);
+    for (unsigned i = 0; i < worker_count; ++i) {
+        workers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto & t : workers) {
+        t.join();
+    }
+}
+
+size_t WorkerPool::Drain(Job & job) {
+    size_t ran = 0;
+    for (;;) {
+        size_t const i = job.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= job.count) {
+            return ran;
+        }
+        (*job.task)(i);
+        ++ran;
+    }
+}
+
+void WorkerPool::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        work_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) {
+            return;
+        }
+        Job & job = *jobs.front();
+        ++job.active_workers;
+        lock.unlock();
+
+        size_t const ran = Drain(job);
+
+        lock.lock();
+        // All the tasks are claimed, no one else should pick up this job.
+        if (!jobs.empty() && jobs.front() == &job) {
+            jobs.pop_front();
+        }
+        job.done += ran;
+        --job.active_workers;
+        if (job.done == job.count && job.active_workers == 0) {
+            job_finished.notify_all();
+        }
+    }
+}
+
+void WorkerPool::Run(size_t count, const std::function<void (size_t)> & task) {
+    Job job;
+    job.task = &task;
+    job.count = count;
+    job.next.store(0, std::memory_order_relaxed);
+    job.done = 0;
+    job.active_workers = 0;
+
+    bool const share = count > 1 && !workers.empty();
+    if (share) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        work_available.notify_all();
+    }
+
+    size_t const ran = Drain(job);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (share) {
+        auto const it = std::find(jobs.begin(), jobs.end(), &job);
+        if (it != jobs.end()) {
+            jobs.erase(it);
+        }
+    }
+    job.done += ran;
+    // The job lives on this stack frame, wait until no worker refers to it.
+    job_finished.wait(lock, [&job] { return job.done == job.count && job.active_workers == 0; });
+}
+
+} // End of namespace 'yhb'
@@ -0,0 +1,73 @@
+#ifndef YHB_WORKER_POOL_H
+#define YHB_WORKER_POOL_H
+
+// Internal thread pool for the parallel algorithms. Not part of the public interface.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yhb {
+
+class WorkerPool {
+public:
+
+    /**
+     * @brief Get the process-wide pool, with one worker thread less than the hardware threads,
+     * as the calling thread always takes part in the work. Created on the first use.
+     */
+    static WorkerPool & Instance();
+
+    /**
+     * @brief Run task(0), task(1) ... task(count - 1) on the worker threads and the calling thread,
+     * return after all of them are done. May be called from several threads at once.
+     */
+    void Run(size_t count, const std::function<void (size_t)> & task);
+
+    /**
+     * @brief How many threads can run the tasks at once, the calling thread included.
+     */
+    unsigned GetConcurrency() const {
+        return static_cast<unsigned>(workers.size()) + 1;
+    }
+
+    ~WorkerPool();
+
+private:
+    explicit WorkerPool(unsigned worker_count);
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator = (const WorkerPool &) = delete;
+
+    struct Job {
+        const std::function<void (size_t)> * task;
+        size_t count;
+        std::atomic<size_t> next;       // Next task index to claim.
+        size_t done;                    // Count of finished tasks, guarded by the mutex.
+        unsigned active_workers;        // Workers holding this job, guarded by the mutex.
+    };
+
+    void WorkerLoop();
+
+    /**
+     * @brief Claim and run the tasks of the job until none is left.
+     *
+     * @return How many tasks were run.
+     */
+    static size_t Drain(Job & job);
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable job_finished;
+    std::deque<Job *> jobs;
+    bool stopping;
+    std::vector<std::thread> workers;
+};
+
+} // End of namespace 'yhb'
+
+#endif
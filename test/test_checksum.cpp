@@ -1,10 +1,12 @@
 #include <gtest/gtest.h>
 #include "checksum.h"
+#include <vector>
 
 using Checksum = yhb::Checksum;
 
 #ifdef __GNUC__
 #include <arpa/inet.h>
+#include <sys/uio.h>
 #endif
 
 size_t const IP_HEAD_LEN = 20;
@@ -132,3 +134,435 @@ TEST(ChecksumTest, Tcp) {
         ASSERT_EQ(0xffff, cs);
     }
 }
+
+// The original implementation, sums one uint16_t at a time into a 32-bit accumulator.
+static uint16_t reference_checksum(const void * dataptr, size_t len, uint16_t additional) {
+    const uint8_t * pb = (const uint8_t *)dataptr;
+    const int odd = ((intptr_t)pb & 1);
+    uint16_t t = 0;
+    if (odd && len > 0) {
+        ((uint8_t *)&t)[1] = *pb++;
+        len--;
+    }
+    const uint16_t * ps = (const uint16_t *)(const void *)pb;
+    uint32_t sum = 0;
+    while (len > 1) {
+        sum += *ps++;
+        len -= 2;
+    }
+    if (len > 0) {
+        ((uint8_t *)&t)[0] = *(const uint8_t *)ps;
+    }
+    sum += t;
+    sum += additional;
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    if (odd) {
+        sum = ((sum & 0xff) << 8) | ((sum & 0xff00) >> 8);
+    }
+    return (uint16_t)sum;
+}
+
+static std::vector<Checksum::Kernel> supported_kernels() {
+    std::vector<Checksum::Kernel> result;
+    Checksum::Kernel const all[] = {
+        Checksum::Kernel::SCALAR,
+        Checksum::Kernel::SSE2,
+        Checksum::Kernel::AVX2,
+        Checksum::Kernel::AVX512,
+    };
+    Checksum::Kernel const saved = Checksum::GetKernel();
+    for (auto k : all) {
+        if (Checksum::SetKernel(k)) {
+            result.push_back(k);
+        }
+    }
+    Checksum::SetKernel(saved);
+    return result;
+}
+
+TEST(ChecksumTest, Kernels) {
+    ASSERT_NE(Checksum::Kernel::AUTO, Checksum::GetKernel());
+
+    std::vector<uint8_t> data(70000);
+    uint32_t seed = 12345;
+    for (auto & b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    std::vector<uint8_t> zeros(300, 0);
+    std::vector<uint8_t> ones(70000, 0xff);
+
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(Checksum::SetKernel(k));
+        ASSERT_EQ(k, Checksum::GetKernel());
+
+        // Rerun the known packet vectors.
+        ASSERT_EQ(0xffff, Checksum::Calculate(TEST_IP_HEAD, IP_HEAD_LEN));
+        ASSERT_EQ(0xffff, Checksum::Calculate(&TEST_ICMP[IP_HEAD_LEN], sizeof(TEST_ICMP) - 1 - IP_HEAD_LEN));
+        char buf[512];
+        memcpy(&buf[1], TEST_IP_HEAD, IP_HEAD_LEN);
+        ASSERT_EQ(0xffff, Checksum::Calculate(&buf[1], IP_HEAD_LEN));
+
+        for (size_t offset = 0; offset < 4; ++offset) {
+            for (size_t len = 0; len < 300; ++len) {
+                uint16_t const add = static_cast<uint16_t>(len * 7919);
+                ASSERT_EQ(reference_checksum(&data[offset], len, add), Checksum::Calculate(&data[offset], len, add))
+                    << "kernel " << static_cast<int>(k) << " offset " << offset << " len " << len;
+                ASSERT_EQ(reference_checksum(&zeros[offset], len, 0), Checksum::Calculate(&zeros[offset], len, 0));
+            }
+            // Long enough to flush the SIMD lanes, but not to overflow the reference accumulator.
+            size_t const len = 65536 - offset;
+            ASSERT_EQ(reference_checksum(&data[offset], len, 0xfffe), Checksum::Calculate(&data[offset], len, 0xfffe));
+            ASSERT_EQ(reference_checksum(&ones[offset], len, 0), Checksum::Calculate(&ones[offset], len, 0));
+        }
+    }
+    ASSERT_TRUE(Checksum::SetKernel(Checksum::Kernel::AUTO));
+}
+
+TEST(ChecksumTest, KernelsLarge) {
+    // Far beyond the range of a 32-bit accumulator, all the kernels must still agree.
+    std::vector<uint8_t> data(4 * 1024 * 1024 + 3, 0xff);
+    for (size_t i = 0; i < data.size(); i += 7) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    ASSERT_TRUE(Checksum::SetKernel(Checksum::Kernel::SCALAR));
+    uint16_t const expected = Checksum::Calculate(&data[1], data.size() - 1, 0x1234);
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(Checksum::SetKernel(k));
+        ASSERT_EQ(expected, Checksum::Calculate(&data[1], data.size() - 1, 0x1234));
+    }
+    ASSERT_TRUE(Checksum::SetKernel(Checksum::Kernel::AUTO));
+}
+
+TEST(ChecksumTest, CopyAndCalculate) {
+    std::vector<uint8_t> data(5000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+    std::vector<uint8_t> dst(data.size() + 8);
+
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(Checksum::SetKernel(k));
+        for (size_t src_offset = 0; src_offset < 2; ++src_offset) {
+            for (size_t dst_offset = 0; dst_offset < 4; ++dst_offset) {
+                for (size_t len : { 0, 1, 2, 7, 15, 16, 33, 63, 64, 65, 127, 200, 1499, 4093 }) {
+                    std::fill(dst.begin(), dst.end(), 0xaa);
+                    uint16_t const add = static_cast<uint16_t>(len * 31 + 1);
+                    uint16_t const cs = Checksum::CopyAndCalculate(&dst[dst_offset], &data[src_offset], len, add);
+                    ASSERT_EQ(0, memcmp(&dst[dst_offset], &data[src_offset], len));
+                    ASSERT_EQ(0xaa, dst[dst_offset + len]);
+                    ASSERT_EQ(Checksum::Calculate(&dst[dst_offset], len, add), cs)
+                        << "kernel " << static_cast<int>(k) << " len " << len;
+                }
+            }
+        }
+    }
+    ASSERT_TRUE(Checksum::SetKernel(Checksum::Kernel::AUTO));
+
+    // A packet copied out keeps a valid checksum.
+    char buf[64];
+    ASSERT_EQ(0xffff, Checksum::CopyAndCalculate(&buf[1], TEST_IP_HEAD, IP_HEAD_LEN));
+}
+
+TEST(ChecksumTest, ScatterGather) {
+    // Even aligned, as the iovec version is defined on the concatenation at an even address.
+    std::vector<uint16_t> storage(2048);
+    uint8_t * const data = reinterpret_cast<uint8_t *>(storage.data());
+    size_t const total = storage.size() * 2 - 1;
+    for (size_t i = 0; i < total; ++i) {
+        data[i] = static_cast<uint8_t>(i * 151 + 3);
+    }
+
+    uint32_t seed = 99;
+    for (int round = 0; round < 200; ++round) {
+        std::vector<struct iovec> iov;
+        std::vector<std::vector<uint8_t>> segments;
+        size_t pos = 0;
+        while (pos < total) {
+            seed = seed * 1103515245 + 12345;
+            size_t len = (seed >> 16) % 97;
+            if (len > total - pos) {
+                len = total - pos;
+            }
+            // Copy each segment to a buffer of its own, at an arbitrary alignment.
+            size_t const shift = (seed >> 8) & 3;
+            segments.push_back(std::vector<uint8_t>(len + shift + 1));
+            memcpy(segments.back().data() + shift, data + pos, len);
+            struct iovec v;
+            v.iov_base = segments.back().data() + shift;
+            v.iov_len = len;
+            iov.push_back(v);
+            pos += len;
+        }
+        uint16_t const add = static_cast<uint16_t>(round * 333);
+        ASSERT_EQ(Checksum::Calculate(data, total, add), Checksum::Calculate(iov.data(), iov.size(), add));
+    }
+
+    ASSERT_EQ(0, Checksum::Calculate(static_cast<const struct iovec *>(nullptr), 0));
+
+    // The UDP packet in three pieces, the pseudo header included.
+    pseudo_header ph;
+    memcpy(&ph.src_ip, &TEST_IP_UDP[12], 4);
+    memcpy(&ph.dest_ip, &TEST_IP_UDP[16], 4);
+    ph.reserved = 0;
+    ph.protocol = 17;
+    ph.length = htons(sizeof(TEST_IP_UDP) - 1 - IP_HEAD_LEN);
+    struct iovec udp[3];
+    udp[0].iov_base = &ph;
+    udp[0].iov_len = sizeof(ph);
+    udp[1].iov_base = const_cast<char *>(&TEST_IP_UDP[IP_HEAD_LEN]);
+    udp[1].iov_len = 13;
+    udp[2].iov_base = const_cast<char *>(&TEST_IP_UDP[IP_HEAD_LEN + 13]);
+    udp[2].iov_len = ntohs(ph.length) - 13;
+    ASSERT_EQ(0xffff, Checksum::Calculate(udp, 3));
+}
+
+// Recompute the IPv4 and TCP/UDP checksums from scratch, returns true if both are valid.
+static bool verify_ipv4_packet(const char * packet, size_t len) {
+    if (Checksum::Calculate(packet, IP_HEAD_LEN) != 0xffff) {
+        return false;
+    }
+    pseudo_header ph;
+    memcpy(&ph.src_ip, packet + 12, 4);
+    memcpy(&ph.dest_ip, packet + 16, 4);
+    ph.reserved = 0;
+    ph.protocol = static_cast<uint8_t>(packet[9]);
+    ph.length = htons(static_cast<uint16_t>(len - IP_HEAD_LEN));
+    uint16_t const cs = Checksum::Calculate(&ph, sizeof(ph));
+    return Checksum::Calculate(packet + IP_HEAD_LEN, len - IP_HEAD_LEN, cs) == 0xffff;
+}
+
+TEST(ChecksumTest, Update) {
+    char buf[512];
+    memcpy(buf, TEST_IP_HEAD, IP_HEAD_LEN);
+    for (uint32_t v : { 0u, 1u, 0xffffu, 0x12345678u, 0xffffffffu }) {
+        uint16_t field;
+        memcpy(&field, &buf[10], 2);
+        uint32_t old;
+        memcpy(&old, &buf[12], 4);
+        memcpy(&buf[12], &v, 4);
+        field = Checksum::Update32(field, old, v);
+        memcpy(&buf[10], &field, 2);
+        ASSERT_EQ(0xffff, Checksum::Calculate(buf, IP_HEAD_LEN));
+
+        uint16_t old16;
+        memcpy(&old16, &buf[4], 2);
+        uint16_t const v16 = static_cast<uint16_t>(v * 3);
+        memcpy(&buf[4], &v16, 2);
+        memcpy(&field, &buf[10], 2);
+        field = Checksum::Update16(field, old16, v16);
+        memcpy(&buf[10], &field, 2);
+        ASSERT_EQ(0xffff, Checksum::Calculate(buf, IP_HEAD_LEN));
+    }
+}
+
+TEST(ChecksumTest, IPv4Rewriter) {
+    // TCP, odd total length
+    size_t const tcp_len = sizeof(TEST_TCP) - 1;
+    char tcp[128];
+    memcpy(tcp, TEST_TCP, tcp_len);
+    ASSERT_TRUE(verify_ipv4_packet(tcp, tcp_len));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetSourceAddress(tcp, tcp_len, htonl(0x0a000001)));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetDestinationAddress(tcp, tcp_len, htonl(0xc0a80101)));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetSourcePort(tcp, tcp_len, htons(40000)));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetDestinationPort(tcp, tcp_len, htons(8443)));
+    ASSERT_TRUE(yhb::IPv4Rewriter::DecreaseTTL(tcp, tcp_len));
+    ASSERT_EQ(0x7f, static_cast<uint8_t>(tcp[8]));
+    ASSERT_EQ(htonl(0x0a000001), *(const uint32_t *)&tcp[12]);
+    ASSERT_EQ(htons(8443), *(const uint16_t *)&tcp[IP_HEAD_LEN + 2]);
+    ASSERT_TRUE(verify_ipv4_packet(tcp, tcp_len));
+
+    // UDP
+    size_t const udp_len = sizeof(TEST_IP_UDP) - 1;
+    char udp[128];
+    memcpy(&udp[1], TEST_IP_UDP, udp_len);
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetSourceAddress(&udp[1], udp_len, htonl(0x64400001)));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetSourcePort(&udp[1], udp_len, htons(53)));
+    memcpy(tcp, &udp[1], udp_len);
+    ASSERT_TRUE(verify_ipv4_packet(tcp, udp_len));
+
+    // UDP without checksum keeps zero.
+    memcpy(udp, TEST_IP_UDP, udp_len);
+    udp[IP_HEAD_LEN + 6] = udp[IP_HEAD_LEN + 7] = 0;
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetDestinationAddress(udp, udp_len, htonl(0x01010101)));
+    ASSERT_EQ(0, *(const uint16_t *)&udp[IP_HEAD_LEN + 6]);
+    ASSERT_EQ(0xffff, Checksum::Calculate(udp, IP_HEAD_LEN));
+
+    // ICMP has no ports, only the IP header is patched.
+    size_t const icmp_len = sizeof(TEST_ICMP) - 1;
+    char icmp[128];
+    memcpy(icmp, TEST_ICMP, icmp_len);
+    ASSERT_FALSE(yhb::IPv4Rewriter::SetSourcePort(icmp, icmp_len, htons(1)));
+    ASSERT_EQ(0, memcmp(icmp, TEST_ICMP, icmp_len));
+    ASSERT_TRUE(yhb::IPv4Rewriter::SetSourceAddress(icmp, icmp_len, htonl(0x0a0a0a0a)));
+    ASSERT_EQ(0xffff, Checksum::Calculate(icmp, IP_HEAD_LEN));
+    ASSERT_EQ(0xffff, Checksum::Calculate(&icmp[IP_HEAD_LEN], icmp_len - IP_HEAD_LEN));
+
+    // Malformed
+    ASSERT_FALSE(yhb::IPv4Rewriter::SetSourceAddress(tcp, 19, 0));
+    tcp[0] = 0x65;
+    ASSERT_FALSE(yhb::IPv4Rewriter::DecreaseTTL(tcp, tcp_len));
+    tcp[0] = 0x45;
+    tcp[8] = 0;
+    ASSERT_FALSE(yhb::IPv4Rewriter::DecreaseTTL(tcp, tcp_len));
+}
+
+TEST(ChecksumTest, Batch) {
+    std::vector<uint8_t> data(8192);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+
+    size_t const count = 103;
+    std::vector<const void *> ptrs(count);
+    std::vector<size_t> lens(count);
+    std::vector<uint16_t> seeds(count);
+    std::vector<uint16_t> results(count);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < count; ++i) {
+        seed = seed * 1103515245 + 12345;
+        ptrs[i] = &data[(seed >> 8) % 4096];
+        lens[i] = i < 40 ? 64 + (i & 1) : (seed >> 16) % 1600;
+        seeds[i] = static_cast<uint16_t>(seed);
+    }
+
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(Checksum::SetKernel(k));
+        Checksum::CalculateBatch(ptrs.data(), lens.data(), seeds.data(), results.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(Checksum::Calculate(ptrs[i], lens[i], seeds[i]), results[i]) << i;
+        }
+        Checksum::CalculateBatch(ptrs.data(), lens.data(), nullptr, results.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(Checksum::Calculate(ptrs[i], lens[i]), results[i]) << i;
+        }
+    }
+    ASSERT_TRUE(Checksum::SetKernel(Checksum::Kernel::AUTO));
+}
+
+// Build an IPv6 packet with the given extension headers and transport layer packet, its checksum field is zero.
+static std::vector<uint8_t> make_ipv6_packet(uint8_t protocol, const std::vector<uint8_t> & ext,
+                                             uint8_t first_header, const std::vector<uint8_t> & l4) {
+    std::vector<uint8_t> p(40);
+    p[0] = 0x60;
+    size_t const payload = ext.size() + l4.size();
+    p[4] = static_cast<uint8_t>(payload >> 8);
+    p[5] = static_cast<uint8_t>(payload);
+    p[6] = ext.empty() ? protocol : first_header;
+    p[7] = 64;
+    for (int i = 0; i < 32; ++i) {
+        p[8 + i] = static_cast<uint8_t>(0x20 + i * 3);
+    }
+    p.insert(p.end(), ext.begin(), ext.end());
+    p.insert(p.end(), l4.begin(), l4.end());
+    return p;
+}
+
+// Checksum of an IPv6 transport layer packet, by building the pseudo header explicitly.
+static uint16_t ipv6_reference_checksum(const std::vector<uint8_t> & packet, uint8_t protocol, size_t l4_offset) {
+    std::vector<uint8_t> buf(packet.begin() + 8, packet.begin() + 40);
+    size_t const len = packet.size() - l4_offset;
+    uint8_t const tail[8] = {
+        static_cast<uint8_t>(len >> 24), static_cast<uint8_t>(len >> 16),
+        static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len), 0, 0, 0, protocol,
+    };
+    buf.insert(buf.end(), tail, tail + 8);
+    buf.insert(buf.end(), packet.begin() + l4_offset, packet.end());
+    return static_cast<uint16_t>(~Checksum::Calculate(buf.data(), buf.size()));
+}
+
+TEST(ChecksumTest, L4Checksum) {
+    using yhb::L4Checksum;
+
+    // IPv4 vectors, the checksums are correct already.
+    ASSERT_TRUE(L4Checksum::Verify(TEST_TCP, sizeof(TEST_TCP) - 1));
+    ASSERT_TRUE(L4Checksum::VerifyPacket(TEST_TCP, sizeof(TEST_TCP) - 1));
+    ASSERT_TRUE(L4Checksum::VerifyPacket(TEST_IP_UDP, sizeof(TEST_IP_UDP) - 1));
+    ASSERT_TRUE(L4Checksum::VerifyPacket(TEST_ICMP, sizeof(TEST_ICMP) - 1));
+    uint16_t cs;
+    ASSERT_TRUE(L4Checksum::Calculate(TEST_TCP, sizeof(TEST_TCP) - 1, &cs));
+    ASSERT_EQ(*(const uint16_t *)&TEST_TCP[IP_HEAD_LEN + 16], cs);
+    ASSERT_TRUE(L4Checksum::Calculate(TEST_IP_UDP, sizeof(TEST_IP_UDP) - 1, &cs));
+    ASSERT_EQ(*(const uint16_t *)&TEST_IP_UDP[IP_HEAD_LEN + 6], cs);
+
+    char buf[256];
+    size_t const udp_len = sizeof(TEST_IP_UDP) - 1;
+    memcpy(&buf[1], TEST_IP_UDP, udp_len);
+    buf[1 + IP_HEAD_LEN + 6] ^= 0x10;
+    ASSERT_FALSE(L4Checksum::Verify(&buf[1], udp_len));
+    ASSERT_TRUE(L4Checksum::Update(&buf[1], udp_len));
+    ASSERT_EQ(0, memcmp(&buf[1], TEST_IP_UDP, udp_len));
+
+    // A wrong IP header checksum fails the packet verification only.
+    buf[1 + 10] ^= 0x01;
+    ASSERT_TRUE(L4Checksum::Verify(&buf[1], udp_len));
+    ASSERT_FALSE(L4Checksum::VerifyPacket(&buf[1], udp_len));
+    buf[1 + 10] ^= 0x01;
+
+    // IPv4 UDP without checksum.
+    buf[1 + IP_HEAD_LEN + 6] = buf[1 + IP_HEAD_LEN + 7] = 0;
+    ASSERT_TRUE(L4Checksum::Verify(&buf[1], udp_len));
+
+    // Truncated, fragments
+    ASSERT_FALSE(L4Checksum::Verify(TEST_IP_UDP, udp_len - 1));
+    memcpy(buf, TEST_IP_UDP, udp_len);
+    buf[6] = 0x20;      // More fragments
+    ASSERT_FALSE(L4Checksum::Verify(buf, udp_len));
+
+    // IPv6 TCP, UDP and ICMPv6, with and without extension headers, odd lengths.
+    std::vector<uint8_t> l4(37);
+    for (size_t i = 0; i < l4.size(); ++i) {
+        l4[i] = static_cast<uint8_t>(i * 17 + 1);
+    }
+    std::vector<uint8_t> ext(16, 0);
+    ext[0] = 60;    // Hop-by-Hop followed by Destination Options, followed by the transport layer
+    ext[1] = 0;
+    ext[8] = 0;     // Set below
+    ext[9] = 0;
+    for (uint8_t protocol : { 6, 17, 58 }) {
+        size_t const field = protocol == 6 ? 16 : protocol == 17 ? 6 : 2;
+        for (int with_ext = 0; with_ext < 2; ++with_ext) {
+            l4[field] = l4[field + 1] = 0;
+            ext[8] = protocol;
+            std::vector<uint8_t> packet = with_ext
+                ? make_ipv6_packet(protocol, ext, 0, l4)
+                : make_ipv6_packet(protocol, std::vector<uint8_t>(), 0, l4);
+            size_t const l4_offset = 40 + (with_ext ? ext.size() : 0);
+            uint16_t const expected = ipv6_reference_checksum(packet, protocol, l4_offset);
+
+            ASSERT_FALSE(L4Checksum::Verify(packet.data(), packet.size()));
+            ASSERT_TRUE(L4Checksum::Calculate(packet.data(), packet.size(), &cs));
+            ASSERT_EQ(expected, cs);
+            ASSERT_TRUE(L4Checksum::Update(packet.data(), packet.size()));
+            ASSERT_TRUE(L4Checksum::Verify(packet.data(), packet.size()));
+            ASSERT_TRUE(L4Checksum::VerifyPacket(packet.data(), packet.size()));
+            packet.back() ^= 1;
+            ASSERT_FALSE(L4Checksum::VerifyPacket(packet.data(), packet.size()));
+        }
+    }
+
+    // IPv6 fragment header is not supported.
+    ext[0] = 44;
+    std::vector<uint8_t> fragment = make_ipv6_packet(17, ext, 0, l4);
+    ASSERT_FALSE(L4Checksum::Verify(fragment.data(), fragment.size()));
+}
+
+TEST(ChecksumTest, Parallel) {
+    std::vector<uint8_t> data(3 * 1024 * 1024 + 77);
+    uint32_t seed = 5;
+    for (auto & b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    for (size_t offset = 0; offset < 3; ++offset) {
+        size_t const len = data.size() - offset - (offset == 1 ? 1 : 0);
+        uint16_t const expected = Checksum::Calculate(&data[offset], len, 0x4321);
+        for (unsigned threads : { 0u, 1u, 2u, 3u, 5u, 8u }) {
+            ASSERT_EQ(expected, Checksum::CalculateParallel(&data[offset], len, 0x4321, threads))
+                << "offset " << offset << " threads " << threads;
+        }
+    }
+    // Too short to split.
+    ASSERT_EQ(0xffff, Checksum::CalculateParallel(TEST_IP_HEAD, IP_HEAD_LEN, 0, 4));
+}
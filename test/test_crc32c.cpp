@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "crc32c.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using CRC32C = yhb::CRC32C;
+
+static std::vector<CRC32C::Kernel> supported_kernels() {
+    std::vector<CRC32C::Kernel> result;
+    CRC32C::Kernel const saved = CRC32C::GetKernel();
+    for (auto k : { CRC32C::Kernel::SOFTWARE, CRC32C::Kernel::SSE42 }) {
+        if (CRC32C::SetKernel(k)) {
+            result.push_back(k);
+        }
+    }
+    CRC32C::SetKernel(saved);
+    return result;
+}
+
+TEST(CRC32C, Vectors) {
+    ASSERT_NE(CRC32C::Kernel::AUTO, CRC32C::GetKernel());
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(CRC32C::SetKernel(k));
+
+        ASSERT_EQ(0u, CRC32C::Calculate("", 0));
+        ASSERT_EQ(0xe3069283u, CRC32C::Calculate("123456789", 9));
+
+        // RFC 3720, B.4
+        uint8_t buf[32];
+        memset(buf, 0, sizeof(buf));
+        ASSERT_EQ(0x8a9136aau, CRC32C::Calculate(buf, sizeof(buf)));
+        memset(buf, 0xff, sizeof(buf));
+        ASSERT_EQ(0x62a8ab43u, CRC32C::Calculate(buf, sizeof(buf)));
+        for (int i = 0; i < 32; ++i) {
+            buf[i] = static_cast<uint8_t>(i);
+        }
+        ASSERT_EQ(0x46dd794eu, CRC32C::Calculate(buf, sizeof(buf)));
+        for (int i = 0; i < 32; ++i) {
+            buf[i] = static_cast<uint8_t>(31 - i);
+        }
+        ASSERT_EQ(0x113fdb5cu, CRC32C::Calculate(buf, sizeof(buf)));
+    }
+    ASSERT_TRUE(CRC32C::SetKernel(CRC32C::Kernel::AUTO));
+}
+
+TEST(CRC32C, KernelsAgree) {
+    std::vector<uint8_t> data(100000);
+    uint32_t seed = 1;
+    for (auto & b : data) {
+        seed = seed * 1103515245 + 12345;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+
+    ASSERT_TRUE(CRC32C::SetKernel(CRC32C::Kernel::SOFTWARE));
+    std::vector<uint32_t> expected;
+    size_t const lens[] = { 1, 7, 8, 100, 767, 768, 769, 2000, 24575, 24576, 24577, 99990 };
+    for (size_t offset = 0; offset < 8; offset += 3) {
+        for (size_t len : lens) {
+            expected.push_back(CRC32C::Calculate(&data[offset], len));
+        }
+    }
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(CRC32C::SetKernel(k));
+        size_t i = 0;
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            for (size_t len : lens) {
+                ASSERT_EQ(expected[i++], CRC32C::Calculate(&data[offset], len)) << len;
+            }
+        }
+    }
+    ASSERT_TRUE(CRC32C::SetKernel(CRC32C::Kernel::AUTO));
+}
+
+TEST(CRC32C, PiecesAndCombine) {
+    std::vector<uint8_t> data(50000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 13 + (i >> 8));
+    }
+    uint32_t const whole = CRC32C::Calculate(data.data(), data.size());
+
+    for (size_t split : { 0, 1, 9, 4096, 33333, 50000 }) {
+        uint32_t const crc1 = CRC32C::Calculate(data.data(), split);
+        uint32_t const crc2 = CRC32C::Calculate(data.data() + split, data.size() - split);
+        ASSERT_EQ(whole, CRC32C::Calculate(data.data() + split, data.size() - split, crc1));
+        ASSERT_EQ(whole, CRC32C::Combine(crc1, crc2, data.size() - split));
+    }
+
+    // Many chunks combined in order, as if calculated by several threads.
+    uint32_t crc = 0;
+    size_t pos = 0;
+    for (size_t chunk = 1; pos < data.size(); chunk = chunk * 3 + 1) {
+        size_t const len = std::min(chunk, data.size() - pos);
+        crc = CRC32C::Combine(crc, CRC32C::Calculate(&data[pos], len), len);
+        pos += len;
+    }
+    ASSERT_EQ(whole, crc);
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "expiring_route_table.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using yhb::ExpiringRouteTable;
+using yhb::RouteTable;
+using IpRange = RouteTable::IpRange;
+
+TEST(ExpiringRouteTable, Overlap) {
+    ExpiringRouteTable tab(1000);
+    ASSERT_FALSE(tab.Insert(IpRange{ 2, 1 }, 2000));
+    ASSERT_FALSE(tab.Insert(0, 33, 2000));
+    ASSERT_FALSE(tab.Insert("1.2.3.4/", 2000));
+    ASSERT_TRUE(tab.Insert("1.2.3.4", 1000));        // Expired already
+    ASSERT_TRUE(tab.IsEmpty());
+    ASSERT_FALSE(tab.Find(0x01020304, true));
+
+    ASSERT_TRUE(tab.Insert("10.0.0.0/24", 1600));
+    ASSERT_TRUE(tab.Insert("10.0.0.128/25", 1300));  // Earlier, covered by the first one
+    ASSERT_TRUE(tab.Insert(htonl(0x0a000040), 26, 1900));
+    ASSERT_EQ(3u, tab.GetSegmentCount());
+    uint64_t expire_at = 0;
+    ASSERT_TRUE(tab.GetExpiry(0x0a000050, expire_at));
+    ASSERT_EQ(1900u, expire_at);
+    ASSERT_TRUE(tab.GetExpiry(0x0a0000ff, expire_at));
+    ASSERT_EQ(1600u, expire_at);
+    ASSERT_FALSE(tab.GetExpiry(0x0a000100, expire_at));
+
+    ASSERT_EQ(0u, tab.Advance(1599));
+    ASSERT_TRUE(tab.Find(0x0a000000, true));
+    ASSERT_EQ(2u, tab.Advance(1600));
+    ASSERT_FALSE(tab.Find(0x0a000000, true));
+    ASSERT_TRUE(tab.Find(htonl(0x0a00007f), false));
+    ASSERT_FALSE(tab.Find(0x0a000080, true));
+    ASSERT_EQ(1u, tab.ToRouteTable().GetCount());
+
+    // Extended by a later rule of the same addresses, the timer of the earlier deadline is stale.
+    ASSERT_TRUE(tab.Insert("10.0.0.64/26", 5000));
+    ASSERT_EQ(0u, tab.Advance(4999));
+    ASSERT_TRUE(tab.Find(0x0a000040, true));
+    ASSERT_EQ(1u, tab.Advance(1u << 20));
+    ASSERT_TRUE(tab.IsEmpty());
+    ASSERT_FALSE(tab.Find(0x0a000040, true));
+
+    // Far beyond the levels of the wheel.
+    uint64_t const far = tab.GetTime() + (uint64_t(1) << 40) + 12345;
+    ASSERT_TRUE(tab.Insert(IpRange{ 0, 0xffffffff }, far));
+    ASSERT_TRUE(tab.Insert(IpRange{ 5, 5 }, far + 1));
+    ASSERT_EQ(0u, tab.Advance(far - 1));
+    ASSERT_TRUE(tab.Find(0xffffffff, true));
+    ASSERT_EQ(2u, tab.Advance(far));
+    RouteTable const left = tab.ToRouteTable();
+    ASSERT_EQ((std::vector<IpRange>{ { 5, 5 } }), std::vector<IpRange>(left.begin(), left.end()));
+    ASSERT_TRUE(tab.Find(5, true));
+    ASSERT_FALSE(tab.Find(4, true));
+
+    tab.Clear();
+    ASSERT_TRUE(tab.IsEmpty());
+    ASSERT_FALSE(tab.Find(5, true));
+    ASSERT_EQ(0u, tab.Advance(far + 1));
+    ASSERT_EQ(far + 1, tab.GetTime());
+}
+
+// Checked against all the rules given, an address matches while any of its rules has not expired.
+TEST(ExpiringRouteTable, Random) {
+    struct Rule {
+        IpRange range;
+        uint64_t expire_at;
+    };
+    std::mt19937 rng(1);
+    ExpiringRouteTable tab;
+    std::vector<Rule> rules;
+    uint64_t now = 0;
+    for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 50; ++i) {
+            // Clustered so they overlap, the deadlines from a tick to about 2^20 ticks later.
+            uint32_t const first = (rng() & 0xfffff) << 4;
+            uint32_t const last = first + (rng() >> (16 + rng() % 16));
+            uint64_t const expire_at = now + 1 + rng() % (1u << (rng() % 21));
+            Rule const rule = { IpRange{ first, last < first ? 0xffffffff : last }, expire_at };
+            ASSERT_TRUE(tab.Insert(rule.range, rule.expire_at));
+            rules.push_back(rule);
+        }
+        now += rng() % (1u << (rng() % 17));
+        tab.Advance(now);
+
+        // The bounds of the rules, and the addresses around them in the same /24 blocks.
+        std::vector<uint32_t> ips;
+        for (auto const & r : rules) {
+            for (uint32_t ip : { r.range.first - 1, r.range.first, r.range.last, r.range.last + 1 }) {
+                ips.push_back(ip);
+                ips.push_back(ip ^ (rng() & 0xff));
+            }
+        }
+        for (uint32_t ip : ips) {
+            uint64_t expected = 0;
+            for (auto const & r : rules) {
+                if (r.range.first <= ip && ip <= r.range.last && r.expire_at > now) {
+                    expected = std::max(expected, r.expire_at);
+                }
+            }
+            uint64_t actual = 0;
+            ASSERT_EQ(expected != 0, tab.GetExpiry(ip, actual)) << ip;
+            ASSERT_EQ(expected != 0, tab.Find(ip, true)) << ip;
+            ASSERT_EQ(expected != 0, tab.Find(htonl(ip), false)) << ip;
+            if (expected != 0) {
+                ASSERT_EQ(expected, actual) << ip;
+            }
+        }
+        RouteTable const snapshot = tab.ToRouteTable();
+        for (uint32_t ip : ips) {
+            ASSERT_EQ(tab.Find(ip, true), snapshot.Find(ip, true)) << ip;
+        }
+        rules.erase(std::remove_if(rules.begin(), rules.end(), [now](const Rule & r) {
+            return r.expire_at <= now;
+        }), rules.end());
+    }
+}
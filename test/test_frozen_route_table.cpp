@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include "frozen_route_table.h"
+#include <arpa/inet.h>
+#include <random>
+#include <vector>
+
+using yhb::RouteTable;
+using yhb::FrozenRouteTable;
+using IpRange = RouteTable::IpRange;
+
+static std::vector<FrozenRouteTable::Kernel> supported_kernels() {
+    std::vector<FrozenRouteTable::Kernel> result;
+    for (auto k : { FrozenRouteTable::Kernel::SCALAR, FrozenRouteTable::Kernel::AVX2 }) {
+        if (FrozenRouteTable::SetKernel(k)) {
+            result.push_back(k);
+        }
+    }
+    FrozenRouteTable::SetKernel(FrozenRouteTable::Kernel::AUTO);
+    return result;
+}
+
+static void make_table(RouteTable & tab, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    while (tab.GetCount() < count) {
+        uint32_t const first = static_cast<uint32_t>(rng());
+        uint32_t const len = static_cast<uint32_t>(rng()) >> (16 + rng() % 16);
+        tab.Insert(IpRange{ first, first + len < first ? 0xffffffff : first + len });
+    }
+}
+
+static void expect_same_find(const RouteTable & tab, uint32_t seed) {
+    FrozenRouteTable const frozen(tab);
+    ASSERT_EQ(tab.GetCount(), frozen.GetCount());
+    std::vector<uint32_t> ips = { 0, 1, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff };
+    for (auto const & r : tab) {
+        for (uint32_t ip : { r.first - 1, r.first, r.first + 1, r.last - 1, r.last, r.last + 1 }) {
+            ips.push_back(ip);
+        }
+    }
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 10000; ++i) {
+        ips.push_back(static_cast<uint32_t>(rng()));
+    }
+    for (auto k : supported_kernels()) {
+        ASSERT_TRUE(FrozenRouteTable::SetKernel(k));
+        for (uint32_t ip : ips) {
+            ASSERT_EQ(tab.Find(ip, true), frozen.Find(ip, true)) << ip << " kernel " << static_cast<int>(k);
+            ASSERT_EQ(tab.Find(ip, true), frozen.Find(htonl(ip), false)) << ip;
+        }
+    }
+    FrozenRouteTable::SetKernel(FrozenRouteTable::Kernel::AUTO);
+}
+
+TEST(FrozenRouteTable, Find) {
+    RouteTable tab;
+    expect_same_find(tab, 1);
+    ASSERT_FALSE(FrozenRouteTable().Find(0, true));
+
+    ASSERT_TRUE(tab.Insert(IpRange{ 0xffffffff, 0xffffffff }));
+    expect_same_find(tab, 2);
+    ASSERT_TRUE(tab.Insert(IpRange{ 0, 0 }));
+    expect_same_find(tab, 3);
+
+    // Sizes around the node and the layer boundaries: 16 keys per node, 17 children per node.
+    for (size_t n : { 15, 16, 17, 272, 273, 4624, 4625, 20000 }) {
+        tab.Clear();
+        make_table(tab, n, static_cast<uint32_t>(n));
+        expect_same_find(tab, static_cast<uint32_t>(n));
+    }
+}
+
+TEST(FrozenRouteTable, Memory) {
+    RouteTable tab;
+    make_table(tab, 100000, 1);
+    FrozenRouteTable const frozen(tab);
+    double const per_range = static_cast<double>(frozen.GetMemoryUsage()) / frozen.GetCount();
+    ASSERT_LE(per_range, 8 * 1.1);
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include "mapped_route_table.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using yhb::RouteTable;
+using yhb::MappedRouteTable;
+using IpRange = RouteTable::IpRange;
+
+static const char SNAPSHOT_PATH[] = "test_mapped_route_table.snapshot";
+
+static void make_table(RouteTable & tab, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    while (tab.GetCount() < count) {
+        uint32_t const first = static_cast<uint32_t>(rng());
+        uint32_t const len = static_cast<uint32_t>(rng()) >> (16 + rng() % 16);
+        tab.Insert(IpRange{ first, first + len < first ? 0xffffffff : first + len });
+    }
+}
+
+static void expect_same_find(const RouteTable & tab, const MappedRouteTable & mapped, uint32_t seed) {
+    ASSERT_EQ(tab.GetCount(), mapped.GetCount());
+    ASSERT_TRUE(std::equal(tab.begin(), tab.end(), mapped.begin()));
+    std::vector<uint32_t> ips = { 0, 1, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff };
+    for (auto const & r : tab) {
+        for (uint32_t ip : { r.first - 1, r.first, r.first + 1, r.last - 1, r.last, r.last + 1 }) {
+            ips.push_back(ip);
+        }
+    }
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 10000; ++i) {
+        ips.push_back(static_cast<uint32_t>(rng()));
+    }
+    for (uint32_t ip : ips) {
+        ASSERT_EQ(tab.Find(ip, true), mapped.Find(ip, true)) << ip;
+        ASSERT_EQ(tab.Find(ip, true), mapped.Find(htonl(ip), false)) << ip;
+    }
+}
+
+static std::vector<char> read_file(const char * path) {
+    std::vector<char> data;
+    FILE * const fp = fopen(path, "rb");
+    if (fp != nullptr) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(fp);
+    }
+    return data;
+}
+
+static void write_file(const char * path, const std::vector<char> & data) {
+    FILE * const fp = fopen(path, "wb");
+    ASSERT_NE(nullptr, fp);
+    ASSERT_EQ(data.size(), fwrite(data.data(), 1, data.size(), fp));
+    fclose(fp);
+}
+
+TEST(MappedRouteTable, Find) {
+    RouteTable tab;
+    MappedRouteTable mapped;
+    ASSERT_FALSE(mapped.IsOpen());
+    ASSERT_FALSE(mapped.Find(0, true));
+
+    // Empty
+    ASSERT_TRUE(tab.SaveSnapshot(SNAPSHOT_PATH));
+    ASSERT_TRUE(mapped.Open(SNAPSHOT_PATH));
+    ASSERT_TRUE(mapped.IsOpen());
+    ASSERT_FALSE(mapped.HasIndex());
+    expect_same_find(tab, mapped, 1);
+
+    for (size_t n : { 1, 100, 20000 }) {
+        tab.Clear();
+        make_table(tab, n, static_cast<uint32_t>(n));
+        ASSERT_TRUE(tab.Insert(IpRange{ 0xffffffff, 0xffffffff }));
+
+        ASSERT_TRUE(tab.SaveSnapshot(SNAPSHOT_PATH));
+        ASSERT_TRUE(mapped.Open(SNAPSHOT_PATH));
+        ASSERT_FALSE(mapped.HasIndex());
+        expect_same_find(tab, mapped, static_cast<uint32_t>(n));
+
+        tab.Compile();
+        ASSERT_TRUE(tab.SaveSnapshot(SNAPSHOT_PATH));   // Replaces the file still mapped.
+        ASSERT_TRUE(mapped.Open(SNAPSHOT_PATH, false));
+        ASSERT_TRUE(mapped.HasIndex());
+        expect_same_find(tab, mapped, static_cast<uint32_t>(n));
+    }
+
+    mapped.Close();
+    ASSERT_FALSE(mapped.IsOpen());
+    ASSERT_EQ(0u, mapped.GetCount());
+    remove(SNAPSHOT_PATH);
+}
+
+TEST(MappedRouteTable, Invalid) {
+    MappedRouteTable mapped;
+    remove(SNAPSHOT_PATH);
+    ASSERT_FALSE(mapped.Open(SNAPSHOT_PATH));
+
+    RouteTable tab;
+    make_table(tab, 1000, 1);
+    tab.Compile();
+    ASSERT_TRUE(tab.SaveSnapshot(SNAPSHOT_PATH));
+    std::vector<char> const good = read_file(SNAPSHOT_PATH);
+    ASSERT_GT(good.size(), 64u);
+
+    // A corrupted byte of the ranges or the index is caught by the CRC of the payload.
+    for (size_t offset : { size_t(64), size_t(100), good.size() - 1 }) {
+        std::vector<char> bad = good;
+        bad[offset] ^= 1;
+        write_file(SNAPSHOT_PATH, bad);
+        ASSERT_FALSE(mapped.Open(SNAPSHOT_PATH, true)) << offset;
+        ASSERT_FALSE(mapped.IsOpen());
+    }
+
+    // The header is always checked.
+    for (size_t offset : { size_t(0), size_t(8), size_t(24), size_t(60) }) {
+        std::vector<char> bad = good;
+        bad[offset] ^= 1;
+        write_file(SNAPSHOT_PATH, bad);
+        ASSERT_FALSE(mapped.Open(SNAPSHOT_PATH, false)) << offset;
+    }
+
+    // Truncated
+    for (size_t size : { size_t(0), size_t(10), size_t(64), good.size() - 1 }) {
+        write_file(SNAPSHOT_PATH, std::vector<char>(good.begin(), good.begin() + size));
+        ASSERT_FALSE(mapped.Open(SNAPSHOT_PATH, false)) << size;
+    }
+
+    // Group indexes out of range in an index not verified, the blocks don't match instead of reading beyond.
+    uint64_t index_offset;
+    uint64_t group_count;
+    memcpy(&index_offset, &good[40], sizeof(index_offset));
+    memcpy(&group_count, &good[48], sizeof(group_count));
+    ASSERT_NE(0u, index_offset);
+    std::vector<char> bad = good;
+    uint32_t const entries[] = { static_cast<uint32_t>(2 + group_count), 0xffffffff };
+    for (size_t i = 0; i < 2; ++i) {
+        memcpy(&bad[index_offset + 0x0a0000 * sizeof(uint32_t) + i * sizeof(uint32_t)], &entries[i], sizeof(uint32_t));
+    }
+    write_file(SNAPSHOT_PATH, bad);
+    ASSERT_TRUE(mapped.Open(SNAPSHOT_PATH, false));
+    ASSERT_FALSE(mapped.Find(0x0a000000, true));
+    ASSERT_FALSE(mapped.Find(0x0a0001ff, true));
+    ASSERT_FALSE(mapped.Open(SNAPSHOT_PATH, true));
+
+    write_file(SNAPSHOT_PATH, good);
+    ASSERT_TRUE(mapped.Open(SNAPSHOT_PATH));
+    expect_same_find(tab, mapped, 1);
+    remove(SNAPSHOT_PATH);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include "packet_classifier.h"
+#include <random>
+#include <vector>
+
+using yhb::PacketClassifier;
+using yhb::RouteTable;
+using IpRange = RouteTable::IpRange;
+using Rule = PacketClassifier::Rule;
+using Packet = PacketClassifier::Packet;
+
+static PacketClassifier::PortRange const ANY_PORT = { 0, 0xffff };
+static PacketClassifier::ProtocolRange const ANY_PROTOCOL = { 0, 0xff };
+static PacketClassifier::ProtocolRange const TCP = { 6, 6 };
+static PacketClassifier::ProtocolRange const UDP = { 17, 17 };
+
+// Classify() both before and after Compile(), and by ClassifyBatch().
+static std::vector<uint32_t> classify_all(PacketClassifier & acl, const std::vector<Packet> & packets) {
+    std::vector<uint32_t> scanned;
+    for (const Packet & p : packets) {
+        scanned.push_back(acl.Classify(p));
+    }
+    acl.Compile();
+    EXPECT_TRUE(acl.IsCompiled());
+    std::vector<uint32_t> compiled;
+    for (const Packet & p : packets) {
+        compiled.push_back(acl.Classify(p));
+    }
+    std::vector<uint32_t> batch(packets.size());
+    acl.ClassifyBatch(packets.data(), packets.size(), batch.data());
+    EXPECT_EQ(scanned, compiled);
+    EXPECT_EQ(scanned, batch);
+    return compiled;
+}
+
+TEST(PacketClassifier, Basic) {
+    PacketClassifier acl;
+    Packet const web = { 0x0a000001, 0xc0a80001, 40000, 80, 6 };
+    ASSERT_EQ(PacketClassifier::NO_MATCH, acl.Classify(web));
+    acl.Compile();
+    ASSERT_EQ(PacketClassifier::NO_MATCH, acl.Classify(web));
+
+    ASSERT_FALSE(acl.AddRule(Rule{ IpRange{ 2, 1 }, IpRange{ 0, 0 }, ANY_PORT, ANY_PORT, ANY_PROTOCOL, 0, 1 }));
+    ASSERT_FALSE(acl.AddRule(Rule{ IpRange{ 0, 0 }, IpRange{ 0, 0 }, { 2, 1 }, ANY_PORT, ANY_PROTOCOL, 0, 1 }));
+    ASSERT_FALSE(acl.AddRule(Rule{ IpRange{ 0, 0 }, IpRange{ 0, 0 }, ANY_PORT, ANY_PORT, { 7, 6 }, 0, 1 }));
+    ASSERT_FALSE(acl.AddRule(Rule{ IpRange{ 0, 0 }, IpRange{ 0, 0 }, ANY_PORT, ANY_PORT, TCP, 0,
+        PacketClassifier::NO_MATCH }));
+    ASSERT_FALSE(acl.AddRule("10.0.0.0/33", "0.0.0.0/0", ANY_PORT, ANY_PORT, TCP, 0, 1));
+    ASSERT_EQ(0u, acl.GetRuleCount());
+
+    ASSERT_TRUE(acl.AddRule("0.0.0.0/0", "0.0.0.0/0", ANY_PORT, ANY_PORT, ANY_PROTOCOL, 100, 1));      // Default
+    ASSERT_TRUE(acl.AddRule("10.0.0.0/8", "192.168.0.0/16", ANY_PORT, { 80, 80 }, TCP, 10, 2));
+    ASSERT_TRUE(acl.AddRule("10.0.0.0/24", "192.168.0.0/24", { 1024, 65535 }, { 0, 1023 }, TCP, 20, 3));
+    ASSERT_TRUE(acl.AddRule("0.0.0.0/0", "192.168.0.1", ANY_PORT, { 53, 53 }, UDP, 10, 4));
+    ASSERT_TRUE(acl.AddRule("10.0.0.1", "0.0.0.0/0", ANY_PORT, { 53, 53 }, UDP, 10, 5));   // Tie, added later
+    ASSERT_FALSE(acl.IsCompiled());
+    ASSERT_EQ(5u, acl.GetRuleCount());
+
+    std::vector<Packet> const packets = {
+        web,
+        { 0x0a000001, 0xc0a80001, 40000, 443, 6 },
+        { 0x0a000001, 0xc0a80001, 53000, 53, 17 },
+        { 0x0a000002, 0xc0a80002, 53000, 53, 17 },
+        { 0x0b000001, 0xc0a80001, 40000, 80, 6 },
+        { 0x0a000001, 0xc0a80001, 40000, 80, 17 },
+    };
+    ASSERT_EQ((std::vector<uint32_t>{ 2, 3, 4, 1, 1, 1 }), classify_all(acl, packets));
+    ASSERT_GT(acl.Compile().memory_bytes, 0u);
+
+    acl.Clear();
+    ASSERT_FALSE(acl.IsCompiled());
+    ASSERT_EQ(PacketClassifier::NO_MATCH, acl.Classify(web));
+}
+
+// Checked against a scan of all the rules, the packets at the bounds of the rules and random ones.
+TEST(PacketClassifier, Random) {
+    std::mt19937 rng(1);
+    auto random_range = [&rng](uint32_t max_value, uint32_t wildcard_percent) {
+        uint32_t const dice = rng() % 100;
+        if (dice < wildcard_percent) {
+            return IpRange{ 0, max_value };
+        }
+        // A prefix, an exact value or any range, from a few bases so the rules overlap.
+        uint32_t const base = static_cast<uint32_t>(rng() % 64) * (max_value / 64 + 1);
+        if (dice % 3 == 0) {
+            unsigned const bits = rng() % 24;
+            uint32_t const mask = (uint32_t(1) << bits) - 1;
+            return IpRange{ base & ~mask, (base | mask) & max_value };
+        } else if (dice % 3 == 1) {
+            return IpRange{ base, base };
+        } else {
+            uint32_t const last = base + rng() % (max_value / 16 + 1);
+            return IpRange{ base, last > max_value || last < base ? max_value : last };
+        }
+    };
+
+    for (size_t count : { 1, 63, 64, 65, 500 }) {
+        PacketClassifier acl;
+        std::vector<Rule> rules;
+        for (size_t i = 0; i < count; ++i) {
+            IpRange const sp = random_range(0xffff, 70);
+            IpRange const dp = random_range(0xffff, 30);
+            IpRange const proto = random_range(0xff, 40);
+            Rule const rule = { random_range(0xffffffff, 20), random_range(0xffffffff, 20),
+                { static_cast<uint16_t>(sp.first), static_cast<uint16_t>(sp.last) },
+                { static_cast<uint16_t>(dp.first), static_cast<uint16_t>(dp.last) },
+                { static_cast<uint8_t>(proto.first), static_cast<uint8_t>(proto.last) },
+                static_cast<uint32_t>(rng() % 50), static_cast<uint32_t>(i) };
+            ASSERT_TRUE(acl.AddRule(rule));
+            rules.push_back(rule);
+        }
+
+        std::vector<Packet> packets;
+        for (const Rule & r : rules) {
+            for (int k = 0; k < 8; ++k) {
+                uint32_t const src = k & 1 ? r.src.last + (k & 2 ? 1 : 0) : r.src.first - (k & 2 ? 1 : 0);
+                uint32_t const dst = k & 4 ? r.dst.last : r.dst.first;
+                uint16_t const dport = static_cast<uint16_t>(k & 2 ? r.dst_port.last + 1 : r.dst_port.first);
+                packets.push_back(Packet{ src, dst, r.src_port.last, dport, r.protocol.first });
+            }
+            packets.push_back(Packet{ static_cast<uint32_t>(rng()), static_cast<uint32_t>(rng()),
+                static_cast<uint16_t>(rng()), static_cast<uint16_t>(rng()), static_cast<uint8_t>(rng()) });
+        }
+
+        std::vector<uint32_t> expected;
+        for (const Packet & p : packets) {
+            const Rule * best = nullptr;
+            for (const Rule & r : rules) {
+                bool const matched = r.src.first <= p.src && p.src <= r.src.last
+                    && r.dst.first <= p.dst && p.dst <= r.dst.last
+                    && r.src_port.first <= p.src_port && p.src_port <= r.src_port.last
+                    && r.dst_port.first <= p.dst_port && p.dst_port <= r.dst_port.last
+                    && r.protocol.first <= p.protocol && p.protocol <= r.protocol.last;
+                if (matched && (best == nullptr || r.priority < best->priority)) {
+                    best = &r;
+                }
+            }
+            expected.push_back(best == nullptr ? PacketClassifier::NO_MATCH : best->id);
+        }
+        ASSERT_EQ(expected, classify_all(acl, packets)) << count;
+    }
+}
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "packet_template.h"
+#include <vector>
+
+#ifdef __GNUC__
+#include <arpa/inet.h>
+#endif
+
+using yhb::Checksum;
+using yhb::L4Checksum;
+using yhb::UDPv4PacketTemplate;
+using yhb::TCPv4PacketTemplate;
+
+static const char TEMPLATE_UDP[] =
+    "\x45\x00\x00\x00\x00\x00\x40\x00\x40\x11\x00\x00\xc0\xa8\x11\x64"
+    "\x08\x08\x08\x08"
+    "\xe5\x9d\x00\x35\x00\x00\x00\x00";
+
+// TCP header with 4 bytes of options (MSS).
+static const char TEMPLATE_TCP[] =
+    "\x45\x00\x00\x00\x49\x5a\x40\x00\x80\x06\x00\x00\xc0\xa8\x11\x64"
+    "\xa1\x75\x44\xcc"
+    "\x04\x4a\x01\xbb\xf9\xe0\xf2\x70\x1d\x71\x88\x56\x60\x12\x03\xfd"
+    "\x00\x00\x00\x00\x02\x04\x05\xb4";
+
+// Build the packet the slow way: write all the fields, then calculate the checksums from scratch.
+static std::vector<char> build_reference(const char * header, size_t header_len, uint16_t id,
+    uint16_t src_port, uint32_t dst_addr, const std::vector<char> & payload)
+{
+    std::vector<char> packet(header, header + header_len);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    uint16_t const total = htons(static_cast<uint16_t>(packet.size()));
+    memcpy(&packet[2], &total, 2);
+    memcpy(&packet[4], &id, 2);
+    memcpy(&packet[16], &dst_addr, 4);
+    memcpy(&packet[20], &src_port, 2);
+    if (packet[9] == 17) {
+        uint16_t const udp_len = htons(static_cast<uint16_t>(packet.size() - 20));
+        memcpy(&packet[24], &udp_len, 2);
+    }
+    memset(&packet[10], 0, 2);
+    uint16_t const ip_checksum = ~Checksum::Calculate(&packet[0], 20);
+    memcpy(&packet[10], &ip_checksum, 2);
+    EXPECT_TRUE(L4Checksum::Update(&packet[0], packet.size()));
+    return packet;
+}
+
+template <typename Template>
+static void check_template(const char * header, size_t header_len) {
+    Template tpl(header, header_len);
+    ASSERT_TRUE(tpl.IsValid());
+    ASSERT_EQ(header_len, tpl.GetHeaderLength());
+
+    std::vector<char> payload;
+    std::vector<char> packet;
+    for (size_t len = 0; len < 300; len += 7) {
+        payload.resize(len);
+        for (size_t i = 0; i < len; ++i) {
+            payload[i] = static_cast<char>(i * 31 + len);
+        }
+        uint16_t const id = htons(static_cast<uint16_t>(len * 1000));
+        uint16_t const src_port = htons(static_cast<uint16_t>(40000 + len));
+        uint32_t const dst_addr = htonl(0x0a000000u + static_cast<uint32_t>(len));
+        std::vector<char> const expected = build_reference(header, header_len, id, src_port, dst_addr, payload);
+
+        // Copy the payload
+        packet.assign(header_len + len, 0);
+        tpl.Build(&packet[0])
+            .template Set16<Template::IP_ID>(id)
+            .template Set16<Template::SRC_PORT>(src_port)
+            .template Set32<Template::DST_ADDR>(dst_addr)
+            .Finish(payload.data(), len);
+        ASSERT_EQ(expected, packet) << len;
+        ASSERT_TRUE(L4Checksum::VerifyPacket(&packet[0], packet.size()));
+
+        // Payload already in place
+        packet.assign(header_len + len, 0);
+        if (len > 0) {
+            memcpy(&packet[header_len], payload.data(), len);
+        }
+        tpl.Build(&packet[0])
+            .template Set16<Template::IP_ID>(id)
+            .template Set16<Template::SRC_PORT>(src_port)
+            .template Set32<Template::DST_ADDR>(dst_addr)
+            .Finish(len, Checksum::Calculate(payload.data(), len));
+        ASSERT_EQ(expected, packet) << len;
+
+        // Fields set twice, the last values win
+        packet.assign(header_len + len, 0);
+        tpl.Build(&packet[0])
+            .template Set16<Template::IP_ID>(static_cast<uint16_t>(~id))
+            .template Set32<Template::DST_ADDR>(~dst_addr)
+            .template Set16<Template::IP_ID>(id)
+            .template Set16<Template::SRC_PORT>(src_port)
+            .template Set16<Template::SRC_PORT>(src_port)
+            .template Set32<Template::DST_ADDR>(dst_addr)
+            .Finish(payload.data(), len);
+        ASSERT_EQ(expected, packet) << len;
+        ASSERT_TRUE(L4Checksum::VerifyPacket(&packet[0], packet.size()));
+    }
+}
+
+TEST(PacketTemplateTest, Udp) {
+    check_template<UDPv4PacketTemplate>(TEMPLATE_UDP, sizeof(TEMPLATE_UDP) - 1);
+}
+
+TEST(PacketTemplateTest, Tcp) {
+    check_template<TCPv4PacketTemplate>(TEMPLATE_TCP, sizeof(TEMPLATE_TCP) - 1);
+}
+
+TEST(PacketTemplateTest, OddAddress) {
+    // Calculate() swaps the bytes of the sum given to it for a buffer at an odd address, so the sums of
+    // the template must not go through a buffer that may be placed at one.
+    uint8_t buf[6] = {};
+    uint8_t * const even = reinterpret_cast<uintptr_t>(buf) % 2 == 0 ? buf : buf + 1;
+    uint8_t * const odd = even + 3;
+    even[1] = 17;
+    odd[1] = 17;
+    ASSERT_NE(Checksum::Calculate(even, 2, 0x1234), Checksum::Calculate(odd, 2, 0x1234));
+
+    // The headers of the samples at an odd address make the same packets.
+    for (int protocol : { 6, 17 }) {
+        const char * const header = protocol == 6 ? TEMPLATE_TCP : TEMPLATE_UDP;
+        size_t const header_len = protocol == 6 ? sizeof(TEMPLATE_TCP) - 1 : sizeof(TEMPLATE_UDP) - 1;
+        std::vector<char> shifted(header_len + 1);
+        memcpy(&shifted[1], header, header_len);
+        if (protocol == 6) {
+            check_template<TCPv4PacketTemplate>(&shifted[1], header_len);
+        } else {
+            check_template<UDPv4PacketTemplate>(&shifted[1], header_len);
+        }
+    }
+}
+
+TEST(PacketTemplateTest, BeyondHeaders) {
+    // The TCP fields are beyond the 8-byte UDP header, in the payload, so they are not written.
+    size_t const header_len = sizeof(TEMPLATE_UDP) - 1;
+    UDPv4PacketTemplate tpl(TEMPLATE_UDP, header_len);
+    std::vector<char> const payload(32, 'x');
+    uint16_t const id = htons(1234);
+    uint16_t const src_port = htons(5353);
+    uint32_t const dst_addr = htonl(0x0a000001);
+    std::vector<char> const expected = build_reference(TEMPLATE_UDP, header_len, id, src_port, dst_addr, payload);
+
+    std::vector<char> packet(header_len + payload.size());
+    memcpy(&packet[header_len], payload.data(), payload.size());
+    tpl.Build(&packet[0])
+        .Set16<UDPv4PacketTemplate::IP_ID>(id)
+        .Set16<UDPv4PacketTemplate::TCP_WINDOW>(0xffff)
+        .Set32<UDPv4PacketTemplate::TCP_ACK>(0xffffffff)
+        .Set16<UDPv4PacketTemplate::SRC_PORT>(src_port)
+        .Set32<UDPv4PacketTemplate::DST_ADDR>(dst_addr)
+        .Finish(payload.size(), Checksum::Calculate(payload.data(), payload.size()));
+    ASSERT_EQ(expected, packet);
+}
+
+TEST(PacketTemplateTest, Invalid) {
+    // Truncated
+    ASSERT_FALSE(UDPv4PacketTemplate(TEMPLATE_UDP, 27).IsValid());
+    ASSERT_FALSE(TCPv4PacketTemplate(TEMPLATE_TCP, 40).IsValid());
+
+    // IPv4 options
+    char header[sizeof(TEMPLATE_UDP)];
+    memcpy(header, TEMPLATE_UDP, sizeof(header));
+    header[0] = 0x46;
+    ASSERT_FALSE(UDPv4PacketTemplate(header, sizeof(header)).IsValid());
+
+    // Bad TCP data offset
+    char tcp[sizeof(TEMPLATE_TCP)];
+    memcpy(tcp, TEMPLATE_TCP, sizeof(tcp));
+    tcp[32] = 0x40;
+    ASSERT_FALSE(TCPv4PacketTemplate(tcp, sizeof(tcp)).IsValid());
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "rcu_holder.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using yhb::RcuHolder;
+using yhb::RouteTable;
+using yhb::RouteTableHolder;
+
+TEST(RcuHolder, RouteTable) {
+    RouteTableHolder holder;
+    ASSERT_TRUE(holder.Read()->IsEmpty());
+
+    std::unique_ptr<RouteTable> tab(new RouteTable());
+    ASSERT_TRUE(tab->Insert("10.0.0.0/8"));
+    holder.Publish(std::unique_ptr<const RouteTable>(tab.release()));
+    {
+        RouteTableHolder::ReadGuard const guard = holder.Read();
+        ASSERT_TRUE(guard->Find(0x0a010203, true));
+        ASSERT_FALSE(guard->Find(0x0b010203, true));
+    }
+
+    RouteTable copy = *holder.Read();
+    ASSERT_TRUE(copy.Insert("11.0.0.0/8"));
+    holder.Publish(copy);
+    ASSERT_TRUE(holder.Read()->Find(0x0b010203, true));
+}
+
+// Poisoned when destroyed, so a reader of a freed object is likely to notice.
+struct Generation {
+    explicit Generation(uint64_t n) : values(64, n), alive(0x600d) {}
+    ~Generation() {
+        alive = 0xdead;
+        std::fill(values.begin(), values.end(), ~uint64_t(0));
+    }
+    std::vector<uint64_t> values;
+    uint32_t alive;
+};
+
+TEST(RcuHolder, Concurrent) {
+    RcuHolder<Generation> holder(std::unique_ptr<const Generation>(new Generation(0)));
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> errors(0);
+    std::atomic<uint64_t> reads(0);
+    // Each publish waits for the readers preempted in their guards, a time slice each with few CPUs, so the
+    // counts are scaled down on the small machines.
+    unsigned const cpus = std::thread::hardware_concurrency();
+    unsigned const reader_count = cpus > 4 ? 4 : 2;
+    uint64_t const publish_count = cpus > 4 ? 300 : cpus > 1 ? 100 : 10;
+    std::vector<std::thread> readers;
+    for (unsigned t = 0; t < reader_count; ++t) {
+        readers.emplace_back([&] {
+            uint64_t last_seen = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                RcuHolder<Generation>::ReadGuard const g = holder.Read();
+                uint64_t const n = g->values[0];
+                // The generations only go forward, and an object is not changed while read.
+                if (g->alive != 0x600d || n < last_seen) {
+                    ++errors;
+                }
+                for (uint64_t v : g->values) {
+                    if (v != n) {
+                        ++errors;
+                    }
+                }
+                last_seen = n;
+                ++reads;
+            }
+        });
+    }
+    while (reads.load() == 0) {
+        std::this_thread::yield();
+    }
+    for (uint64_t n = 1; n <= publish_count; ++n) {
+        holder.Publish(std::unique_ptr<const Generation>(new Generation(n)));
+    }
+    stop = true;
+    for (auto & t : readers) {
+        t.join();
+    }
+    ASSERT_EQ(0u, errors.load());
+    ASSERT_GT(reads.load(), 0u);
+    ASSERT_EQ(publish_count, holder.Read()->values[0]);
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include "route_map.h"
+#include <arpa/inet.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using yhb::RouteMap;
+
+struct Prefix {
+    uint32_t prefix;    // By host bits order
+    unsigned bits;
+    int value;
+};
+
+// The value of the longest prefix by checking all of them.
+static const int * brute_force_find(const std::vector<Prefix> & prefixes, uint32_t ip) {
+    const int * result = nullptr;
+    int best = -1;
+    for (auto const & p : prefixes) {
+        uint32_t const mask = p.bits == 0 ? 0 : uint32_t(-1) << (32 - p.bits);
+        if ((ip & mask) == p.prefix && static_cast<int>(p.bits) > best) {
+            best = static_cast<int>(p.bits);
+            result = &p.value;
+        }
+    }
+    return result;
+}
+
+static void expect_same_find(const RouteMap<int> & map, const std::vector<Prefix> & prefixes, uint32_t seed) {
+    std::vector<uint32_t> ips = { 0, 1, 0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff };
+    for (auto const & p : prefixes) {
+        uint32_t const last = p.prefix | (p.bits == 0 ? 0xffffffff : ~(uint32_t(-1) << (32 - p.bits)));
+        for (uint32_t ip : { p.prefix - 1, p.prefix, p.prefix + 1, last - 1, last, last + 1 }) {
+            ips.push_back(ip);
+        }
+    }
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 2000; ++i) {
+        ips.push_back(static_cast<uint32_t>(rng()));
+    }
+    for (uint32_t ip : ips) {
+        const int * const expected = brute_force_find(prefixes, ip);
+        const int * const actual = map.Find(ip, true);
+        ASSERT_EQ(expected == nullptr, actual == nullptr) << ip;
+        if (expected != nullptr) {
+            ASSERT_EQ(*expected, *actual) << ip;
+        }
+        ASSERT_EQ(actual, map.Find(htonl(ip), false));
+    }
+}
+
+TEST(RouteMap, Find) {
+    RouteMap<std::string> map;
+    ASSERT_EQ(nullptr, map.Find(0, true));
+    ASSERT_FALSE(map.Insert("10.0.0.0/33", "bad"));
+    ASSERT_FALSE(map.Insert("10.0.0", "bad"));
+    ASSERT_TRUE(map.Insert("10.0.0.0/8", "a"));
+    ASSERT_TRUE(map.Insert("10.1.0.0/16", "b"));
+    ASSERT_TRUE(map.Insert("10.1.2.3", "c"));
+    ASSERT_TRUE(map.Insert("10.1.2.128/25", "d"));
+    ASSERT_EQ(4u, map.GetCount());
+
+    for (int pass = 0; pass < 2; ++pass) {
+        ASSERT_EQ("a", *map.Find(0x0a000001, true));
+        ASSERT_EQ("b", *map.Find(0x0a010001, true));
+        ASSERT_EQ("c", *map.Find(0x0a010203, true));
+        ASSERT_EQ("b", *map.Find(0x0a010204, true));
+        ASSERT_EQ("d", *map.Find(0x0a0102ff, true));
+        ASSERT_EQ("d", *map.Find(htonl(0x0a010280), false));
+        ASSERT_EQ(nullptr, map.Find(0x0b000000, true));
+        map.Compile();
+        ASSERT_TRUE(map.IsCompiled());
+    }
+
+    // Replacing the value of the same prefix, the host bits are ignored.
+    ASSERT_TRUE(map.Insert("10.1.255.255/16", "e"));
+    ASSERT_FALSE(map.IsCompiled());
+    ASSERT_EQ(4u, map.GetCount());
+    ASSERT_EQ("e", *map.Find(0x0a010001, true));
+
+    ASSERT_TRUE(map.Erase(htonl(0x0a010000), 16));
+    ASSERT_FALSE(map.Erase(htonl(0x0a010000), 16));
+    ASSERT_EQ(3u, map.GetCount());
+    ASSERT_EQ("a", *map.Find(0x0a010001, true));
+
+    ASSERT_TRUE(map.Insert("0.0.0.0/0", "default"));
+    map.Compile();
+    ASSERT_EQ("default", *map.Find(0xffffffff, true));
+    ASSERT_EQ("c", *map.Find(0x0a010203, true));
+
+    size_t n = 0;
+    map.ForEach([&n](const RouteMap<std::string>::CIDR & cidr, const std::string & value) {
+        if (value == "d") {
+            ASSERT_EQ(htonl(0x0a010280), cidr.prefix);
+            ASSERT_EQ(25u, cidr.network_bits);
+        }
+        ++n;
+    });
+    ASSERT_EQ(4u, n);
+
+    map.Clear();
+    ASSERT_TRUE(map.IsEmpty());
+    ASSERT_EQ(nullptr, map.Find(0, true));
+}
+
+TEST(RouteMap, Compile) {
+    std::mt19937 rng(1);
+    RouteMap<int> map;
+    std::vector<Prefix> prefixes;
+    for (int i = 0; i < 3000; ++i) {
+        // Clustered, so that the prefixes nest.
+        unsigned const bits = i == 0 ? 0 : static_cast<unsigned>(1 + rng() % 32);
+        uint32_t const mask = bits == 0 ? 0 : uint32_t(-1) << (32 - bits);
+        uint32_t const prefix = (0x0a000000 | (static_cast<uint32_t>(rng()) & 0x000fffff)) & mask;
+        bool duplicated = false;
+        for (auto & p : prefixes) {
+            if (p.prefix == prefix && p.bits == bits) {
+                p.value = i;
+                duplicated = true;
+            }
+        }
+        if (!duplicated) {
+            prefixes.push_back(Prefix{ prefix, bits, i });
+        }
+        ASSERT_TRUE(map.Insert(htonl(prefix), bits, i));
+    }
+    ASSERT_EQ(prefixes.size(), map.GetCount());
+    expect_same_find(map, prefixes, 1);
+
+    RouteMap<int> compiled = map;
+    RouteMap<int>::CompileStats const stats = compiled.Compile();
+    ASSERT_GT(stats.group_count, 0u);
+    expect_same_find(compiled, prefixes, 2);
+    ASSERT_FALSE(map.IsCompiled());
+}
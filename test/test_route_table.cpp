@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include "route_table.h"
 #include <arpa/inet.h>
+#include <random>
+#include <algorithm>
+#include <iterator>
 
 namespace yhb {
 
@@ -223,4 +226,542 @@ TEST(CIDR, Convert) {
     });
 }
 
+
+// Random ranges of various sizes, some are adjacent to the /24 boundaries.
+static void insert_random_ranges(RouteTable & tab, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t const first = rng();
+        uint32_t const len = rng() >> (8 + rng() % 24);
+        IpRange r{ first, first + len < first ? 0xffffffff : first + len };
+        if (i % 8 == 0) {
+            r.first &= ~0xffu;
+        }
+        tab.Insert(r);
+    }
+}
+
+static void expect_same_find(const RouteTable & compiled, const RouteTable & plain, uint32_t seed) {
+    ASSERT_TRUE(compiled.IsCompiled());
+    ASSERT_FALSE(plain.IsCompiled());
+    for (auto const & r : plain) {
+        for (uint32_t ip : { r.first - 1, r.first, r.first + 1, r.last - 1, r.last, r.last + 1 }) {
+            ASSERT_EQ(plain.Find(ip, true), compiled.Find(ip, true)) << ip;
+            ASSERT_EQ(plain.Find(htonl(ip), false), compiled.Find(htonl(ip), false)) << ip;
+        }
+    }
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t const ip = rng();
+        ASSERT_EQ(plain.Find(ip, true), compiled.Find(ip, true)) << ip;
+    }
+}
+
+TEST(CIDR, Compile) {
+    RouteTable tab;
+    RouteTable::CompileStats stats = tab.Compile();
+    ASSERT_TRUE(tab.IsCompiled());
+    ASSERT_EQ(0, stats.group_count);
+    ASSERT_EQ(64u << 20, stats.memory_bytes);
+    ASSERT_FALSE(tab.Find(0, true));
+    ASSERT_FALSE(tab.Find(0xffffffff, true));
+
+    insert_random_ranges(tab, 20000, 1);
+    ASSERT_FALSE(tab.IsCompiled());     // Dropped by Insert()
+    RouteTable compiled = tab;
+    stats = compiled.Compile();
+    ASSERT_LT(0, stats.group_count);
+    ASSERT_EQ((64u << 20) + stats.group_count * 32, stats.memory_bytes);
+    expect_same_find(compiled, tab, 2);
+
+    // Whole and single address ranges at both ends.
+    tab.Clear();
+    ASSERT_TRUE(tab.Insert(IpRange{ 0, 0 }));
+    ASSERT_TRUE(tab.Insert(IpRange{ 0xffffffff, 0xffffffff }));
+    ASSERT_TRUE(tab.Insert(IpRange{ 0x01020300, 0x010203ff }));
+    compiled = tab;
+    stats = compiled.Compile();
+    ASSERT_EQ(2, stats.group_count);
+    expect_same_find(compiled, tab, 3);
+    compiled.Insert(IpRange{ 0, 0xffffffff });
+    ASSERT_FALSE(compiled.IsCompiled());
+    compiled.Compile();
+    ASSERT_TRUE(compiled.Find(0x12345678, true));
+    compiled.Clear();
+    ASSERT_FALSE(compiled.IsCompiled());
+}
+
+
+static void expect_same_find_batch(const RouteTable & tab, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> ips(1000);
+    for (size_t i = 0; i < ips.size(); ++i) {
+        auto const & r = *(tab.begin() + rng() % tab.GetCount());
+        uint32_t const candidates[] = { static_cast<uint32_t>(rng()), r.first, r.last, r.first - 1, r.last + 1 };
+        ips[i] = candidates[i % 5];
+    }
+    std::vector<uint32_t> net_ips(ips.size());
+    for (size_t i = 0; i < ips.size(); ++i) {
+        net_ips[i] = htonl(ips[i]);
+    }
+    for (size_t n : { 0, 1, 7, 15, 16, 17, 33, 1000 }) {
+        std::vector<uint8_t> out(n + 1, 0xcc);
+        tab.FindBatch(ips.data(), n, true, out.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(tab.Find(ips[i], true), out[i] == 1) << ips[i];
+        }
+        ASSERT_EQ(0xcc, out[n]);
+        std::fill(out.begin(), out.end(), 0xcc);
+        tab.FindBatch(net_ips.data(), n, false, out.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(tab.Find(ips[i], true), out[i] == 1) << ips[i];
+        }
+        ASSERT_EQ(0xcc, out[n]);
+    }
+}
+
+TEST(CIDR, FindBatch) {
+    RouteTable tab;
+    uint32_t ip = 0x01020304;
+    uint8_t result = 0xcc;
+    tab.FindBatch(&ip, 1, true, &result);
+    ASSERT_EQ(0, result);
+
+    ASSERT_TRUE(tab.Insert(IpRange{ 0xffffff00, 0xffffffff }));
+    expect_same_find_batch(tab, 1);
+    ASSERT_TRUE(tab.Insert(IpRange{ 0, 0 }));
+    expect_same_find_batch(tab, 2);
+
+    insert_random_ranges(tab, 5000, 3);
+    expect_same_find_batch(tab, 4);
+    tab.Compile();
+    expect_same_find_batch(tab, 5);
+}
+
+
+static void expect_same_table(const RouteTable & expected, const RouteTable & actual) {
+    ASSERT_EQ(expected.GetCount(), actual.GetCount());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(), actual.begin()));
+}
+
+TEST(CIDR, BulkInsert) {
+    std::mt19937 rng(7);
+    std::vector<IpRange> ranges;
+    for (int i = 0; i < 300000; ++i) {
+        uint32_t const first = static_cast<uint32_t>(rng());
+        uint32_t const len = static_cast<uint32_t>(rng()) >> (12 + rng() % 20);
+        ranges.push_back(IpRange{ first, first + len < first ? 0xffffffff : first + len });
+    }
+    ranges.push_back(IpRange{ 10, 9 });     // Invalid
+    ranges.push_back(IpRange{ 0xffffffff, 0xffffffff });
+    ranges.push_back(IpRange{ 0, 0 });
+
+    // Existing contents, then the rest by Insert() and by BulkInsert().
+    RouteTable expected;
+    insert_random_ranges(expected, 1000, 8);
+    RouteTable actual = expected;
+    for (size_t n : { 0, 1, 100, 5000, 300003 }) {
+        for (size_t i = 0; i < n; ++i) {
+            expected.Insert(ranges[i]);
+        }
+        RouteTable serial = actual;
+        ASSERT_EQ(n == 300003 ? n - 1 : n, serial.BulkInsert(ranges.data(), n, 1));
+        expect_same_table(expected, serial);
+        // Sorted in chunks, the odd count of chunks leaves one unpaired in the merging rounds.
+        RouteTable parallel = actual;
+        parallel.BulkInsert(ranges.data(), n, 3);
+        expect_same_table(expected, parallel);
+        actual = expected;
+    }
+
+    std::vector<CIDR> cidrs;
+    RouteTable by_insert;
+    for (int i = 0; i < 20000; ++i) {
+        CIDR const c{ static_cast<uint32_t>(rng()), static_cast<uint32_t>(rng() % 34) };
+        cidrs.push_back(c);
+        by_insert.Insert(c.prefix, c.network_bits);
+    }
+    cidrs.push_back(CIDR{ 0, 0 });
+    by_insert.Insert(0, 0);
+    RouteTable bulk;
+    bulk.Compile();
+    ASSERT_LT(0, bulk.BulkInsert(cidrs.data(), cidrs.size()));
+    ASSERT_FALSE(bulk.IsCompiled());
+    expect_same_table(by_insert, bulk);
+    ASSERT_EQ(1, bulk.GetCount());
+}
+
+
+TEST(CIDR, Parse) {
+    RouteTable tab;
+    for (const char * s : { "01.2.3.4", "1.2.3.256", "1.2.3", "1.2.3.4.5", "1.2.3.4/", "1.2.3.4/033",
+            "1.2.3.4/-1", "1.2.3.4/ ", "1.2.3.4/8 ", "1.2.3.4/8x", " 1.2.3.4", "1.2.3.4 ", "1..2.3", "1.2.3.4/8/8",
+            "", "1.2.3.1000", "1.2.3.4/99999999999999999999" }) {
+        ASSERT_FALSE(tab.Insert(s)) << s;
+    }
+    ASSERT_TRUE(tab.IsEmpty());
+    ASSERT_TRUE(tab.Insert("255.255.255.255/32"));
+    ASSERT_TRUE(tab.Insert("0.0.0.0"));
+    ASSERT_TRUE(tab.Insert("10.0.0.0/08"));
+    ASSERT_EQ(3, tab.GetCount());
+    ASSERT_EQ((IpRange{ 0x0a000000, 0x0affffff }), *(tab.begin() + 1));
+    ASSERT_TRUE(tab.Insert("0.0.0.0/0"));
+    ASSERT_EQ(1, tab.GetCount());
+
+    // The network bits are parsed by strtol(), the same as the earlier versions.
+    for (const char * s : { "1.2.3.0/024", "1.2.3.0/+24", "1.2.3.0/ 24", "1.2.3.0/\t24", "1.2.3.0/0000024" }) {
+        RouteTable::CIDR cidr;
+        ASSERT_TRUE(RouteTable::ParseCIDR(s, cidr)) << s;
+        ASSERT_EQ(24u, cidr.network_bits) << s;
+    }
+    tab.Clear();
+    ASSERT_TRUE(tab.Insert("1.2.3.0/024"));
+    ASSERT_TRUE(tab.Erase("1.2.3.0/+25"));
+    ASSERT_EQ((std::vector<IpRange>{ { 0x01020380, 0x010203ff } }), std::vector<IpRange>(tab.begin(), tab.end()));
+
+    // The lines of a list are stricter.
+    size_t errors = 0;
+    ASSERT_EQ(0u, tab.LoadFromBuffer("1.2.3.0/024\n1.2.3.0/+24\n", 24, [&errors](size_t, const std::string &) {
+        ++errors;
+    }));
+    ASSERT_EQ(2u, errors);
+}
+
+TEST(CIDR, Load) {
+    static const char TEXT[] =
+        "# Blocklist\n"
+        "\n"
+        "1.2.3.4\n"
+        "  10.0.0.0/8   # private\r\n"
+        "192.168.1.10 - 192.168.1.20\n"
+        "192.168.1.21-192.168.1.30\r\n"
+        "bad line\n"
+        "1.2.3.4/33\n"
+        "\t\r\n"
+        "5.6.7.8-5.6.7.7\n"
+        "172.16.0.1/12";
+    std::vector<std::pair<size_t, std::string>> errors;
+    auto const on_error = [&errors](size_t line_number, const std::string & line) {
+        errors.emplace_back(line_number, line);
+    };
+
+    RouteTable tab;
+    ASSERT_TRUE(tab.Insert("1.2.3.5"));
+    ASSERT_EQ(5, tab.LoadFromBuffer(TEXT, sizeof(TEXT) - 1, on_error));
+    ASSERT_EQ(3, errors.size());
+    ASSERT_EQ((std::pair<size_t, std::string>(7, "bad line")), errors[0]);
+    ASSERT_EQ((std::pair<size_t, std::string>(8, "1.2.3.4/33")), errors[1]);
+    ASSERT_EQ((std::pair<size_t, std::string>(10, "5.6.7.8-5.6.7.7")), errors[2]);
+
+    RouteTable expected;
+    ASSERT_TRUE(expected.Insert("1.2.3.5"));
+    ASSERT_TRUE(expected.Insert("1.2.3.4"));
+    ASSERT_TRUE(expected.Insert("10.0.0.0/8"));
+    ASSERT_TRUE(expected.Insert(IpRange{ 0xc0a8010a, 0xc0a8011e }));
+    ASSERT_TRUE(expected.Insert("172.16.0.0/12"));
+    expect_same_table(expected, tab);
+
+    // A file larger than the chunks read at once, no line break at the end.
+    std::string text;
+    std::mt19937 rng(9);
+    expected.Clear();
+    char line[64];
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t const ip = static_cast<uint32_t>(rng());
+        unsigned const bits = 16 + rng() % 17;
+        snprintf(line, sizeof(line), "%u.%u.%u.%u/%u%s", ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+            bits, i % 1000 == 0 ? " # comment" : "");
+        text += text.empty() ? "" : "\n";
+        text += line;
+        ASSERT_TRUE(expected.Insert(htonl(ip), bits));
+    }
+    text += "\n1.2.3.4/xx";
+    char const path[] = "test_route_table_load.txt";
+    FILE * fp = fopen(path, "wb");
+    ASSERT_NE(nullptr, fp);
+    ASSERT_EQ(text.size(), fwrite(text.data(), 1, text.size(), fp));
+    fclose(fp);
+
+    errors.clear();
+    tab.Clear();
+    size_t loaded = 0;
+    ASSERT_TRUE(tab.LoadFromFile(path, on_error, &loaded));
+    remove(path);
+    ASSERT_EQ(100000, loaded);
+    ASSERT_EQ(1, errors.size());
+    ASSERT_EQ((std::pair<size_t, std::string>(100001, "1.2.3.4/xx")), errors[0]);
+    expect_same_table(expected, tab);
+
+    ASSERT_FALSE(tab.LoadFromFile("no/such/file.txt"));
+    expect_same_table(expected, tab);
+}
+
+// Sorted and merged, as built by Insert().
+static void expect_canonical(const RouteTable & tab) {
+    for (auto it = tab.begin(); it != tab.end(); ++it) {
+        ASSERT_TRUE(*it);
+        if (it != tab.begin()) {
+            ASSERT_TRUE(it[-1].last != 0xffffffff && it[-1].last + 1 < it->first);
+        }
+    }
+}
+
+template <typename Op>
+static void expect_combined(const RouteTable & a, const RouteTable & b, const RouteTable & result, Op op) {
+    expect_canonical(result);
+    std::vector<uint32_t> ips = { 0, 0xffffffff };
+    for (const RouteTable * tab : { &a, &b }) {
+        for (auto const & r : *tab) {
+            for (uint32_t ip : { r.first - 1, r.first, r.last, r.last + 1 }) {
+                ips.push_back(ip);
+            }
+        }
+    }
+    for (uint32_t ip : ips) {
+        ASSERT_EQ(op(a.Find(ip, true), b.Find(ip, true)), result.Find(ip, true)) << ip;
+    }
+}
+
+TEST(CIDR, SetAlgebra) {
+    auto const op_union = [](bool in_a, bool in_b) { return in_a || in_b; };
+    auto const op_intersection = [](bool in_a, bool in_b) { return in_a && in_b; };
+    auto const op_difference = [](bool in_a, bool in_b) { return in_a && !in_b; };
+    auto const op_complement = [](bool in_a, bool) { return !in_a; };
+
+    RouteTable empty;
+    RouteTable full;
+    ASSERT_TRUE(full.Insert(IpRange{ 0, 0xffffffff }));
+    RouteTable edges;
+    ASSERT_TRUE(edges.Insert(IpRange{ 0, 10 }));
+    ASSERT_TRUE(edges.Insert(IpRange{ 0xfffffff0, 0xffffffff }));
+
+    std::vector<RouteTable> tables = { empty, full, edges, RouteTable(), RouteTable() };
+    insert_random_ranges(tables[3], 3000, 1);
+    insert_random_ranges(tables[4], 3000, 2);
+    for (auto const & a : tables) {
+        expect_combined(a, empty, RouteTable::Complement(a), op_complement);
+        RouteTable inverted = a;
+        inverted.Invert();
+        expect_same_table(RouteTable::Complement(a), inverted);
+        inverted.Invert();
+        expect_same_table(a, inverted);
+
+        for (auto const & b : tables) {
+            RouteTable const u = RouteTable::Union(a, b);
+            RouteTable const i = RouteTable::Intersection(a, b);
+            RouteTable const d = RouteTable::Difference(a, b);
+            expect_combined(a, b, u, op_union);
+            expect_combined(a, b, i, op_intersection);
+            expect_combined(a, b, d, op_difference);
+
+            // The same as inserting the ranges one by one.
+            RouteTable inserted = a;
+            for (auto const & r : b) {
+                inserted.Insert(r);
+            }
+            expect_same_table(inserted, u);
+
+            // In place, not reallocated if the capacity is enough.
+            RouteTable t = a;
+            t.UnionWith(b);
+            expect_same_table(u, t);
+            t = a;
+            t.IntersectWith(b);
+            expect_same_table(i, t);
+            t = a;
+            t.Subtract(b);
+            expect_same_table(d, t);
+        }
+    }
+
+    RouteTable t = tables[3];
+    t.Compile();
+    t.Subtract(t);
+    ASSERT_TRUE(t.IsEmpty());
+    ASSERT_FALSE(t.IsCompiled());
+    t = tables[3];
+    t.UnionWith(t);
+    expect_same_table(tables[3], t);
+    t.IntersectWith(t);
+    expect_same_table(tables[3], t);
+
+    t.Invert();
+    t.Invert();     // Now the capacity is enough.
+    const IpRange * const data = &*t.begin();
+    t.UnionWith(RouteTable());
+    t.Invert();
+    ASSERT_EQ(data, &*t.begin());
+}
+
+
+// The largest CIDR at each step, found bit by bit.
+static std::vector<CIDR> naive_cidrs(uint32_t first, uint32_t last) {
+    std::vector<CIDR> result;
+    uint64_t from = first;
+    while (from <= last) {
+        unsigned host_bits = 0;
+        while (host_bits < 32 && (from & ((uint64_t(2) << host_bits) - 1)) == 0
+            && from + (uint64_t(2) << host_bits) - 1 <= last)
+        {
+            ++host_bits;
+        }
+        result.push_back(CIDR{ htonl(static_cast<uint32_t>(from)), 32 - host_bits });
+        from += uint64_t(1) << host_bits;
+    }
+    return result;
+}
+
+TEST(CIDR, ExportCIDRs) {
+    std::mt19937 rng(1);
+    for (int i = 0; i < 20000; ++i) {
+        uint32_t const first = i % 4 == 0 ? rng() & ~0xffffu : rng();
+        uint32_t const last = i % 3 == 0 ? 0xffffffff : first + (rng() >> (rng() % 32));
+        IpRange const range{ first, last < first ? 0xffffffff : last };
+        std::vector<CIDR> callback;
+        range.ToCIDR([&callback](CIDR cidr) {
+            callback.push_back(cidr);
+        });
+        std::vector<CIDR> inlined;
+        range.ForEachCIDR([&inlined](CIDR cidr) {
+            inlined.push_back(cidr);
+        });
+        ASSERT_EQ(naive_cidrs(range.first, range.last), inlined) << range.first << " - " << range.last;
+        ASSERT_EQ(inlined, callback);
+    }
+    std::vector<CIDR> whole;
+    IpRange{ 0, 0xffffffff }.ForEachCIDR([&whole](CIDR cidr) {
+        whole.push_back(cidr);
+    });
+    ASSERT_EQ((std::vector<CIDR>{ { 0, 0 } }), whole);
+    IpRange{ 2, 1 }.ForEachCIDR([](CIDR) {
+        FAIL();
+    });
+
+    // The CIDRs make the same table.
+    RouteTable tab;
+    ASSERT_EQ(0u, tab.CountCIDRs());
+    insert_random_ranges(tab, 3000, 1);
+    ASSERT_TRUE(tab.Insert(IpRange{ 0xfffffff0, 0xffffffff }));
+    std::vector<CIDR> cidrs(tab.CountCIDRs());
+    ASSERT_EQ(cidrs.data() + cidrs.size(), tab.ExportCIDRs(cidrs.data()));
+    std::vector<CIDR> appended;
+    tab.ExportCIDRs(std::back_inserter(appended));
+    ASSERT_EQ(cidrs, appended);
+    RouteTable rebuilt;
+    ASSERT_EQ(cidrs.size(), rebuilt.BulkInsert(cidrs.data(), cidrs.size()));
+    expect_same_table(tab, rebuilt);
+}
+
+
+TEST(CIDR, Erase) {
+    RouteTable tab;
+    ASSERT_TRUE(tab.Insert(IpRange{ 100, 200 }));
+    ASSERT_TRUE(tab.Insert(IpRange{ 300, 400 }));
+    ASSERT_TRUE(tab.Insert(IpRange{ 500, 600 }));
+    RouteTable expected = tab;
+
+    ASSERT_FALSE(tab.Erase(IpRange{ 2, 1 }));
+    ASSERT_FALSE(tab.Erase(0, 33));
+    ASSERT_FALSE(tab.Erase("1.2.3.4/"));
+    ASSERT_TRUE(tab.Erase(IpRange{ 201, 299 }));        // Nothing removed
+    expect_same_table(expected, tab);
+
+    ASSERT_TRUE(tab.Erase(IpRange{ 150, 160 }));        // Split
+    ASSERT_TRUE(tab.Erase(IpRange{ 390, 510 }));        // Trimmed at both sides
+    ASSERT_TRUE(tab.Erase(IpRange{ 100, 100 }));
+    ASSERT_TRUE(tab.Erase(IpRange{ 600, 600 }));
+    ASSERT_EQ((std::vector<IpRange>{ { 101, 149 }, { 161, 200 }, { 300, 389 }, { 511, 599 } }),
+        std::vector<IpRange>(tab.begin(), tab.end()));
+    ASSERT_TRUE(tab.Erase(IpRange{ 0, 300 }));
+    ASSERT_EQ((std::vector<IpRange>{ { 301, 389 }, { 511, 599 } }), std::vector<IpRange>(tab.begin(), tab.end()));
+
+    tab.Clear();
+    ASSERT_TRUE(tab.Insert(IpRange{ 0, 0xffffffff }));
+    tab.Compile();
+    ASSERT_TRUE(tab.Erase("1.2.3.0/24"));
+    ASSERT_FALSE(tab.IsCompiled());
+    ASSERT_TRUE(tab.Erase(htonl(0xff000000), 8));
+    ASSERT_EQ((std::vector<IpRange>{ { 0, 0x010202ff }, { 0x01020400, 0xfeffffff } }),
+        std::vector<IpRange>(tab.begin(), tab.end()));
+    ASSERT_TRUE(tab.Erase(IpRange{ 0, 0xffffffff }));
+    ASSERT_TRUE(tab.IsEmpty());
+
+    // The same as the difference.
+    RouteTable a;
+    insert_random_ranges(a, 3000, 1);
+    RouteTable b;
+    insert_random_ranges(b, 3000, 2);
+    RouteTable erased = a;
+    for (auto const & r : b) {
+        ASSERT_TRUE(erased.Erase(r));
+    }
+    expect_canonical(erased);
+    expect_same_table(RouteTable::Difference(a, b), erased);
+}
+
+// Random changes, most of them are small and near the existing ranges.
+static std::vector<IpRange> random_delta(const RouteTable & tab, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<IpRange> delta;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t first = rng();
+        if (!tab.IsEmpty() && i % 4 != 0) {
+            auto const & r = tab.begin()[rng() % tab.GetCount()];
+            first = (i % 2 == 0 ? r.first : r.last) + rng() % 512 - 256;
+        }
+        uint32_t const len = rng() >> (12 + rng() % 20);
+        delta.push_back(IpRange{ first, first + len < first ? 0xffffffff : first + len });
+    }
+    delta.push_back(IpRange{ 5, 1 });   // Invalid, skipped
+    return delta;
+}
+
+TEST(CIDR, ApplyDelta) {
+    std::vector<RouteTable> tables(3);
+    ASSERT_TRUE(tables[1].Insert(IpRange{ 0, 0xffffffff }));
+    insert_random_ranges(tables[2], 20000, 1);
+    for (auto const & tab : tables) {
+        for (uint32_t seed = 1; seed <= 3; ++seed) {
+            std::vector<IpRange> const adds = random_delta(tab, seed * 100, seed);
+            std::vector<IpRange> const removes = random_delta(tab, seed * 100, seed + 10);
+            RouteTable expected = tab;
+            for (auto const & r : removes) {
+                expected.Erase(r);
+            }
+            for (auto const & r : adds) {
+                expected.Insert(r);
+            }
+
+            RouteTable t = tab;
+            t.ApplyDelta(adds.data(), adds.size(), removes.data(), removes.size());
+            expect_canonical(t);
+            expect_same_table(expected, t);
+            ASSERT_FALSE(t.IsCompiled());
+
+            // The patched index is the same as a new one, the index shared with the copy is not changed.
+            RouteTable compiled = tab;
+            compiled.Compile();
+            RouteTable const shared = compiled;
+            compiled.ApplyDelta(adds.data(), adds.size(), removes.data(), removes.size());
+            expect_same_table(expected, compiled);
+            expect_same_find(compiled, expected, seed);
+            expect_same_find(shared, tab, seed);
+
+            // Not shared, patched in place, again and again.
+            compiled.ApplyDelta(removes.data(), removes.size(), adds.data(), adds.size());
+            t.ApplyDelta(removes.data(), removes.size(), adds.data(), adds.size());
+            expect_same_table(t, compiled);
+            expect_same_find(compiled, t, seed);
+        }
+    }
+
+    RouteTable t;
+    t.ApplyDelta(nullptr, 0, nullptr, 0);
+    ASSERT_TRUE(t.IsEmpty());
+    IpRange const all{ 0, 0xffffffff };
+    t.ApplyDelta(&all, 1, nullptr, 0);
+    t.ApplyDelta(nullptr, 0, &all, 1);
+    ASSERT_TRUE(t.IsEmpty());
+}
+
 }
@@ -0,0 +1,211 @@
+#include <gtest/gtest.h>
+#include "route_table6.h"
+#include "route_table.h"
+#include <arpa/inet.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using yhb::RouteTable;
+using yhb::RouteTable6;
+using Address = RouteTable6::Address;
+using IpRange6 = RouteTable6::IpRange;
+using CIDR6 = RouteTable6::CIDR;
+
+static Address str_to_addr(const char * str) {
+    uint8_t bytes[16];
+    EXPECT_EQ(1, inet_pton(AF_INET6, str, bytes)) << str;
+    return Address::FromBytes(bytes);
+}
+
+static std::string addr_to_str(const Address & a) {
+    uint8_t bytes[16];
+    a.ToBytes(bytes);
+    char buf[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, bytes, buf, sizeof(buf));
+    return buf;
+}
+
+TEST(RouteTable6, Parse) {
+    RouteTable6 tab;
+    for (const char * s : { "", ":", ":::", "1:2:3:4:5:6:7", "1:2:3:4:5:6:7:8:9", "1::2::3", "12345::", "g::",
+            ":1::", "1::2:", "1:2:3:4:5:6:7:8::", "::1.2.3", "::01.2.3.4", "1:2:3:4:5:6:7:1.2.3.4", "::/",
+            "::/129", "::/0128", "::1/ 8", " ::1", "::1 ", "1.2.3.4", "::1/8/8" }) {
+        ASSERT_FALSE(tab.Insert(s)) << s;
+    }
+    ASSERT_TRUE(tab.IsEmpty());
+
+    for (const char * s : { "::", "::1", "1::", "2001:db8::8:800:200c:417a", "2001:DB8:0:0:8:800:200C:417A",
+            "1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8", "::ffff:1.2.3.4", "64:ff9b::192.0.2.33",
+            "1:2:3:4:5:6:1.2.3.4", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff" }) {
+        tab.Clear();
+        ASSERT_TRUE(tab.Insert(s)) << s;
+        ASSERT_EQ(1u, tab.GetCount());
+        Address const expected = str_to_addr(s);
+        ASSERT_EQ((IpRange6{ expected, expected }), *tab.begin()) << s;
+    }
+
+    tab.Clear();
+    ASSERT_TRUE(tab.Insert("2001:db8::1/32"));
+    ASSERT_EQ((IpRange6{ str_to_addr("2001:db8::"), str_to_addr("2001:db8:ffff:ffff:ffff:ffff:ffff:ffff") }),
+        *tab.begin());
+    ASSERT_TRUE(tab.Insert("::/0"));
+    ASSERT_EQ(1u, tab.GetCount());
+    ASSERT_EQ((IpRange6{ Address{ 0, 0 }, Address{ ~0ull, ~0ull } }), *tab.begin());
+}
+
+// Merging is the same as RouteTable, check it with the IPv4 ranges mapped into an IPv6 prefix.
+TEST(RouteTable6, Insert) {
+    std::mt19937 rng(1);
+    RouteTable tab4;
+    RouteTable6 tab6;
+    uint64_t const hi = 0x20010db800000000ull;
+    for (int i = 0; i < 20000; ++i) {
+        uint32_t const first = static_cast<uint32_t>(rng()) & 0xfffff;
+        uint32_t const last = first + (static_cast<uint32_t>(rng()) >> (20 + rng() % 12));
+        bool const ok = tab4.Insert(RouteTable::IpRange{ first, last });
+        ASSERT_EQ(ok, tab6.Insert(IpRange6{ Address{ hi, first }, Address{ hi, last } }));
+    }
+    ASSERT_EQ(tab4.GetCount(), tab6.GetCount());
+    auto it = tab6.begin();
+    for (auto const & r : tab4) {
+        ASSERT_EQ((IpRange6{ Address{ hi, r.first }, Address{ hi, r.last } }), *it++);
+    }
+
+    // Adjacent across the carry into the upper 64 bits.
+    RouteTable6 tab;
+    ASSERT_TRUE(tab.Insert(IpRange6{ Address{ 1, 0 }, Address{ 1, ~0ull } }));
+    ASSERT_TRUE(tab.Insert(IpRange6{ Address{ 2, 0 }, Address{ 2, 5 } }));
+    ASSERT_EQ(1u, tab.GetCount());
+    ASSERT_TRUE(tab.Insert(IpRange6{ Address{ 0, 5 }, Address{ 0, ~0ull - 1 } }));
+    ASSERT_EQ(2u, tab.GetCount());
+    ASSERT_TRUE(tab.Insert(IpRange6{ Address{ ~0ull, ~0ull }, Address{ ~0ull, ~0ull } }));
+    ASSERT_EQ(3u, tab.GetCount());
+    ASSERT_FALSE(tab.Insert(IpRange6{ Address{ 2, 0 }, Address{ 1, 0 } }));
+    ASSERT_TRUE(tab.Insert(IpRange6{ Address{ 0, ~0ull }, Address{ 0, ~0ull } }));
+    ASSERT_EQ(2u, tab.GetCount());
+    ASSERT_EQ((IpRange6{ Address{ 0, 5 }, Address{ 2, 5 } }), *tab.begin());
+}
+
+static void test_cidr_convert(const char * first, const char * last,
+    const std::vector<std::pair<std::string, uint32_t>> & expected)
+{
+    IpRange6 const range{ str_to_addr(first), str_to_addr(last) };
+    std::vector<std::pair<std::string, uint32_t>> actual;
+    range.ToCIDR([&actual](const CIDR6 & cidr) {
+        actual.emplace_back(addr_to_str(Address::FromBytes(cidr.prefix)), cidr.network_bits);
+    });
+    ASSERT_EQ(expected, actual) << first << " - " << last;
+}
+
+TEST(RouteTable6, Convert) {
+    test_cidr_convert("2001:db8::49", "2001:db8::84", {
+        { "2001:db8::49", 128 },
+        { "2001:db8::4a", 127 },
+        { "2001:db8::4c", 126 },
+        { "2001:db8::50", 124 },
+        { "2001:db8::60", 123 },
+        { "2001:db8::80", 126 },
+        { "2001:db8::84", 128 },
+    });
+    test_cidr_convert("::", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", { { "::", 0 } });
+    test_cidr_convert("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff",
+        { { "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", 128 } });
+    test_cidr_convert("::7", "::5", {});
+    test_cidr_convert("7fff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", {
+        { "7fff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", 128 },
+        { "8000::", 1 },
+    });
+    test_cidr_convert("2001:db8:0:1::", "2001:db8:0:2:ffff:ffff:ffff:ffff", {
+        { "2001:db8:0:1::", 64 },
+        { "2001:db8:0:2::", 64 },
+    });
+
+    // Converted back, the CIDRs make the same range.
+    IpRange6 const range{ Address{ 3, 12345 }, Address{ 0x100, 0x8000 } };
+    RouteTable6 tab;
+    range.ToCIDR([&tab](const CIDR6 & cidr) {
+        ASSERT_TRUE(tab.Insert(cidr.prefix, cidr.network_bits));
+    });
+    ASSERT_EQ(1u, tab.GetCount());
+    ASSERT_EQ(range, *tab.begin());
+}
+
+// Prefixes of all the lengths, clustered in a few /16 blocks so the trie goes deep, and some ranges not
+// aligned to /64.
+static void insert_random_prefixes(RouteTable6 & tab, size_t count, uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    uint64_t const clusters[] = { 0x2001000000000000ull, 0x2400000000000000ull, 0xfe80000000000000ull };
+    for (size_t i = 0; i < count; ++i) {
+        Address a = { clusters[rng() % 3] | (rng() >> 16), rng() };
+        if (i % 8 == 0) {
+            Address last = { a.hi + (rng() % 3), a.lo + (rng() >> 4) };
+            if (last < a) {
+                last = a;
+            }
+            tab.Insert(IpRange6{ a, last });
+        } else {
+            uint8_t bytes[16];
+            a.ToBytes(bytes);
+            tab.Insert(bytes, static_cast<unsigned>(20 + rng() % 109));
+        }
+    }
+}
+
+static void expect_same_find(const RouteTable6 & tab, const RouteTable6 & compiled, uint64_t seed) {
+    ASSERT_FALSE(tab.IsCompiled());
+    ASSERT_TRUE(compiled.IsCompiled());
+    std::vector<Address> ips = { { 0, 0 }, { 0, 1 }, { ~0ull, ~0ull }, { ~0ull, 0 }, { 0x8000000000000000ull, 0 } };
+    for (auto const & r : tab) {
+        for (uint64_t d : { ~0ull, 0ull, 1ull }) {
+            ips.push_back(Address{ r.first.hi, r.first.lo + d });
+            ips.push_back(Address{ r.last.hi, r.last.lo + d });
+            ips.push_back(Address{ r.first.hi + d, 0 });
+            ips.push_back(Address{ r.last.hi + d, ~0ull });
+        }
+    }
+    std::mt19937_64 rng(seed);
+    for (int i = 0; i < 10000; ++i) {
+        ips.push_back(Address{ rng(), rng() });
+    }
+    for (auto const & ip : ips) {
+        ASSERT_EQ(tab.Find(ip), compiled.Find(ip)) << addr_to_str(ip);
+        uint8_t bytes[16];
+        ip.ToBytes(bytes);
+        ASSERT_EQ(tab.Find(ip), compiled.Find(bytes)) << addr_to_str(ip);
+    }
+}
+
+TEST(RouteTable6, Compile) {
+    RouteTable6 tab;
+    RouteTable6 compiled;
+    compiled.Compile();
+    expect_same_find(tab, compiled, 1);
+
+    for (size_t n : { 1, 10, 1000, 20000 }) {
+        tab.Clear();
+        insert_random_prefixes(tab, n, static_cast<uint32_t>(n));
+        compiled = tab;
+        RouteTable6::CompileStats const stats = compiled.Compile();
+        ASSERT_GT(stats.memory_bytes, 0u);
+        expect_same_find(tab, compiled, n);
+    }
+
+    // Many ranges in a /64 block, searched after the trie.
+    for (uint64_t lo = 0; lo < 3000; ++lo) {
+        ASSERT_TRUE(tab.Insert(IpRange6{ Address{ 0x2001000000000000ull, lo * 7 }, Address{ 0x2001000000000000ull,
+            lo * 7 + lo % 3 } }));
+    }
+    compiled = tab;
+    compiled.Compile();
+    expect_same_find(tab, compiled, 3);
+
+    ASSERT_TRUE(tab.Insert("::/0"));
+    compiled = tab;
+    ASSERT_EQ(0u, compiled.Compile().node_count);
+    expect_same_find(tab, compiled, 2);
+
+    // Any change drops the index.
+    ASSERT_TRUE(compiled.Insert("::1"));
+    ASSERT_FALSE(compiled.IsCompiled());
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "segmenter.h"
+#include <vector>
+
+#ifdef __GNUC__
+#include <arpa/inet.h>
+#endif
+
+using yhb::L4Checksum;
+using yhb::TCPv4Segmenter;
+using yhb::UDPv4Segmenter;
+
+static const char HEADER_UDP[] =
+    "\x45\x00\x00\x00\xff\xfe\x40\x00\x40\x11\x00\x00\xc0\xa8\x11\x64"
+    "\x08\x08\x08\x08"
+    "\xe5\x9d\x00\x35\x00\x00\x00\x00";
+
+// TCP header with 4 bytes of options, flags CWR|PSH|ACK|FIN, the sequence number wraps around.
+static const char HEADER_TCP[] =
+    "\x45\x00\x00\x00\x49\x5a\x40\x00\x80\x06\x00\x00\xc0\xa8\x11\x64"
+    "\xa1\x75\x44\xcc"
+    "\x04\x4a\x01\xbb\xff\xff\xf0\x00\x1d\x71\x88\x56\x60\x99\x03\xfd"
+    "\x00\x00\x00\x00\x02\x04\x05\xb4";
+
+static uint16_t get_u16(const uint8_t * p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t * p) {
+    return (static_cast<uint32_t>(get_u16(p)) << 16) | get_u16(p + 2);
+}
+
+template <typename Segmenter>
+static void check_segments(const char * header, size_t header_len, size_t mss, size_t payload_len) {
+    Segmenter segmenter(header, header_len, mss);
+    ASSERT_TRUE(segmenter.IsValid());
+    ASSERT_EQ(header_len, segmenter.GetHeaderLength());
+
+    std::vector<char> payload(payload_len);
+    for (size_t i = 0; i < payload_len; ++i) {
+        payload[i] = static_cast<char>(i * 7 + (i >> 8));
+    }
+    size_t const count = segmenter.GetSegmentCount(payload_len);
+    std::vector<char> headers(count * header_len);
+    std::vector<typename Segmenter::Segment> segments(count);
+    ASSERT_EQ(count, segmenter.Split(payload.data(), payload_len, headers.data(), segments.data()));
+
+    const uint8_t * const orig = reinterpret_cast<const uint8_t *>(header);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        typename Segmenter::Segment const & seg = segments[i];
+        ASSERT_EQ(&headers[i * header_len], seg.header);
+        ASSERT_EQ(header_len, seg.header_len);
+        ASSERT_EQ(payload.data() + offset, seg.payload);     // Zero-copy
+        ASSERT_EQ(std::min(mss, payload_len - offset), seg.payload_len);
+
+        std::vector<char> packet(static_cast<char *>(seg.header), static_cast<char *>(seg.header) + header_len);
+        packet.insert(packet.end(), payload.begin() + offset, payload.begin() + offset + seg.payload_len);
+        ASSERT_TRUE(L4Checksum::VerifyPacket(packet.data(), packet.size())) << i;
+
+        const uint8_t * const h = reinterpret_cast<const uint8_t *>(packet.data());
+        ASSERT_EQ(packet.size(), get_u16(h + 2));
+        ASSERT_EQ(static_cast<uint16_t>(get_u16(orig + 4) + i), get_u16(h + 4));
+        if (orig[9] == 6) {
+            ASSERT_EQ(get_u32(orig + 24) + static_cast<uint32_t>(offset), get_u32(h + 24));
+            uint8_t expected_flags = orig[33];
+            if (i != 0) {
+                expected_flags &= ~0x80;
+            }
+            if (i != count - 1) {
+                expected_flags &= ~0x09;
+            }
+            ASSERT_EQ(expected_flags, h[33]);
+        }
+        offset += seg.payload_len;
+    }
+    ASSERT_EQ(payload_len, offset);
+}
+
+TEST(SegmenterTest, Udp) {
+    size_t const header_len = sizeof(HEADER_UDP) - 1;
+    check_segments<UDPv4Segmenter>(HEADER_UDP, header_len, 1472, 10000);
+    check_segments<UDPv4Segmenter>(HEADER_UDP, header_len, 1001, 10000);
+    check_segments<UDPv4Segmenter>(HEADER_UDP, header_len, 1000, 10000);
+    check_segments<UDPv4Segmenter>(HEADER_UDP, header_len, 1472, 1);
+    check_segments<UDPv4Segmenter>(HEADER_UDP, header_len, 1472, 0);
+}
+
+TEST(SegmenterTest, Tcp) {
+    size_t const header_len = sizeof(HEADER_TCP) - 1;
+    check_segments<TCPv4Segmenter>(HEADER_TCP, header_len, 1448, 64 * 1024 - 100);
+    check_segments<TCPv4Segmenter>(HEADER_TCP, header_len, 537, 20000);
+    check_segments<TCPv4Segmenter>(HEADER_TCP, header_len, 1448, 1448);
+    check_segments<TCPv4Segmenter>(HEADER_TCP, header_len, 1448, 0);
+}
+
+TEST(SegmenterTest, Invalid) {
+    UDPv4Segmenter const no_mss(HEADER_UDP, sizeof(HEADER_UDP) - 1, 0);
+    ASSERT_FALSE(no_mss.IsValid());
+    ASSERT_EQ(0u, no_mss.GetSegmentCount(1000));
+    char const payload[16] = {};
+    ASSERT_EQ(0u, no_mss.Split(payload, sizeof(payload), nullptr, nullptr));
+    ASSERT_EQ(0u, TCPv4Segmenter(HEADER_TCP, sizeof(HEADER_TCP) - 1, 0).GetSegmentCount(0));
+    ASSERT_FALSE(UDPv4Segmenter(HEADER_UDP, sizeof(HEADER_UDP) - 1, 0xffff).IsValid());
+    ASSERT_FALSE(TCPv4Segmenter(HEADER_TCP, 30, 1448).IsValid());
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "shared_route_table.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using yhb::RouteTable;
+using yhb::SharedRouteTable;
+using IpRange = RouteTable::IpRange;
+
+static std::string test_name() {
+    return "/yhb_test_shared_route_table_" + std::to_string(getpid());
+}
+
+static void expect_same_find(const RouteTable & tab, const SharedRouteTable & shared, uint32_t seed) {
+    ASSERT_EQ(tab.GetCount(), shared.GetTable().GetCount());
+    ASSERT_TRUE(std::equal(tab.begin(), tab.end(), shared.GetTable().begin()));
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 10000; ++i) {
+        uint32_t const ip = static_cast<uint32_t>(rng());
+        ASSERT_EQ(tab.Find(ip, true), shared.Find(ip, true)) << ip;
+        ASSERT_EQ(tab.Find(ip, true), shared.Find(htonl(ip), false)) << ip;
+    }
+    for (auto const & r : tab) {
+        ASSERT_TRUE(shared.Find(r.first, true));
+        ASSERT_TRUE(shared.Find(r.last, true));
+    }
+}
+
+TEST(SharedRouteTable, Generations) {
+    std::string const name = test_name();
+    SharedRouteTable::Unlink(name.c_str());
+    SharedRouteTable reader;
+    ASSERT_FALSE(reader.Open(name.c_str()));
+    ASSERT_FALSE(reader.IsOpen());
+    ASSERT_FALSE(reader.Refresh());
+
+    RouteTable tab;
+    std::mt19937 rng(1);
+    for (int i = 0; i < 5000; ++i) {
+        uint32_t const first = static_cast<uint32_t>(rng());
+        tab.Insert(IpRange{ first, first + (static_cast<uint32_t>(rng()) >> 20) });
+    }
+    uint64_t generation = 0;
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), tab, &generation));
+    ASSERT_EQ(1u, generation);
+    ASSERT_TRUE(reader.Open(name.c_str()));
+    ASSERT_EQ(1u, reader.GetGeneration());
+    ASSERT_FALSE(reader.GetTable().HasIndex());
+    expect_same_find(tab, reader, 1);
+    ASSERT_FALSE(reader.Refresh());
+
+    // A new generation, compiled, the old one is still usable until Refresh().
+    RouteTable const old = tab;
+    ASSERT_TRUE(tab.Insert("10.0.0.0/8"));
+    tab.Compile();
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), tab, &generation));
+    ASSERT_EQ(2u, generation);
+    expect_same_find(old, reader, 2);
+    ASSERT_TRUE(reader.Refresh());
+    ASSERT_EQ(2u, reader.GetGeneration());
+    ASSERT_TRUE(reader.GetTable().HasIndex());
+    expect_same_find(tab, reader, 3);
+
+    // Skipped generations.
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), RouteTable(), nullptr));
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), old, &generation));
+    ASSERT_EQ(4u, generation);
+    ASSERT_TRUE(reader.Refresh());
+    ASSERT_EQ(4u, reader.GetGeneration());
+    expect_same_find(old, reader, 4);
+
+    // Removed, the mapped table is still usable.
+    SharedRouteTable::Unlink(name.c_str());
+    expect_same_find(old, reader, 5);
+    ASSERT_FALSE(reader.Refresh());
+    SharedRouteTable other;
+    ASSERT_FALSE(other.Open(name.c_str()));
+    reader.Close();
+    ASSERT_FALSE(reader.IsOpen());
+    ASSERT_FALSE(reader.Find(old.begin()->first, true));
+}
+
+// The readers are other processes.
+TEST(SharedRouteTable, Processes) {
+    std::string const name = test_name();
+    SharedRouteTable::Unlink(name.c_str());
+    RouteTable tab;
+    ASSERT_TRUE(tab.Insert("192.168.0.0/16"));
+    tab.Compile();
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), tab));
+
+    // Each child checks the table, then waits for the next generation.
+    int pipes[2];
+    int ready[2];
+    ASSERT_EQ(0, pipe(pipes));
+    ASSERT_EQ(0, pipe(ready));
+    std::vector<pid_t> children;
+    for (int i = 0; i < 3; ++i) {
+        pid_t const pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            close(pipes[1]);
+            close(ready[0]);
+            SharedRouteTable reader;
+            bool ok = reader.Open(name.c_str()) && reader.Find(0xc0a80101, true) && !reader.Find(0x0a000001, true);
+            char ch = ok ? 1 : 0;
+            ok = write(ready[1], &ch, 1) == 1 && ok;
+            ok = ok && read(pipes[0], &ch, 1) == 0;     // Closed by the parent after publishing.
+            ok = ok && reader.Refresh() && reader.Find(0x0a000001, true) && reader.GetGeneration() == 2;
+            _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+    close(pipes[0]);
+    close(ready[1]);
+    // Not published before all the children have opened the first generation.
+    for (size_t i = 0; i < children.size(); ++i) {
+        char ch;
+        ASSERT_EQ(1, read(ready[0], &ch, 1));
+    }
+    close(ready[0]);
+    ASSERT_TRUE(tab.Insert("10.0.0.0/8"));
+    ASSERT_TRUE(SharedRouteTable::Publish(name.c_str(), tab));
+    close(pipes[1]);
+    for (pid_t pid : children) {
+        int status = 0;
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+    }
+    SharedRouteTable::Unlink(name.c_str());
+}